@@ -0,0 +1,353 @@
+#ifndef INDRA_HEADS_ASYNC_DRIVER_HPP
+#define INDRA_HEADS_ASYNC_DRIVER_HPP
+
+#if __cplusplus < 202002L
+#error "indra_heads_protocol/AsyncDriver.hpp requires C++20 coroutines"
+#endif
+
+#include <indra_heads_protocol/Driver.hpp>
+#include <algorithm>
+#include <coroutine>
+#include <exception>
+#include <poll.h>
+#include <vector>
+
+namespace indra_heads_protocol
+{
+    /** Coroutine-based asynchronous request API
+     *
+     * This is header-only and requires C++20. The library itself does not
+     * depend on it.
+     *
+     * <code>
+     * async::Task point(async::AsyncDriver& head)
+     * {
+     *     ResponseStatus status = co_await head.request(requests::AnglesGeo(0, 0.1, 0));
+     *     ...
+     * }
+     *
+     * async::EventLoop loop;
+     * async::AsyncDriver head(loop, driver);
+     * async::Task flow = point(head);
+     * loop.run();
+     * flow.get();
+     * </code>
+     *
+     * Beware of coroutine lambdas: their captures live in the closure
+     * object, not in the coroutine frame, so a lambda that is called
+     * immediately must not use its captures after its first co_await
+     */
+    namespace async
+    {
+        class EventLoop;
+
+        /** Return type of the coroutines that use the asynchronous API
+         *
+         * The coroutine starts immediately, and runs until its first
+         * co_await. Exceptions thrown by the coroutine are rethrown by get()
+         *
+         * Destroying a Task that waits for a response cancels the wait: the
+         * response, if it ever arrives, is ignored
+         */
+        class Task
+        {
+        public:
+            struct promise_type
+            {
+                std::exception_ptr exception;
+
+                Task get_return_object()
+                {
+                    return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+                }
+                std::suspend_never initial_suspend() noexcept { return {}; }
+                std::suspend_always final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception() { exception = std::current_exception(); }
+            };
+
+            Task(Task&& other) noexcept
+                : mHandle(other.mHandle)
+            {
+                other.mHandle = nullptr;
+            }
+            Task& operator=(Task&& other) noexcept
+            {
+                std::swap(mHandle, other.mHandle);
+                return *this;
+            }
+            Task(Task const&) = delete;
+            Task& operator=(Task const&) = delete;
+
+            ~Task()
+            {
+                if (mHandle)
+                    mHandle.destroy();
+            }
+
+            /** Whether the coroutine finished */
+            bool done() const
+            {
+                return !mHandle || mHandle.done();
+            }
+
+            /** Rethrow the exception that terminated the coroutine, if there
+             * is one
+             */
+            void get() const
+            {
+                if (mHandle && mHandle.promise().exception)
+                    std::rethrow_exception(mHandle.promise().exception);
+            }
+
+        private:
+            explicit Task(std::coroutine_handle<promise_type> handle)
+                : mHandle(handle) {}
+
+            std::coroutine_handle<promise_type> mHandle;
+        };
+
+        /** State of a request that waits for its response
+         *
+         * It lives in the awaiting coroutine's frame, the event loop only
+         * keeps pointers to it
+         */
+        struct PendingRequest
+        {
+            CommandIDs command_id;
+            base::Time deadline;
+            std::coroutine_handle<> handle;
+            ResponseStatus status = STATUS_FAILED;
+            bool timed_out = false;
+        };
+
+        class AsyncDriver;
+
+        /** Single-threaded event loop that resumes the coroutines waiting on
+         * the responses of a set of drivers
+         */
+        class EventLoop
+        {
+            friend class AsyncDriver;
+            std::vector<AsyncDriver*> mDrivers;
+            std::vector<pollfd> mPollFDs;
+            std::vector<std::coroutine_handle<>> mReady;
+
+        public:
+            /** Process the events for at most the given time
+             *
+             * @return false if there are no pending requests anymore
+             */
+            bool step(base::Time const& timeout);
+
+            /** Run until all requests got a response or timed out */
+            void run()
+            {
+                while (step(base::Time::fromSeconds(1)));
+            }
+        };
+
+        /** Asynchronous requests on a Driver
+         *
+         * Responses do not carry a sequence number. They are matched with
+         * the oldest pending request that has the same command ID.
+         */
+        class AsyncDriver
+        {
+            friend class EventLoop;
+            EventLoop& mLoop;
+            Driver& mDriver;
+            std::vector<PendingRequest*> mPending;
+
+        public:
+            template<typename T>
+            struct RequestAwaiter
+            {
+                AsyncDriver& driver;
+                T packet;
+                base::Time timeout;
+                PendingRequest pending;
+
+                /** Called when the awaiting coroutine is destroyed while
+                 * suspended, or after it got resumed
+                 */
+                ~RequestAwaiter()
+                {
+                    driver.cancel(&pending);
+                }
+
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> handle)
+                {
+                    driver.mDriver.sendRequest(packet);
+                    pending.command_id = static_cast<CommandIDs>(packet.command_id);
+                    pending.deadline = base::Time::now() + timeout;
+                    pending.handle = handle;
+                    driver.mPending.push_back(&pending);
+                }
+                ResponseStatus await_resume()
+                {
+                    if (pending.timed_out)
+                        throw iodrivers_base::TimeoutError(
+                            iodrivers_base::TimeoutError::PACKET,
+                            "timed out waiting for the response");
+                    return pending.status;
+                }
+            };
+
+            AsyncDriver(EventLoop& loop, Driver& driver)
+                : mLoop(loop)
+                , mDriver(driver)
+            {
+                loop.mDrivers.push_back(this);
+            }
+
+            ~AsyncDriver()
+            {
+                auto& drivers = mLoop.mDrivers;
+                drivers.erase(std::remove(drivers.begin(), drivers.end(), this),
+                              drivers.end());
+            }
+
+            AsyncDriver(AsyncDriver const&) = delete;
+            AsyncDriver& operator=(AsyncDriver const&) = delete;
+
+            /** Send a request and wait for its response
+             *
+             * co_await on the returned object returns the response status.
+             * It throws iodrivers_base::TimeoutError if no response arrived
+             * within the driver's read timeout.
+             */
+            template<typename T>
+            RequestAwaiter<T> request(T const& packet)
+            {
+                return request(packet, mDriver.getReadTimeout());
+            }
+
+            /** Send a request and wait for its response with an explicit
+             * timeout
+             */
+            template<typename T>
+            RequestAwaiter<T> request(T const& packet, base::Time const& timeout)
+            {
+                return RequestAwaiter<T> { *this, packet, timeout, PendingRequest() };
+            }
+
+            /** Number of requests waiting for a response */
+            size_t getPendingCount() const
+            {
+                return mPending.size();
+            }
+
+        private:
+            /** Forget about a request whose coroutine is going away */
+            void cancel(PendingRequest* pending)
+            {
+                mPending.erase(std::remove(mPending.begin(), mPending.end(), pending),
+                               mPending.end());
+                // The coroutine may also have been made ready in the current
+                // step, but not resumed yet
+                for (auto& handle : mLoop.mReady)
+                {
+                    if (handle == pending->handle)
+                        handle = nullptr;
+                }
+            }
+
+            void dispatch(Response const& response, std::vector<std::coroutine_handle<>>& ready)
+            {
+                for (auto it = mPending.begin(); it != mPending.end(); ++it)
+                {
+                    if ((*it)->command_id == response.command_id)
+                    {
+                        (*it)->status = response.status;
+                        ready.push_back((*it)->handle);
+                        mPending.erase(it);
+                        return;
+                    }
+                }
+            }
+
+            void readResponses(std::vector<std::coroutine_handle<>>& ready)
+            {
+                while (true)
+                {
+                    try {
+                        dispatch(mDriver.readResponse(base::Time()), ready);
+                    }
+                    catch(iodrivers_base::TimeoutError&) {
+                        return;
+                    }
+                }
+            }
+
+            void expire(base::Time const& now, std::vector<std::coroutine_handle<>>& ready)
+            {
+                for (auto it = mPending.begin(); it != mPending.end(); )
+                {
+                    if ((*it)->deadline <= now)
+                    {
+                        (*it)->timed_out = true;
+                        ready.push_back((*it)->handle);
+                        it = mPending.erase(it);
+                    }
+                    else
+                        ++it;
+                }
+            }
+        };
+
+        inline bool EventLoop::step(base::Time const& timeout)
+        {
+            base::Time now = base::Time::now();
+            base::Time deadline = now + timeout;
+            mPollFDs.clear();
+            bool has_pending = false;
+            for (AsyncDriver* driver : mDrivers)
+            {
+                pollfd fd;
+                fd.fd = driver->mDriver.getFileDescriptor();
+                fd.events = POLLIN;
+                fd.revents = 0;
+                mPollFDs.push_back(fd);
+                for (PendingRequest* pending : driver->mPending)
+                {
+                    has_pending = true;
+                    deadline = std::min(deadline, pending->deadline);
+                }
+            }
+            if (!has_pending)
+                return false;
+
+            int64_t wait_ms = std::max<int64_t>(0, (deadline - now).toMilliseconds() + 1);
+            poll(mPollFDs.data(), mPollFDs.size(), wait_ms);
+
+            // Responses are processed on every step, not only on readable
+            // file descriptors, as the driver might have buffered a complete
+            // packet already
+            mReady.clear();
+            now = base::Time::now();
+            for (AsyncDriver* driver : mDrivers)
+            {
+                driver->readResponses(mReady);
+                driver->expire(now, mReady);
+            }
+            // Resuming a coroutine may destroy others, which then get
+            // cleared from mReady
+            for (size_t i = 0; i < mReady.size(); ++i)
+            {
+                if (mReady[i])
+                    mReady[i].resume();
+            }
+
+            for (AsyncDriver* driver : mDrivers)
+            {
+                if (!driver->mPending.empty())
+                    return true;
+            }
+            return false;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,1185 @@
+#include <indra_heads_protocol/ConfigurationSnapshot.hpp>
+#include <indra_heads_protocol/DecodePipeline.hpp>
+#include <indra_heads_protocol/GeoPointing.hpp>
+#include <indra_heads_protocol/Multicast.hpp>
+#include <indra_heads_protocol/PacketParser.hpp>
+#include <indra_heads_protocol/RequestServer.hpp>
+#include <indra_heads_protocol/SetpointScheduler.hpp>
+#include <indra_heads_protocol/TelemetryStore.hpp>
+#include <iodrivers_base/IOStream.hpp>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <cmath>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+void usage()
+{
+    std::cout
+        << "usage: indra_heads_protocol_bench [NAME]\n"
+        << "  runs all the benchmarks, or only the ones whose name starts with NAME\n"
+        << std::endl;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedSeconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void report(std::string const& name, size_t bytes, double seconds)
+{
+    std::cout
+        << "  " << std::left << std::setw(40) << name << std::right
+        << std::setw(10) << std::fixed << std::setprecision(2)
+        << seconds * 1e9 / bytes << " ns/byte"
+        << std::setw(10) << bytes / seconds / 1e6 << " MB/s"
+        << std::endl;
+}
+
+/** A stream of all the packet types of the protocol, back to back */
+std::vector<uint8_t> makeStream(int repeat)
+{
+    std::vector<std::vector<uint8_t>> packets = {
+        requests::packetize(requests::Stop()),
+        requests::packetize(requests::BITE()),
+        requests::packetize(requests::StatusRefreshRatePT(RATE_20HZ)),
+        requests::packetize(requests::StatusRefreshRateIMU(RATE_10HZ)),
+        requests::packetize(requests::AnglesRelative(0.1, 0.3, 0.2)),
+        requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2)),
+        requests::packetize(requests::AngularVelocityRelative(0.1, -0.2, 0.3)),
+        requests::packetize(requests::AngularVelocityGeo(0.1, -0.2, 0.3)),
+        requests::packetize(requests::PositionGeo(-0.1, 0.2, -0.3)),
+        requests::packetize(reply::Response(ID_ANGLES_GEO, STATUS_FAILED))
+    };
+
+    std::vector<uint8_t> stream;
+    for (int i = 0; i < repeat; ++i) {
+        for (auto const& p : packets)
+            stream.insert(stream.end(), p.begin(), p.end());
+    }
+    return stream;
+}
+
+/** The stateless framing, which re-validates the whole buffer on each call */
+int rescanExtract(uint8_t const* buffer, size_t buffer_size)
+{
+    if (buffer_size == 0)
+        return 0;
+    else if (buffer[0] > ID_LAST)
+        return -1;
+    else if (buffer_size < 2)
+        return 0;
+    else if (buffer[1] > MSG_LAST_TYPE)
+        return -1;
+
+    size_t packet_size   = packets::getPacketSize(
+            static_cast<CommandIDs>(buffer[0]),
+            static_cast<MessageTypes>(buffer[1]));
+    size_t expected_size = packet_size + sizeof(crc_t);
+    if (buffer_size < expected_size)
+        return 0;
+
+    crc_t expected_crc = *reinterpret_cast<crc_t const*>(buffer + packet_size);
+    crc_t actual_crc   = details::compute_crc(buffer, packet_size);
+    if (actual_crc != expected_crc)
+        return -1;
+    return expected_size;
+}
+
+/** Feed the stream to the extraction function the way iodrivers_base
+ * does, in chunks of chunk_size bytes
+ */
+template<typename Extract>
+size_t deliverInChunks(std::vector<uint8_t> const& stream, size_t chunk_size,
+                       Extract extract)
+{
+    std::vector<uint8_t> buffer(MAX_PACKET_SIZE * 10);
+    size_t buffer_size = 0;
+    size_t packets = 0;
+    for (size_t i = 0; i < stream.size(); i += chunk_size)
+    {
+        size_t size = std::min(chunk_size, stream.size() - i);
+        std::memcpy(buffer.data() + buffer_size, stream.data() + i, size);
+        buffer_size += size;
+
+        size_t start = 0;
+        while (start < buffer_size)
+        {
+            int result = extract(buffer.data() + start, buffer_size - start);
+            if (result == 0)
+                break;
+            else if (result < 0)
+                start += -result;
+            else
+            {
+                start += result;
+                ++packets;
+            }
+        }
+        std::memmove(buffer.data(), buffer.data() + start, buffer_size - start);
+        buffer_size -= start;
+    }
+    return packets;
+}
+
+void benchmarkFraming()
+{
+    auto stream = makeStream(100000);
+    for (size_t chunk_size : { 1, 4, 64 })
+    {
+        std::string suffix = " (" + std::to_string(chunk_size) + " bytes/read)";
+
+        auto start = Clock::now();
+        size_t rescan_count = deliverInChunks(stream, chunk_size, rescanExtract);
+        report("rescan" + suffix, stream.size(), elapsedSeconds(start));
+
+        PacketParser parser;
+        start = Clock::now();
+        size_t incremental_count = deliverInChunks(stream, chunk_size,
+            [&parser](uint8_t const* buffer, size_t size) {
+                return parser.extract(buffer, size);
+            });
+        report("incremental" + suffix, stream.size(), elapsedSeconds(start));
+
+        if (rescan_count != incremental_count)
+            throw std::logic_error("framing implementations disagree");
+    }
+}
+
+void benchmarkScheduler()
+{
+    for (int rate : { 50, 100, 200 })
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+            throw std::runtime_error("failed to create socket pair");
+
+        Driver driver;
+        driver.setMainStream(new iodrivers_base::FDStream(fds[0], true));
+
+        Trajectory trajectory(2);
+        trajectory[0].command_id = ID_ANGULAR_VELOCITY_GEO;
+        trajectory[0].rpy = Eigen::Vector3d(0, 0, 0);
+        trajectory[1] = trajectory[0];
+        trajectory[1].time = base::Time::fromSeconds(1);
+        trajectory[1].rpy = Eigen::Vector3d(0.1, 0.2, 0.3);
+
+        SetpointScheduler scheduler(driver, base::Time::fromSeconds(1.0 / rate));
+        scheduler.setTrajectory(trajectory);
+        scheduler.run();
+        ::close(fds[1]);
+
+        auto stats = scheduler.getStatistics();
+        std::cout
+            << "  " << std::left << std::setw(10) << (std::to_string(rate) + "Hz")
+            << std::right
+            << " ticks=" << stats.ticks
+            << " missed=" << stats.missed_ticks
+            << " jitter(us) min=" << stats.jitter_min.toMicroseconds()
+            << " mean=" << stats.jitter_mean.toMicroseconds()
+            << " max=" << stats.jitter_max.toMicroseconds()
+            << " stddev=" << stats.jitter_stddev.toMicroseconds()
+            << std::endl;
+    }
+}
+
+/** Reads the other side of a link at a limited rate and timestamps the
+ * STOP packets it receives
+ */
+struct RateLimitedReader
+{
+    int fd;
+    double bytes_per_second;
+    std::atomic<int64_t> last_stop_ns;
+    std::thread thread;
+
+    RateLimitedReader(int fd, double bytes_per_second)
+        : fd(fd)
+        , bytes_per_second(bytes_per_second)
+        , last_stop_ns(0)
+        , thread([this]() { run(); }) {}
+
+    ~RateLimitedReader()
+    {
+        ::shutdown(fd, SHUT_RDWR);
+        thread.join();
+        ::close(fd);
+    }
+
+    void run()
+    {
+        PacketParser parser;
+        std::vector<uint8_t> buffer(MAX_PACKET_SIZE * 10);
+        size_t buffer_size = 0;
+        while (true)
+        {
+            ssize_t size = ::read(fd, buffer.data() + buffer_size,
+                                  std::min<size_t>(16, buffer.size() - buffer_size));
+            if (size <= 0)
+                return;
+            buffer_size += size;
+
+            size_t start = 0;
+            while (start < buffer_size)
+            {
+                int result = parser.extract(buffer.data() + start, buffer_size - start);
+                if (result == 0)
+                    break;
+                else if (result < 0)
+                    start += -result;
+                else
+                {
+                    if (buffer[start] == ID_STOP)
+                        last_stop_ns = Clock::now().time_since_epoch().count();
+                    start += result;
+                }
+            }
+            std::memmove(buffer.data(), buffer.data() + start, buffer_size - start);
+            buffer_size -= start;
+
+            std::this_thread::sleep_for(
+                std::chrono::duration<double>(size / bytes_per_second));
+        }
+    }
+};
+
+void benchmarkStop()
+{
+    // Emulates a 1Mbaud serial link
+    double const link_rate = 100000;
+    int const trials = 10;
+
+    for (bool priority : { false, true })
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+            throw std::runtime_error("failed to create socket pair");
+        int sndbuf = 0;
+        setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+        Driver driver;
+        driver.setMainStream(new iodrivers_base::FDStream(fds[0], true));
+        driver.setRequestQueueCapacity(256);
+        RateLimitedReader reader(fds[1], link_rate);
+
+        double worst = 0, sum = 0;
+        for (int i = 0; i < trials; ++i)
+        {
+            // Saturate the link with setpoints for a while, keeping the
+            // outgoing queue full
+            auto saturate_until = Clock::now() + std::chrono::milliseconds(50);
+            while (Clock::now() < saturate_until)
+            {
+                while (driver.queueRequest(requests::AngularVelocityGeo(0.1, 0.2, 0.3)));
+                pollfd pfd = { driver.getFileDescriptor(), POLLOUT, 0 };
+                if (poll(&pfd, 1, 1) == 1)
+                    driver.writeQueuedRequests(1);
+            }
+
+            int64_t previous_stop = reader.last_stop_ns;
+            auto start = Clock::now();
+            if (priority)
+                driver.sendPriorityRequest(framed::STOP);
+            else
+            {
+                while (!driver.queueRequest(requests::Stop()))
+                    driver.writeQueuedRequests(1);
+                driver.writeQueuedRequests();
+            }
+            while (reader.last_stop_ns == previous_stop)
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+            double latency = (reader.last_stop_ns - start.time_since_epoch().count()) * 1e-9;
+            worst = std::max(worst, latency);
+            sum += latency;
+        }
+
+        std::cout
+            << "  " << std::left << std::setw(40)
+            << (priority ? "priority STOP" : "queued STOP") << std::right
+            << std::fixed << std::setprecision(2)
+            << " mean=" << sum / trials * 1e3 << "ms"
+            << " worst=" << worst * 1e3 << "ms"
+            << std::endl;
+    }
+}
+
+void benchmarkWatchdog()
+{
+    int const trials = 20;
+    for (int deadline_ms : { 20, 100 })
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+            throw std::runtime_error("failed to create socket pair");
+
+        Driver driver;
+        driver.setMainStream(new iodrivers_base::FDStream(fds[0], true));
+        driver.setSetpointTimeout(RequestedConfiguration::ANGULAR_VELOCITY_GEO,
+                                  base::Time::fromMilliseconds(deadline_ms));
+        std::vector<uint8_t> setpoint =
+            requests::packetize(requests::AngularVelocityGeo(0.1, 0.2, 0.3));
+
+        double worst = 0, sum = 0;
+        for (int i = 0; i < trials; ++i)
+        {
+            if (::write(fds[1], setpoint.data(), setpoint.size()) != static_cast<ssize_t>(setpoint.size()))
+                throw std::runtime_error("failed to write setpoint");
+            driver.readRequest();
+            base::Time deadline = driver.getRequestedConfiguration().time +
+                base::Time::fromMilliseconds(deadline_ms);
+
+            pollfd pfd = { driver.getWatchdogFileDescriptor(), POLLIN, 0 };
+            while (true)
+            {
+                poll(&pfd, 1, -1);
+                if (driver.processWatchdog())
+                    break;
+            }
+            double latency = (base::Time::now() - deadline).toSeconds();
+            worst = std::max(worst, latency);
+            sum += latency;
+        }
+        ::close(fds[1]);
+
+        std::cout
+            << "  " << std::left << std::setw(40)
+            << ("deadline " + std::to_string(deadline_ms) + "ms") << std::right
+            << std::fixed << std::setprecision(1)
+            << " detection latency mean=" << sum / trials * 1e6 << "us"
+            << " worst=" << worst * 1e6 << "us"
+            << std::endl;
+    }
+}
+
+void benchmarkGeoPointing()
+{
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> offset(-0.5, 0.5);
+    std::uniform_real_distribution<double> altitude(0, 3000);
+
+    for (size_t count : { 100, 10000 })
+    {
+        std::vector<GeoTarget> targets(count);
+        for (auto& target : targets)
+            target = GeoTarget(45 + offset(rng), 10 + offset(rng), altitude(rng));
+
+        GeoPointing pointing;
+        int const batches = 1000000 / count;
+        auto start = Clock::now();
+        for (int i = 0; i < batches; ++i)
+        {
+            pointing.setTargets(targets);
+            pointing.update(GeoTarget(45, 10, 10), Eigen::Vector3d(0.01, -0.02, 0.3));
+        }
+        double batch = elapsedSeconds(start);
+
+        // Fixed targets, moving ship
+        start = Clock::now();
+        for (int i = 0; i < batches; ++i)
+            pointing.update(GeoTarget(45 + i * 1e-6, 10, 10), Eigen::Vector3d(0.01, -0.02, 0.3 + i * 1e-4));
+        double streaming = elapsedSeconds(start);
+
+        size_t total = batches * count;
+        std::cout
+            << "  " << std::left << std::setw(40)
+            << (std::to_string(count) + " targets") << std::right
+            << std::fixed << std::setprecision(0)
+            << " batch=" << total / batch / 1e3 << " targets/ms"
+            << " streaming=" << total / streaming / 1e3 << " targets/ms"
+            << std::endl;
+    }
+}
+
+/** Field-by-field serialization of a RequestedConfiguration, i.e. what a
+ * logger has to do without ConfigurationSnapshot
+ */
+size_t serializeConfiguration(RequestedConfiguration const& conf, uint8_t* buffer)
+{
+    int64_t time = conf.time.toMicroseconds();
+    int32_t enums[4] = { conf.command_id, conf.rate_status_pt,
+                         conf.rate_status_imu, conf.control_mode };
+    double values[6] = { conf.rpy.x(), conf.rpy.y(), conf.rpy.z(),
+                         conf.lat_lon_alt.latitude, conf.lat_lon_alt.longitude,
+                         conf.lat_lon_alt.altitude };
+    std::memcpy(buffer, &time, sizeof(time));
+    std::memcpy(buffer + sizeof(time), enums, sizeof(enums));
+    std::memcpy(buffer + sizeof(time) + sizeof(enums), values, sizeof(values));
+    return sizeof(time) + sizeof(enums) + sizeof(values);
+}
+
+void reportPerRecord(std::string const& name, size_t count, size_t record_size, double seconds)
+{
+    std::cout
+        << "  " << std::left << std::setw(40) << name << std::right
+        << std::setw(10) << std::fixed << std::setprecision(2)
+        << seconds * 1e9 / count << " ns/record"
+        << std::setw(6) << record_size << " bytes/record"
+        << std::endl;
+}
+
+void benchmarkSnapshot()
+{
+    size_t const count = 4096;
+    int const repeat = 1000;
+
+    std::vector<RequestedConfiguration> configurations(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        configurations[i].time = base::Time::fromMicroseconds(i);
+        configurations[i].command_id = ID_ANGULAR_VELOCITY_GEO;
+        configurations[i].control_mode = RequestedConfiguration::ANGULAR_VELOCITY_GEO;
+        configurations[i].rpy = Eigen::Vector3d(0.1, -0.2, 0.3);
+    }
+    std::vector<ConfigurationSnapshot> snapshots(count);
+    for (size_t i = 0; i < count; ++i)
+        snapshots[i] = ConfigurationSnapshot::fromConfiguration(configurations[i]);
+
+    std::vector<RequestedConfiguration> configuration_copies(count);
+    auto start = Clock::now();
+    for (int r = 0; r < repeat; ++r)
+    {
+        std::copy(configurations.begin(), configurations.end(), configuration_copies.begin());
+        asm volatile("" : : "r"(configuration_copies.data()) : "memory");
+    }
+    reportPerRecord("copy RequestedConfiguration", count * repeat,
+                    sizeof(RequestedConfiguration), elapsedSeconds(start));
+
+    std::vector<ConfigurationSnapshot> snapshot_copies(count);
+    start = Clock::now();
+    for (int r = 0; r < repeat; ++r)
+    {
+        std::copy(snapshots.begin(), snapshots.end(), snapshot_copies.begin());
+        asm volatile("" : : "r"(snapshot_copies.data()) : "memory");
+    }
+    reportPerRecord("copy ConfigurationSnapshot", count * repeat,
+                    sizeof(ConfigurationSnapshot), elapsedSeconds(start));
+
+    std::vector<uint8_t> buffer(count * 128);
+    size_t record_size = 0;
+    start = Clock::now();
+    for (int r = 0; r < repeat; ++r)
+    {
+        uint8_t* out = buffer.data();
+        for (auto const& conf : configurations)
+        {
+            record_size = serializeConfiguration(conf, out);
+            out += record_size;
+        }
+        asm volatile("" : : "r"(buffer.data()) : "memory");
+    }
+    reportPerRecord("serialize RequestedConfiguration", count * repeat,
+                    record_size, elapsedSeconds(start));
+
+    start = Clock::now();
+    for (int r = 0; r < repeat; ++r)
+    {
+        uint8_t* out = buffer.data();
+        for (auto const& conf : configurations)
+        {
+            ConfigurationSnapshot snapshot = ConfigurationSnapshot::fromConfiguration(conf);
+            std::memcpy(out, &snapshot, sizeof(snapshot));
+            out += sizeof(snapshot);
+        }
+        asm volatile("" : : "r"(buffer.data()) : "memory");
+    }
+    reportPerRecord("convert and serialize snapshot", count * repeat,
+                    sizeof(ConfigurationSnapshot), elapsedSeconds(start));
+
+    start = Clock::now();
+    for (int r = 0; r < repeat; ++r)
+    {
+        std::memcpy(buffer.data(), snapshots.data(), count * sizeof(ConfigurationSnapshot));
+        asm volatile("" : : "r"(buffer.data()) : "memory");
+    }
+    reportPerRecord("serialize snapshots", count * repeat,
+                    sizeof(ConfigurationSnapshot), elapsedSeconds(start));
+}
+
+/** Cost of producing the bytes of constant requests, encoded at runtime
+ * with packetize or framed at compile time
+ */
+void benchmarkEncoding()
+{
+    size_t const count = 10000000;
+    uint8_t buffer[MAX_PACKET_SIZE];
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        requests::packetize(buffer, requests::Stop());
+        asm volatile("" : : "r"(buffer) : "memory");
+    }
+    reportPerRecord("packetize STOP", count, 3, elapsedSeconds(start));
+
+    start = Clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::memcpy(buffer, framed::STOP.data, framed::STOP.size());
+        asm volatile("" : : "r"(buffer) : "memory");
+    }
+    reportPerRecord("framed STOP", count, 3, elapsedSeconds(start));
+
+    start = Clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        requests::packetize(buffer, requests::AnglesRelative(0, 0.5, 0));
+        asm volatile("" : : "r"(buffer) : "memory");
+    }
+    reportPerRecord("packetize home position", count, 9, elapsedSeconds(start));
+
+    static constexpr auto home = framed::AnglesRelative(0, 0.5, 0);
+    start = Clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::memcpy(buffer, home.data, home.size());
+        asm volatile("" : : "r"(buffer) : "memory");
+    }
+    reportPerRecord("framed home position", count, 9, elapsedSeconds(start));
+}
+
+/** Emulates the cost of an application handler */
+void busyWait(std::chrono::nanoseconds duration)
+{
+    auto deadline = Clock::now() + duration;
+    while (Clock::now() < deadline);
+}
+
+void benchmarkPipeline()
+{
+    std::vector<std::vector<uint8_t>> packets = {
+        requests::packetize(requests::StatusRefreshRatePT(RATE_20HZ)),
+        requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2)),
+        requests::packetize(requests::AngularVelocityGeo(0.1, -0.2, 0.3)),
+        requests::packetize(requests::PositionGeo(-0.1, 0.2, -0.3))
+    };
+    std::vector<uint8_t> stream;
+    size_t const count = 200000;
+    for (size_t i = 0; i < count; ++i)
+        stream.insert(stream.end(), packets[i % packets.size()].begin(),
+                      packets[i % packets.size()].end());
+
+    for (int handler_ns : { 0, 500, 2000 })
+    {
+        for (bool pipelined : { false, true })
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+                throw std::runtime_error("failed to create socket pair");
+            Driver driver;
+            driver.setMainStream(new iodrivers_base::FDStream(fds[0], true));
+
+            std::thread writer([&stream, &fds]() {
+                size_t written = 0;
+                while (written < stream.size())
+                {
+                    ssize_t ret = ::write(fds[1], stream.data() + written, stream.size() - written);
+                    if (ret <= 0)
+                        break;
+                    written += ret;
+                }
+                ::close(fds[1]);
+            });
+
+            std::chrono::nanoseconds handler_cost(handler_ns);
+            size_t handled = 0;
+            auto start = Clock::now();
+            if (pipelined)
+            {
+                DecodePipeline pipeline(driver, 1024);
+                pipeline.setRequestHandler([&](CommandIDs, RequestedConfiguration const&) {
+                    busyWait(handler_cost);
+                    ++handled;
+                });
+                pipeline.start();
+                pipeline.wait();
+            }
+            else
+            {
+                try {
+                    while (true)
+                    {
+                        driver.readRequest();
+                        busyWait(handler_cost);
+                        ++handled;
+                    }
+                }
+                catch(std::exception&) {}
+            }
+            double duration = elapsedSeconds(start);
+            writer.join();
+            if (handled != count)
+                throw std::logic_error("pipeline benchmark lost packets");
+
+            std::cout
+                << "  " << std::left << std::setw(40)
+                << ((pipelined ? "two threads, handler=" : "single thread, handler=") +
+                    std::to_string(handler_ns) + "ns") << std::right
+                << std::fixed << std::setprecision(0)
+                << std::setw(10) << count / duration / 1e3 << " kpackets/s"
+                << std::endl;
+        }
+    }
+}
+
+double threadCPUSeconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void benchmarkServing()
+{
+    size_t const count = 100000;
+    std::vector<uint8_t> request = requests::packetize(requests::AngularVelocityGeo(0.1, -0.2, 0.3));
+    size_t const response_size = sizeof(packets::Response) + sizeof(crc_t);
+
+    for (size_t burst : { 1, 8, 64 })
+    {
+        std::vector<uint8_t> burst_data;
+        for (size_t i = 0; i < burst; ++i)
+            burst_data.insert(burst_data.end(), request.begin(), request.end());
+        std::vector<uint8_t> responses(burst * response_size);
+
+        for (bool batched : { false, true })
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+                throw std::runtime_error("failed to create socket pair");
+            Driver driver;
+            driver.setMainStream(new iodrivers_base::FDStream(fds[0], true));
+
+            uint64_t writes = 0;
+            std::thread server([&]() {
+                try {
+                    if (batched)
+                    {
+                        RequestServer server(driver,
+                            [](CommandIDs, RequestedConfiguration const&) { return STATUS_OK; });
+                        try { server.run(); }
+                        catch(...) {
+                            writes = server.getStatistics().bursts;
+                            throw;
+                        }
+                    }
+                    else
+                    {
+                        while (true)
+                        {
+                            CommandIDs command_id = driver.readRequest(base::Time::fromSeconds(1));
+                            driver.writeResponse(Response { command_id, STATUS_OK });
+                            ++writes;
+                        }
+                    }
+                }
+                catch(std::exception&) {}
+            });
+
+            auto start = Clock::now();
+            for (size_t sent = 0; sent < count; sent += burst)
+            {
+                if (::write(fds[1], burst_data.data(), burst_data.size()) !=
+                    static_cast<ssize_t>(burst_data.size()))
+                    throw std::runtime_error("failed to write requests");
+                size_t received = 0;
+                while (received < responses.size())
+                {
+                    ssize_t ret = ::read(fds[1], responses.data() + received,
+                                         responses.size() - received);
+                    if (ret <= 0)
+                        throw std::runtime_error("failed to read responses");
+                    received += ret;
+                }
+            }
+            double duration = elapsedSeconds(start);
+            ::close(fds[1]);
+            server.join();
+
+            std::cout
+                << "  " << std::left << std::setw(40)
+                << ((batched ? "batched, burst=" : "per request, burst=") +
+                    std::to_string(burst)) << std::right
+                << std::fixed << std::setprecision(0)
+                << std::setw(10) << count / duration / 1e3 << " krequests/s"
+                << std::setprecision(3)
+                << std::setw(8) << static_cast<double>(writes) / count << " writes/request"
+                << std::endl;
+        }
+    }
+}
+
+void benchmarkSerial()
+{
+    // Time to transmit one byte at 115200 bauds
+    std::chrono::microseconds const byte_time(87);
+    int const round_trips = 200;
+
+    std::vector<uint8_t> request = requests::packetize(requests::AngularVelocityGeo(0.1, 0.2, 0.3));
+    std::vector<uint8_t> response = requests::packetize(reply::Response(ID_ANGULAR_VELOCITY_GEO, STATUS_OK));
+
+    for (bool low_latency : { false, true })
+    {
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master == -1 || grantpt(master) != 0 || unlockpt(master) != 0)
+            throw std::runtime_error("failed to create a pty");
+        int slave = ::open(ptsname(master), O_RDWR | O_NOCTTY);
+        if (slave == -1)
+            throw std::runtime_error("failed to open the pty slave");
+        termios tio;
+        tcgetattr(slave, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+
+        Driver driver;
+        driver.setMainStream(new iodrivers_base::FDStream(slave, true));
+        if (low_latency)
+            driver.setupLowLatencySerial(MSG_RESPONSE);
+
+        // Emulated head, sending its responses one byte at a time
+        std::thread head([&]() {
+            std::vector<uint8_t> buffer(request.size());
+            for (int i = 0; i < round_trips; ++i)
+            {
+                size_t received = 0;
+                while (received < buffer.size())
+                {
+                    ssize_t ret = ::read(master, buffer.data() + received, buffer.size() - received);
+                    if (ret <= 0)
+                        return;
+                    received += ret;
+                }
+                for (uint8_t byte : response)
+                {
+                    std::this_thread::sleep_for(byte_time);
+                    if (::write(master, &byte, 1) != 1)
+                        return;
+                }
+            }
+        });
+
+        double worst = 0, sum = 0;
+        double cpu_start = threadCPUSeconds();
+        for (int i = 0; i < round_trips; ++i)
+        {
+            auto start = Clock::now();
+            driver.sendRequest(requests::AngularVelocityGeo(0.1, 0.2, 0.3));
+            driver.readResponse(base::Time::fromSeconds(1));
+            double latency = elapsedSeconds(start);
+            worst = std::max(worst, latency);
+            sum += latency;
+        }
+        double cpu = threadCPUSeconds() - cpu_start;
+        head.join();
+        ::close(master);
+
+        std::cout
+            << "  " << std::left << std::setw(40)
+            << (low_latency ? "low-latency mode" : "default termios") << std::right
+            << std::fixed << std::setprecision(1)
+            << " round-trip mean=" << sum / round_trips * 1e6 << "us"
+            << " worst=" << worst * 1e6 << "us"
+            << " client CPU=" << cpu / round_trips * 1e6 << "us/round-trip"
+            << std::endl;
+    }
+}
+
+/** Telemetry of a head tracking a target from a moving ship, at 50Hz with
+ * a bit of timing jitter
+ */
+ConfigurationSnapshot makeTelemetryRecord(size_t i, std::mt19937& rng)
+{
+    RequestedConfiguration conf;
+    conf.time = base::Time::fromMicroseconds(i * 20000 + rng() % 50);
+    conf.command_id = ID_ANGLES_GEO;
+    conf.control_mode = RequestedConfiguration::ANGLES_GEO;
+    double t = i * 0.02;
+    conf.rpy = Eigen::Vector3d(0.05 * std::sin(t / 7), 0.2 + 0.1 * std::sin(t / 30),
+                               std::fmod(t / 100, 2 * M_PI) - M_PI);
+    conf.lat_lon_alt = GeoTarget(0.76 + t * 1e-7, -0.02 - t * 2e-7, 12);
+    return ConfigurationSnapshot::fromConfiguration(conf);
+}
+
+void benchmarkTelemetry()
+{
+    // Six hours at 50Hz
+    size_t const count = 6 * 3600 * 50;
+    char path[] = "/tmp/indra_heads_bench_telemetry_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1)
+        throw std::runtime_error("failed to create a temporary file");
+    ::close(fd);
+
+    std::mt19937 rng(0);
+    std::vector<ConfigurationSnapshot> records(count);
+    for (size_t i = 0; i < count; ++i)
+        records[i] = makeTelemetryRecord(i, rng);
+
+    for (size_t block_size : { 256, 4096 })
+    {
+        ::unlink(path);
+        uint64_t file_size;
+        auto start = Clock::now();
+        {
+            TelemetryWriter writer(path, block_size);
+            for (auto const& record : records)
+                writer.push(record);
+            writer.flush();
+            file_size = writer.getBytesWritten();
+        }
+        double duration = elapsedSeconds(start);
+        std::cout
+            << "  " << std::left << std::setw(40)
+            << "ingest, block=" + std::to_string(block_size) << std::right
+            << std::fixed << std::setprecision(2)
+            << std::setw(10) << count / duration / 1e6 << " Mrecords/s"
+            << std::setw(8) << static_cast<double>(file_size) / count << " bytes/record"
+            << std::setprecision(1)
+            << std::setw(8) << sizeof(ConfigurationSnapshot) * count / static_cast<double>(file_size)
+            << "x vs snapshots"
+            << std::endl;
+
+        TelemetryReader reader(path);
+        std::vector<ConfigurationSnapshot> result;
+        result.reserve(count);
+        start = Clock::now();
+        int const queries = 1000;
+        for (int q = 0; q < queries; ++q)
+        {
+            // One minute somewhere in the file
+            size_t first = rng() % (count - 3000);
+            result.clear();
+            reader.query(records[first].time, records[first + 2999].time, result);
+        }
+        duration = elapsedSeconds(start);
+        std::cout
+            << "  " << std::left << std::setw(40)
+            << "query one minute, block=" + std::to_string(block_size) << std::right
+            << std::fixed << std::setprecision(1)
+            << std::setw(10) << duration / queries * 1e6 << " us/query"
+            << std::endl;
+
+        start = Clock::now();
+        result.clear();
+        reader.query(records.front().time, records.back().time, result);
+        duration = elapsedSeconds(start);
+        std::cout
+            << "  " << std::left << std::setw(40)
+            << "full scan, block=" + std::to_string(block_size) << std::right
+            << std::fixed << std::setprecision(2)
+            << std::setw(10) << count / duration / 1e6 << " Mrecords/s"
+            << std::endl;
+    }
+    ::unlink(path);
+}
+
+/** Head that answers each request a fixed time after receiving it, without
+ * delaying the requests behind it, as a link with this round-trip time would
+ */
+void serveWithLatency(Driver& head, base::Time const& latency)
+{
+    std::deque<std::pair<base::Time, CommandIDs>> pending;
+    while (true)
+    {
+        base::Time timeout = base::Time::fromSeconds(1);
+        if (!pending.empty())
+        {
+            base::Time now = base::Time::now();
+            timeout = now < pending.front().first ? pending.front().first - now : base::Time();
+        }
+        try {
+            CommandIDs command_id = head.readRequest(timeout);
+            pending.emplace_back(base::Time::now() + latency, command_id);
+        }
+        catch(iodrivers_base::TimeoutError&) {
+        }
+
+        base::Time now = base::Time::now();
+        while (!pending.empty() && !(now < pending.front().first))
+        {
+            head.writeResponse(Response { pending.front().second, STATUS_OK });
+            pending.pop_front();
+        }
+    }
+}
+
+void benchmarkReconnect()
+{
+    int const count = 20;
+    auto rate_pt = requests::StatusRefreshRatePT(RATE_50HZ);
+    auto rate_imu = requests::StatusRefreshRateIMU(RATE_20HZ);
+    auto target = requests::PositionGeo(0.76, -0.02, 12);
+
+    for (int latency_ms : { 1, 5, 20 })
+    {
+        base::Time latency = base::Time::fromMilliseconds(latency_ms);
+        for (bool pipelined : { false, true })
+        {
+            Driver client;
+            client.acknowledgeRequest(rate_pt);
+            client.acknowledgeRequest(rate_imu);
+            client.acknowledgeRequest(target);
+
+            double total = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                // From the link drop to the last acknowledgement on the new
+                // connection
+                client.close();
+                auto start = Clock::now();
+                int fds[2];
+                if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+                    throw std::runtime_error("failed to create socket pair");
+                Driver head;
+                head.setMainStream(new iodrivers_base::FDStream(fds[1], true));
+                std::thread server([&head, latency]() {
+                    try { serveWithLatency(head, latency); }
+                    catch(std::exception&) {}
+                });
+
+                client.setMainStream(new iodrivers_base::FDStream(fds[0], true));
+                client.clear();
+                client.getRoundTripEstimator().reset();
+                if (pipelined)
+                    client.restoreConfiguration();
+                else
+                {
+                    client.transact(rate_pt);
+                    client.transact(rate_imu);
+                    client.transact(target);
+                }
+                total += elapsedSeconds(start);
+
+                client.close();
+                server.join();
+            }
+
+            std::cout
+                << "  " << std::left << std::setw(40)
+                << ((pipelined ? "pipelined, rtt=" : "one request at a time, rtt=") +
+                    std::to_string(latency_ms) + "ms") << std::right
+                << std::fixed << std::setprecision(2)
+                << std::setw(10) << total / count * 1e3 << " ms to operational"
+                << std::endl;
+        }
+    }
+}
+
+/** Drain the given file descriptors until stop is set
+ *
+ * @param read reads what is available on the i-th descriptor
+ */
+void drainUntilStopped(std::vector<int> const& fds, std::atomic<bool> const& stop,
+                       std::function<void (size_t)> const& read)
+{
+    std::vector<pollfd> pfds(fds.size());
+    for (size_t i = 0; i < fds.size(); ++i)
+        pfds[i] = pollfd { fds[i], POLLIN, 0 };
+    while (!stop)
+    {
+        if (poll(pfds.data(), pfds.size(), 10) <= 0)
+            continue;
+        for (size_t i = 0; i < pfds.size(); ++i)
+        {
+            if (pfds[i].revents & POLLIN)
+                read(i);
+        }
+    }
+}
+
+void benchmarkMulticast()
+{
+    // A burst is a request and its response, published as one datagram
+    size_t const bursts = 20000;
+    char const* group = "239.255.71.18";
+    int const port = 47000 + getpid() % 1000;
+
+    RequestedConfiguration conf;
+    conf.command_id = ID_ANGLES_GEO;
+    conf.control_mode = RequestedConfiguration::ANGLES_GEO;
+    conf.rpy = Eigen::Vector3d(0.1, 0.2, 0.3);
+    ConfigurationSnapshot snapshot = ConfigurationSnapshot::fromConfiguration(conf);
+    Response response { ID_ANGLES_GEO, STATUS_OK };
+
+    for (size_t subscriber_count : { 1, 4, 16, 64 })
+    {
+        // One multicast group for all the consoles
+        {
+            std::vector<std::unique_ptr<MulticastSubscriber>> subscribers;
+            std::vector<int> fds;
+            for (size_t i = 0; i < subscriber_count; ++i)
+            {
+                subscribers.emplace_back(new MulticastSubscriber(group, port, "127.0.0.1"));
+                fds.push_back(subscribers.back()->getFileDescriptor());
+            }
+
+            std::atomic<bool> stop(false);
+            std::vector<MulticastRecord> records;
+            std::thread reader([&]() {
+                drainUntilStopped(fds, stop, [&](size_t i) {
+                    subscribers[i]->read(records, base::Time());
+                    records.clear();
+                });
+            });
+
+            MulticastPublisherConfiguration publisher_conf;
+            publisher_conf.interface = "127.0.0.1";
+            MulticastPublisher publisher(group, port, publisher_conf);
+            double cpu_start = threadCPUSeconds();
+            for (size_t i = 0; i < bursts; ++i)
+            {
+                publisher.publishCommand(snapshot);
+                publisher.publishResponse(response, base::Time());
+                publisher.flush();
+                // Let the subscribers keep up, as they would at the head's rate
+                if (i % 16 == 15)
+                {
+                    double paused = threadCPUSeconds();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    cpu_start += threadCPUSeconds() - paused;
+                }
+            }
+            double cpu = threadCPUSeconds() - cpu_start;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            stop = true;
+            reader.join();
+
+            uint64_t received = 0;
+            for (auto const& subscriber : subscribers)
+                received += subscriber->getStatistics().records;
+            std::cout
+                << "  " << std::left << std::setw(40)
+                << ("multicast, subscribers=" + std::to_string(subscriber_count)) << std::right
+                << std::fixed << std::setprecision(2)
+                << std::setw(10) << cpu / bursts * 1e6 << " us/burst"
+                << std::setprecision(1)
+                << std::setw(8) << 100.0 * received / (2 * bursts * subscriber_count) << "% delivered"
+                << std::endl;
+        }
+
+        // One stream per console, written by the driver process
+        {
+            std::vector<int> writers, readers;
+            for (size_t i = 0; i < subscriber_count; ++i)
+            {
+                int fds[2];
+                if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+                    throw std::runtime_error("failed to create socket pair");
+                writers.push_back(fds[0]);
+                readers.push_back(fds[1]);
+            }
+
+            std::atomic<bool> stop(false);
+            uint64_t received = 0;
+            std::thread reader([&]() {
+                uint8_t buffer[65536];
+                drainUntilStopped(readers, stop, [&](size_t i) {
+                    ssize_t ret = ::read(readers[i], buffer, sizeof(buffer));
+                    if (ret > 0)
+                        received += ret;
+                });
+            });
+
+            // The same records as the multicast datagram, without its header
+            uint8_t record[1 + sizeof(snapshot) + 1 + 10];
+            std::memcpy(record + 1, &snapshot, sizeof(snapshot));
+            double cpu_start = threadCPUSeconds();
+            for (size_t i = 0; i < bursts; ++i)
+            {
+                for (int fd : writers)
+                {
+                    if (::write(fd, record, sizeof(record)) != sizeof(record))
+                        throw std::runtime_error("failed to write records");
+                }
+                if (i % 16 == 15)
+                {
+                    double paused = threadCPUSeconds();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    cpu_start += threadCPUSeconds() - paused;
+                }
+            }
+            double cpu = threadCPUSeconds() - cpu_start;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            stop = true;
+            reader.join();
+            for (size_t i = 0; i < subscriber_count; ++i)
+            {
+                ::close(writers[i]);
+                ::close(readers[i]);
+            }
+
+            std::cout
+                << "  " << std::left << std::setw(40)
+                << ("stream per console, consoles=" + std::to_string(subscriber_count)) << std::right
+                << std::fixed << std::setprecision(2)
+                << std::setw(10) << cpu / bursts * 1e6 << " us/burst"
+                << std::setprecision(1)
+                << std::setw(8) << 100.0 * received / (sizeof(record) * bursts * subscriber_count)
+                << "% delivered" << std::endl;
+        }
+    }
+}
+
+struct Benchmark
+{
+    char const* name;
+    void (*run)();
+};
+
+static const Benchmark BENCHMARKS[] = {
+    { "framing", benchmarkFraming },
+    { "scheduler", benchmarkScheduler },
+    { "stop", benchmarkStop },
+    { "watchdog", benchmarkWatchdog },
+    { "geopointing", benchmarkGeoPointing },
+    { "snapshot", benchmarkSnapshot },
+    { "pipeline", benchmarkPipeline },
+    { "serial", benchmarkSerial },
+    { "encoding", benchmarkEncoding },
+    { "serving", benchmarkServing },
+    { "telemetry", benchmarkTelemetry },
+    { "reconnect", benchmarkReconnect },
+    { "multicast", benchmarkMulticast }
+};
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && string(argv[1]) == "--help")
+    {
+        usage();
+        return 0;
+    }
+
+    string filter;
+    if (argc > 1)
+        filter = argv[1];
+
+    for (auto const& benchmark : BENCHMARKS)
+    {
+        if (string(benchmark.name).compare(0, filter.size(), filter) != 0)
+            continue;
+
+        std::cout << benchmark.name << std::endl;
+        benchmark.run();
+    }
+    return 0;
+}
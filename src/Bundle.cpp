@@ -0,0 +1,119 @@
+#include <indra_heads_protocol/Bundle.hpp>
+#include <cstring>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+int bundles::getEntrySize(uint8_t command_id)
+{
+    if (command_id > ID_LAST)
+        return 0;
+    // The entry is the request without its message type
+    return packets::getPacketSize(static_cast<CommandIDs>(command_id), MSG_REQUEST) - 1;
+}
+
+bool bundles::isValidPayload(uint8_t const* payload, size_t size)
+{
+    if (size == 0)
+        return false;
+
+    size_t offset = 0;
+    while (offset < size)
+    {
+        int entry_size = getEntrySize(payload[offset]);
+        if (entry_size == 0)
+            return false;
+        offset += entry_size;
+    }
+    return offset == size;
+}
+
+Bundle::Bundle()
+    : mSize(0)
+    , mCount(0)
+{
+}
+
+void Bundle::clear()
+{
+    mSize = 0;
+    mCount = 0;
+}
+
+bool Bundle::empty() const
+{
+    return mCount == 0;
+}
+
+size_t Bundle::getCommandCount() const
+{
+    return mCount;
+}
+
+size_t Bundle::getPacketSize() const
+{
+    return BUNDLE_HEADER_SIZE + mSize + sizeof(crc_t);
+}
+
+bool Bundle::addEntry(uint8_t const* packet, size_t packet_size)
+{
+    if (packet[1] != MSG_REQUEST)
+        return false;
+    size_t entry_size = bundles::getEntrySize(packet[0]);
+    if (entry_size == 0 || entry_size != packet_size - 1)
+        return false;
+    if (mSize + entry_size > MAX_BUNDLE_PAYLOAD)
+        return false;
+
+    mPayload[mSize] = packet[0];
+    std::memcpy(mPayload + mSize + 1, packet + 2, entry_size - 1);
+    mSize += entry_size;
+    ++mCount;
+    return true;
+}
+
+bool Bundle::isIdempotent() const
+{
+    for (size_t offset = 0; offset < mSize; offset += bundles::getEntrySize(mPayload[offset]))
+    {
+        if (!packets::isIdempotent(static_cast<CommandIDs>(mPayload[offset])))
+            return false;
+    }
+    return true;
+}
+
+size_t Bundle::packetize(uint8_t* buffer) const
+{
+    buffer[0] = ID_BUNDLE;
+    buffer[1] = MSG_REQUEST;
+    buffer[2] = mSize;
+    std::memcpy(buffer + BUNDLE_HEADER_SIZE, mPayload, mSize);
+    size_t size = BUNDLE_HEADER_SIZE + mSize;
+    details::encode_crc(buffer + size, details::compute_crc(buffer, size));
+    return size + sizeof(crc_t);
+}
+
+std::vector<uint8_t> Bundle::packetize() const
+{
+    std::vector<uint8_t> buffer(getPacketSize());
+    packetize(buffer.data());
+    return buffer;
+}
+
+std::vector<std::vector<uint8_t>> Bundle::packetizeCommands() const
+{
+    std::vector<std::vector<uint8_t>> result;
+    for (size_t offset = 0; offset < mSize; )
+    {
+        size_t entry_size = bundles::getEntrySize(mPayload[offset]);
+        std::vector<uint8_t> packet(entry_size + 1 + sizeof(crc_t));
+        packet[0] = mPayload[offset];
+        packet[1] = MSG_REQUEST;
+        std::memcpy(packet.data() + 2, mPayload + offset + 1, entry_size - 1);
+        details::encode_crc(packet.data() + entry_size + 1,
+                            details::compute_crc(packet.data(), entry_size + 1));
+        result.push_back(packet);
+        offset += entry_size;
+    }
+    return result;
+}
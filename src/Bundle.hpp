@@ -0,0 +1,92 @@
+#ifndef INDRA_HEADS_BUNDLE_HPP
+#define INDRA_HEADS_BUNDLE_HPP
+
+#include <indra_heads_protocol/Protocol.hpp>
+#include <vector>
+
+namespace indra_heads_protocol
+{
+    /** Command ID, message type and payload size */
+    static const int BUNDLE_HEADER_SIZE = 3;
+    /** Largest bundle payload, so that a framed bundle fits in
+     * MAX_PACKET_SIZE
+     */
+    static const int MAX_BUNDLE_PAYLOAD = MAX_PACKET_SIZE - BUNDLE_HEADER_SIZE - sizeof(crc_t);
+
+    namespace bundles {
+        /** Size of a command's entry in a bundle payload
+         *
+         * @return zero if the command cannot be bundled
+         */
+        int getEntrySize(uint8_t command_id);
+
+        /** Whether the payload is a non-empty sequence of complete entries */
+        bool isValidPayload(uint8_t const* payload, size_t size);
+    }
+
+    /** Several requests sent as a single frame (protocol extension)
+     *
+     * On the wire, a bundle is
+     *
+     * <code>
+     * ID_BUNDLE MSG_REQUEST payload_size entries... CRC
+     * </code>
+     *
+     * where each entry is the request packet of a base protocol command
+     * without its message type (i.e. its command ID followed by its fields).
+     * The head applies the commands in order and answers with a single
+     * Response to ID_BUNDLE, whose status is STATUS_OK only if all of them
+     * succeeded.
+     *
+     * Only heads that advertise FEATURE_BUNDLE accept bundles.
+     * Driver::transact(Bundle const&) falls back to separate requests for
+     * the other heads.
+     */
+    class Bundle
+    {
+        uint8_t mPayload[MAX_BUNDLE_PAYLOAD];
+        size_t mSize;
+        size_t mCount;
+
+        bool addEntry(uint8_t const* packet, size_t packet_size);
+
+    public:
+        Bundle();
+
+        /** Append a request built with the functions in requests
+         *
+         * @return false if the bundle is full or the request cannot be
+         *   bundled, in which case it is not added
+         */
+        template<typename T>
+        bool add(T const& packet)
+        {
+            return addEntry(reinterpret_cast<uint8_t const*>(&packet), sizeof(T));
+        }
+
+        void clear();
+        bool empty() const;
+        size_t getCommandCount() const;
+
+        /** Size of the framed bundle, CRC included */
+        size_t getPacketSize() const;
+
+        /** Whether all bundled commands are idempotent */
+        bool isIdempotent() const;
+
+        /** Frame the bundle in buffer, which must hold getPacketSize()
+         * bytes
+         *
+         * @return the packet size
+         */
+        size_t packetize(uint8_t* buffer) const;
+        std::vector<uint8_t> packetize() const;
+
+        /** Frame each command as a separate request, for heads that do not
+         * support bundles
+         */
+        std::vector<std::vector<uint8_t>> packetizeCommands() const;
+    };
+}
+
+#endif
@@ -0,0 +1,362 @@
+#include <indra_heads_protocol/CaptureDecoder.hpp>
+#include <indra_heads_protocol/Bundle.hpp>
+#include <indra_heads_protocol/PacketParser.hpp>
+#include <iodrivers_base/Exceptions.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+size_t CaptureColumns::size() const
+{
+    return offsets.size();
+}
+
+void CaptureColumns::clear()
+{
+    offsets.clear();
+    command_ids.clear();
+    message_types.clear();
+    codes.clear();
+    for (auto& column : values)
+        column.clear();
+}
+
+void CaptureColumns::reserve(size_t rows)
+{
+    offsets.reserve(rows);
+    command_ids.reserve(rows);
+    message_types.reserve(rows);
+    codes.reserve(rows);
+    for (auto& column : values)
+        column.reserve(rows);
+}
+
+template<typename T>
+static void appendColumn(std::vector<T>& to, std::vector<T> const& from, size_t first)
+{
+    to.insert(to.end(), from.begin() + first, from.end());
+}
+
+void CaptureColumns::append(CaptureColumns const& other, size_t first)
+{
+    appendColumn(offsets, other.offsets, first);
+    appendColumn(command_ids, other.command_ids, first);
+    appendColumn(message_types, other.message_types, first);
+    appendColumn(codes, other.codes, first);
+    for (int i = 0; i < 3; ++i)
+        appendColumn(values[i], other.values[i], first);
+}
+
+namespace
+{
+    static const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+    void appendRow(CaptureColumns& rows, uint64_t offset, uint8_t const* packet,
+                   uint8_t code, double x = NaN, double y = NaN, double z = NaN)
+    {
+        rows.offsets.push_back(offset);
+        rows.command_ids.push_back(packet[0]);
+        rows.message_types.push_back(packet[1]);
+        rows.codes.push_back(code);
+        rows.values[0].push_back(x);
+        rows.values[1].push_back(y);
+        rows.values[2].push_back(z);
+    }
+
+    void appendVector(CaptureColumns& rows, uint64_t offset, uint8_t const* packet,
+                      Eigen::Vector3d const& v)
+    {
+        appendRow(rows, offset, packet, 0, v.x(), v.y(), v.z());
+    }
+
+    /** Decode a framed packet into one row, or one row per command for
+     * bundles
+     */
+    void appendPacket(CaptureColumns& rows, uint64_t offset, uint8_t const* packet)
+    {
+        if (packet[1] == MSG_RESPONSE)
+            return appendRow(rows, offset, packet, packet[2]);
+
+        switch(packet[0])
+        {
+            case ID_STATUS_REFRESH_RATE_PT:
+            case ID_STATUS_REFRESH_RATE_IMU:
+                return appendRow(rows, offset, packet, requests::decode(
+                    reinterpret_cast<packets::StatusRefreshRate const&>(packet[0])));
+            case ID_ANGLES_RELATIVE:
+            case ID_ANGLES_GEO:
+                return appendVector(rows, offset, packet, requests::decode(
+                    reinterpret_cast<packets::Angles const&>(packet[0])));
+            case ID_ANGULAR_VELOCITY_RELATIVE:
+            case ID_ANGULAR_VELOCITY_GEO:
+                return appendVector(rows, offset, packet, requests::decode(
+                    reinterpret_cast<packets::AngularVelocities const&>(packet[0])));
+            case ID_STABILIZATION_TARGET:
+            {
+                GeoTarget target = requests::decode(
+                    reinterpret_cast<packets::PositionGeo const&>(packet[0]));
+                return appendRow(rows, offset, packet, 0,
+                                 target.latitude, target.longitude, target.altitude);
+            }
+            case ID_BUNDLE:
+            {
+                // Same expansion than Driver::decodeRequest
+                uint8_t const* entry = packet + BUNDLE_HEADER_SIZE;
+                uint8_t const* end = entry + packet[2];
+                uint8_t request[MAX_PACKET_SIZE];
+                request[1] = MSG_REQUEST;
+                while (entry < end)
+                {
+                    int entry_size = bundles::getEntrySize(entry[0]);
+                    request[0] = entry[0];
+                    std::memcpy(request + 2, entry + 1, entry_size - 1);
+                    appendPacket(rows, offset, request);
+                    entry += entry_size;
+                }
+                return;
+            }
+            default:
+                return appendRow(rows, offset, packet, 0);
+        }
+    }
+
+    /** Result of framing a capture from a chunk boundary */
+    struct Chunk
+    {
+        CaptureColumns rows;
+        /** Offset, size and first row of the framed packets */
+        std::vector<uint64_t> packet_offsets;
+        std::vector<uint8_t> packet_sizes;
+        std::vector<size_t> packet_rows;
+        /** Where the framing started and stopped */
+        uint64_t begin = 0;
+        uint64_t end = 0;
+        /** Whether it stopped on an incomplete packet */
+        bool incomplete = false;
+    };
+
+    /** Frame one packet at offset with the same rules than Driver
+     *
+     * @return see PacketParser::extract
+     */
+    int frame(PacketParser& parser, uint8_t const* data, uint64_t size, uint64_t offset)
+    {
+        size_t available = std::min<uint64_t>(size - offset, MAX_PACKET_SIZE);
+        return parser.extract(data + offset, available);
+    }
+
+    /** Frame and decode from begin until reaching end or an incomplete
+     * packet
+     */
+    void decodeChunk(uint8_t const* data, uint64_t size,
+                     uint64_t begin, uint64_t end, Chunk& chunk)
+    {
+        PacketParser parser;
+        chunk.begin = begin;
+        // Rough estimate, to avoid most of the reallocations
+        size_t expected_packets = (end - begin) / 8 + 1;
+        chunk.packet_offsets.reserve(expected_packets);
+        chunk.packet_sizes.reserve(expected_packets);
+        chunk.packet_rows.reserve(expected_packets);
+        chunk.rows.reserve(expected_packets);
+        uint64_t offset = begin;
+        while (offset < end)
+        {
+            int result = frame(parser, data, size, offset);
+            if (result == 0)
+            {
+                chunk.incomplete = true;
+                break;
+            }
+            else if (result < 0)
+            {
+                offset += 1;
+                continue;
+            }
+
+            chunk.packet_offsets.push_back(offset);
+            chunk.packet_sizes.push_back(result);
+            chunk.packet_rows.push_back(chunk.rows.size());
+            appendPacket(chunk.rows, offset, data + offset);
+            offset += result;
+        }
+        chunk.end = offset;
+    }
+
+    /** Whether the framing of chunk went through offset
+     *
+     * It went through all positions from the chunk's start to its end,
+     * except the ones inside the packets it framed
+     */
+    bool isOnPath(Chunk const& chunk, uint64_t offset)
+    {
+        if (offset < chunk.begin || offset > chunk.end)
+            return false;
+        auto const& offsets = chunk.packet_offsets;
+        auto it = std::upper_bound(offsets.begin(), offsets.end(), offset);
+        if (it == offsets.begin())
+            return true;
+        size_t i = it - offsets.begin() - 1;
+        return offset == offsets[i] || offset >= offsets[i] + chunk.packet_sizes[i];
+    }
+}
+
+MappedFile::MappedFile(std::string const& path)
+    : mData(nullptr)
+    , mSize(0)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw iodrivers_base::UnixError("failed to open " + path);
+
+    struct stat info;
+    if (fstat(fd, &info) == -1)
+    {
+        ::close(fd);
+        throw iodrivers_base::UnixError("failed to stat " + path);
+    }
+
+    mSize = info.st_size;
+    if (mSize != 0)
+    {
+        void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            ::close(fd);
+            throw iodrivers_base::UnixError("failed to map " + path);
+        }
+        // Each thread reads its chunk sequentially
+        madvise(data, mSize, MADV_SEQUENTIAL);
+        mData = static_cast<uint8_t const*>(data);
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (mData)
+        munmap(const_cast<uint8_t*>(mData), mSize);
+}
+
+uint8_t const* MappedFile::data() const
+{
+    return mData;
+}
+
+size_t MappedFile::size() const
+{
+    return mSize;
+}
+
+CaptureDecoder::CaptureDecoder(size_t threads, size_t chunk_size)
+    : mThreads(threads)
+    , mChunkSize(chunk_size)
+{
+    if (mChunkSize == 0)
+        throw std::invalid_argument("the chunk size must be strictly positive");
+    if (mThreads == 0)
+        mThreads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+size_t CaptureDecoder::getThreadCount() const
+{
+    return mThreads;
+}
+
+CaptureStatistics const& CaptureDecoder::getStatistics() const
+{
+    return mStatistics;
+}
+
+CaptureColumns CaptureDecoder::decodeFile(std::string const& path)
+{
+    MappedFile file(path);
+    return decode(file.data(), file.size());
+}
+
+CaptureColumns CaptureDecoder::decode(uint8_t const* data, size_t size)
+{
+    mStatistics = CaptureStatistics();
+    mStatistics.bytes = size;
+    size_t chunk_count = (size + mChunkSize - 1) / mChunkSize;
+    mStatistics.chunks = chunk_count;
+
+    std::vector<Chunk> chunks(chunk_count);
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < chunk_count; i = next++)
+        {
+            uint64_t begin = i * mChunkSize;
+            uint64_t end = std::min<uint64_t>(begin + mChunkSize, size);
+            decodeChunk(data, size, begin, end, chunks[i]);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(mThreads, chunk_count); ++i)
+        threads.emplace_back(work);
+    work();
+    for (auto& thread : threads)
+        thread.join();
+
+    size_t total_rows = 0;
+    for (auto const& chunk : chunks)
+        total_rows += chunk.rows.size();
+
+    CaptureColumns result;
+    result.reserve(total_rows);
+    PacketParser parser;
+    uint64_t offset = 0;
+    uint64_t packet_bytes = 0;
+    bool incomplete = false;
+    for (size_t i = 0; i < chunk_count && !incomplete; ++i)
+    {
+        Chunk const& chunk = chunks[i];
+        // Frame sequentially until reaching the chunk's own framing
+        while (offset <= chunk.end && !isOnPath(chunk, offset))
+        {
+            int packet_size = frame(parser, data, size, offset);
+            if (packet_size == 0)
+            {
+                incomplete = true;
+                break;
+            }
+            else if (packet_size < 0)
+            {
+                offset += 1;
+                continue;
+            }
+            appendPacket(result, offset, data + offset);
+            packet_bytes += packet_size;
+            ++mStatistics.packets;
+            ++mStatistics.stitched_packets;
+            offset += packet_size;
+        }
+        if (incomplete || offset > chunk.end)
+            continue;
+
+        auto const& offsets = chunk.packet_offsets;
+        size_t first = std::lower_bound(offsets.begin(), offsets.end(), offset) - offsets.begin();
+        if (first < offsets.size())
+            result.append(chunk.rows, chunk.packet_rows[first]);
+        for (size_t p = first; p < offsets.size(); ++p)
+            packet_bytes += chunk.packet_sizes[p];
+        mStatistics.packets += offsets.size() - first;
+        offset = chunk.end;
+        incomplete = chunk.incomplete;
+    }
+
+    if (incomplete)
+        mStatistics.truncated_bytes = size - offset;
+    mStatistics.discarded_bytes = size - packet_bytes - mStatistics.truncated_bytes;
+    return result;
+}
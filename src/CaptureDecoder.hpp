@@ -0,0 +1,123 @@
+#ifndef INDRA_HEADS_CAPTURE_DECODER_HPP
+#define INDRA_HEADS_CAPTURE_DECODER_HPP
+
+#include <indra_heads_protocol/Protocol.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace indra_heads_protocol
+{
+    /** Decoded packets of a capture, one array per field
+     *
+     * Row i describes one command or response. A bundle gives one row per
+     * bundled command, all with the bundle's offset.
+     */
+    struct CaptureColumns
+    {
+        /** Offset of the packet in the capture, in bytes
+         *
+         * Raw captures do not carry reception times. The offset is what
+         * locates a packet in time, e.g. by dividing it by the link's byte
+         * rate when the link was busy
+         */
+        std::vector<uint64_t> offsets;
+        std::vector<uint8_t> command_ids;
+        std::vector<uint8_t> message_types;
+        /** Status of responses (feature bits for ID_FEATURES), rate of the
+         * refresh rate requests, zero otherwise
+         */
+        std::vector<uint8_t> codes;
+        /** Roll, pitch and yaw for angle and angular velocity requests,
+         * latitude, longitude and altitude for stabilization targets, NaN
+         * otherwise
+         */
+        std::vector<double> values[3];
+
+        size_t size() const;
+        void clear();
+        void reserve(size_t rows);
+
+        /** Append the rows of other, starting at row first */
+        void append(CaptureColumns const& other, size_t first = 0);
+    };
+
+    struct CaptureStatistics
+    {
+        uint64_t bytes = 0;
+        /** Valid packets found in the capture */
+        uint64_t packets = 0;
+        /** Bytes that were skipped to resynchronize on the packet stream */
+        uint64_t discarded_bytes = 0;
+        /** Bytes at the end of the capture that are the start of an
+         * incomplete packet
+         */
+        uint64_t truncated_bytes = 0;
+        uint64_t chunks = 0;
+        /** Packets that had to be framed again while stitching the chunks,
+         * because the chunk that contained them started in the middle of a
+         * packet
+         */
+        uint64_t stitched_packets = 0;
+    };
+
+    /** Read-only memory mapping of a whole file */
+    class MappedFile
+    {
+        uint8_t const* mData;
+        size_t mSize;
+
+    public:
+        /** @throw iodrivers_base::UnixError if the file cannot be mapped */
+        explicit MappedFile(std::string const& path);
+        ~MappedFile();
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator =(MappedFile const&) = delete;
+
+        uint8_t const* data() const;
+        size_t size() const;
+    };
+
+    /** Parallel offline decoding of raw link captures
+     *
+     * The capture is split in fixed-size chunks, which are framed and
+     * decoded by a pool of threads. A chunk's framing starts at the chunk
+     * boundary, which may be in the middle of a packet: it then skips bytes
+     * until it resynchronizes on the packet stream, the same way a Driver
+     * does. When stitching, the packets of a chunk are kept from the first
+     * position that the framing of the previous chunks also reaches. Framing
+     * only depends on the position it starts from, so both agree from there
+     * on and the result is exactly the one of a sequential framing of the
+     * whole capture. Positions before that are framed again sequentially,
+     * which is usually at most one packet per chunk.
+     *
+     * Like Driver, the framing stops at an incomplete packet, which can only
+     * happen at the end of the capture.
+     */
+    class CaptureDecoder
+    {
+        size_t mThreads;
+        size_t mChunkSize;
+        CaptureStatistics mStatistics;
+
+    public:
+        /**
+         * @param threads the number of decoding threads, zero to use one
+         *   per core
+         * @param chunk_size the size of the capture chunks, in bytes
+         */
+        explicit CaptureDecoder(size_t threads = 0, size_t chunk_size = 4 << 20);
+
+        size_t getThreadCount() const;
+
+        CaptureColumns decode(uint8_t const* data, size_t size);
+
+        /** Map the file and decode it */
+        CaptureColumns decodeFile(std::string const& path);
+
+        /** Statistics of the last decode */
+        CaptureStatistics const& getStatistics() const;
+    };
+}
+
+#endif
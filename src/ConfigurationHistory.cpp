@@ -0,0 +1,163 @@
+#include <indra_heads_protocol/ConfigurationHistory.hpp>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+static Eigen::Quaterniond rpyToQuaternion(Eigen::Vector3d const& rpy)
+{
+    return Eigen::AngleAxisd(rpy.z(), Eigen::Vector3d::UnitZ()) *
+        Eigen::AngleAxisd(rpy.y(), Eigen::Vector3d::UnitY()) *
+        Eigen::AngleAxisd(rpy.x(), Eigen::Vector3d::UnitX());
+}
+
+static Eigen::Vector3d quaternionToRPY(Eigen::Quaterniond const& q)
+{
+    double sin_pitch = 2 * (q.w() * q.y() - q.z() * q.x());
+    return Eigen::Vector3d(
+        std::atan2(2 * (q.w() * q.x() + q.y() * q.z()),
+                   1 - 2 * (q.x() * q.x() + q.y() * q.y())),
+        std::asin(std::max(-1.0, std::min(1.0, sin_pitch))),
+        std::atan2(2 * (q.w() * q.z() + q.x() * q.y()),
+                   1 - 2 * (q.y() * q.y() + q.z() * q.z())));
+}
+
+ConfigurationHistory::ConfigurationHistory(size_t capacity)
+    : mHead(0)
+    , mSize(0)
+{
+    setCapacity(capacity);
+}
+
+void ConfigurationHistory::setCapacity(size_t capacity)
+{
+    mEntries.resize(capacity);
+    clear();
+}
+
+size_t ConfigurationHistory::getCapacity() const
+{
+    return mEntries.size();
+}
+
+size_t ConfigurationHistory::size() const
+{
+    return mSize;
+}
+
+bool ConfigurationHistory::empty() const
+{
+    return mSize == 0;
+}
+
+void ConfigurationHistory::clear()
+{
+    mHead = 0;
+    mSize = 0;
+}
+
+void ConfigurationHistory::push(RequestedConfiguration const& configuration)
+{
+    if (mEntries.empty())
+        return;
+
+    if (mSize < mEntries.size())
+    {
+        mEntries[(mHead + mSize) % mEntries.size()] = configuration;
+        ++mSize;
+    }
+    else
+    {
+        mEntries[mHead] = configuration;
+        mHead = (mHead + 1) % mEntries.size();
+    }
+}
+
+RequestedConfiguration const& ConfigurationHistory::at(size_t index) const
+{
+    return mEntries[(mHead + index) % mEntries.size()];
+}
+
+RequestedConfiguration const& ConfigurationHistory::front() const
+{
+    if (empty())
+        throw std::out_of_range("empty configuration history");
+    return at(0);
+}
+
+RequestedConfiguration const& ConfigurationHistory::back() const
+{
+    if (empty())
+        throw std::out_of_range("empty configuration history");
+    return at(mSize - 1);
+}
+
+size_t ConfigurationHistory::upperBound(base::Time const& time) const
+{
+    size_t first = 0;
+    size_t count = mSize;
+    while (count > 0)
+    {
+        size_t step = count / 2;
+        if (!(time < at(first + step).time))
+        {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+            count = step;
+    }
+    return first;
+}
+
+bool ConfigurationHistory::get(base::Time const& time, RequestedConfiguration& result) const
+{
+    size_t after = upperBound(time);
+    if (after == 0)
+        return false;
+    result = at(after - 1);
+    return true;
+}
+
+bool ConfigurationHistory::interpolate(base::Time const& time, RequestedConfiguration& result) const
+{
+    size_t after = upperBound(time);
+    if (after == 0)
+        return false;
+
+    RequestedConfiguration const& from = at(after - 1);
+    if (after == mSize || at(after).control_mode != from.control_mode)
+    {
+        result = from;
+        return true;
+    }
+
+    RequestedConfiguration const& to = at(after);
+    double ratio = (time - from.time).toSeconds() / (to.time - from.time).toSeconds();
+    result = from;
+    result.time = time;
+    switch(from.control_mode)
+    {
+        case RequestedConfiguration::ANGLES_RELATIVE:
+        case RequestedConfiguration::ANGLES_GEO:
+            result.rpy = quaternionToRPY(
+                rpyToQuaternion(from.rpy).slerp(ratio, rpyToQuaternion(to.rpy)));
+            break;
+        case RequestedConfiguration::ANGULAR_VELOCITY_RELATIVE:
+        case RequestedConfiguration::ANGULAR_VELOCITY_GEO:
+            result.rpy = from.rpy + (to.rpy - from.rpy) * ratio;
+            break;
+        case RequestedConfiguration::POSITION_GEO:
+            result.lat_lon_alt = GeoTarget(
+                from.lat_lon_alt.latitude + (to.lat_lon_alt.latitude - from.lat_lon_alt.latitude) * ratio,
+                from.lat_lon_alt.longitude + (to.lat_lon_alt.longitude - from.lat_lon_alt.longitude) * ratio,
+                from.lat_lon_alt.altitude + (to.lat_lon_alt.altitude - from.lat_lon_alt.altitude) * ratio);
+            break;
+        default:
+            break;
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef INDRA_HEADS_CONFIGURATION_HISTORY_HPP
+#define INDRA_HEADS_CONFIGURATION_HISTORY_HPP
+
+#include <indra_heads_protocol/RequestedConfiguration.hpp>
+#include <vector>
+
+namespace indra_heads_protocol
+{
+    /** Fixed-capacity, time-indexed history of requested configurations
+     *
+     * It is a ring buffer preallocated at construction (or when the capacity
+     * changes): once full, adding a configuration overwrites the oldest one
+     * and does not allocate. Lookups by time are O(log n).
+     *
+     * Configurations must be pushed in chronological order, which is the
+     * case of the ones stamped by Driver::readRequest
+     */
+    class ConfigurationHistory
+    {
+        std::vector<RequestedConfiguration> mEntries;
+        size_t mHead;
+        size_t mSize;
+
+        RequestedConfiguration const& at(size_t index) const;
+        /** Index of the first entry whose time is strictly after the given
+         * time
+         */
+        size_t upperBound(base::Time const& time) const;
+
+    public:
+        explicit ConfigurationHistory(size_t capacity = 0);
+
+        /** Change the capacity. This clears the history */
+        void setCapacity(size_t capacity);
+        size_t getCapacity() const;
+        size_t size() const;
+        bool empty() const;
+        void clear();
+
+        void push(RequestedConfiguration const& configuration);
+
+        /** The oldest configuration in the history */
+        RequestedConfiguration const& front() const;
+        /** The most recent configuration in the history */
+        RequestedConfiguration const& back() const;
+
+        /** The configuration that was active at the given time
+         *
+         * @return false if the time is before the oldest configuration in
+         *   the history, in which case result is unchanged
+         */
+        bool get(base::Time const& time, RequestedConfiguration& result) const;
+
+        /** The configuration at the given time, interpolated between the
+         * configurations that surround it
+         *
+         * Interpolation only happens between two configurations in the same
+         * control mode. Angles are interpolated with a slerp between the
+         * corresponding orientations, angular velocities and geodetic
+         * targets linearly. In any other case, it returns the same than get()
+         *
+         * @return false if the time is before the oldest configuration in
+         *   the history, in which case result is unchanged
+         */
+        bool interpolate(base::Time const& time, RequestedConfiguration& result) const;
+    };
+}
+
+#endif
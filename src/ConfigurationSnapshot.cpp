@@ -0,0 +1,77 @@
+#include <indra_heads_protocol/ConfigurationSnapshot.hpp>
+#include <cmath>
+#include <type_traits>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+static_assert(sizeof(ConfigurationSnapshot) == 32,
+              "ConfigurationSnapshot is expected to be 32 bytes long");
+static_assert(std::is_trivially_copyable<ConfigurationSnapshot>::value,
+              "ConfigurationSnapshot must be trivially copyable");
+
+/** Counts per unit of the snapshot fields. rpy uses the protocol's angular
+ * velocity resolution (0.1 degree), of which the 0.5 degree angle
+ * resolution is a multiple
+ */
+static const double RPY_SCALE = 1800 / M_PI;
+static const double LAT_LON_SCALE = 1e6;
+static const double ALTITUDE_SCALE = 10;
+
+static int32_t toCount(double value, double scale)
+{
+    double scaled = value * scale;
+    return static_cast<int32_t>(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+ConfigurationSnapshot ConfigurationSnapshot::fromConfiguration(
+    RequestedConfiguration const& configuration)
+{
+    ConfigurationSnapshot snapshot = ConfigurationSnapshot();
+    snapshot.time = configuration.time.toMicroseconds();
+    snapshot.command_id = configuration.command_id;
+    snapshot.rate_status_pt = configuration.rate_status_pt;
+    snapshot.rate_status_imu = configuration.rate_status_imu;
+    snapshot.control_mode = configuration.control_mode;
+
+    if (!base::isUnset(configuration.rpy.x()))
+    {
+        snapshot.flags |= HAS_RPY;
+        for (int i = 0; i < 3; ++i)
+            snapshot.rpy[i] = toCount(configuration.rpy[i], RPY_SCALE);
+    }
+
+    GeoTarget const& target = configuration.lat_lon_alt;
+    if (!base::isUnknown(target.latitude))
+    {
+        snapshot.flags |= HAS_LAT_LON_ALT;
+        snapshot.latitude  = toCount(target.latitude, LAT_LON_SCALE);
+        snapshot.longitude = toCount(target.longitude, LAT_LON_SCALE);
+        snapshot.altitude  = toCount(target.altitude, ALTITUDE_SCALE);
+    }
+    return snapshot;
+}
+
+RequestedConfiguration ConfigurationSnapshot::toConfiguration() const
+{
+    RequestedConfiguration configuration;
+    configuration.time = base::Time::fromMicroseconds(time);
+    configuration.command_id = static_cast<CommandIDs>(command_id);
+    configuration.rate_status_pt = static_cast<Rates>(rate_status_pt);
+    configuration.rate_status_imu = static_cast<Rates>(rate_status_imu);
+    configuration.control_mode =
+        static_cast<RequestedConfiguration::ControlModes>(control_mode);
+
+    if (flags & HAS_RPY)
+    {
+        // Same operation order than the protocol's angular velocity decoding
+        configuration.rpy = base::Vector3d(
+            rpy[0] * M_PI / 1800, rpy[1] * M_PI / 1800, rpy[2] * M_PI / 1800);
+    }
+    if (flags & HAS_LAT_LON_ALT)
+    {
+        configuration.lat_lon_alt = GeoTarget(
+            latitude * 1e-6, longitude * 1e-6, altitude * 0.1);
+    }
+    return configuration;
+}
@@ -0,0 +1,61 @@
+#ifndef INDRA_HEADS_CONFIGURATION_SNAPSHOT_HPP
+#define INDRA_HEADS_CONFIGURATION_SNAPSHOT_HPP
+
+#include <indra_heads_protocol/RequestedConfiguration.hpp>
+#include <cstdint>
+
+namespace indra_heads_protocol
+{
+    /** Compact, trivially copyable representation of a
+     * RequestedConfiguration
+     *
+     * It stores fixed-point integers instead of doubles, which makes it 32
+     * bytes long and safe to memcpy into logs, shared memory or IPC
+     * messages. Fields are in host byte order.
+     *
+     * The units are not all the ones of the wire. Angles and angular
+     * velocities share the rpy field, in tenths of degrees (or of degrees
+     * per second): this is the wire resolution of angular velocities, but
+     * finer than the 0.5 degree of the wire angles. Latitude and longitude
+     * (1e-6) and altitude (0.1m) match the wire resolution.
+     *
+     * The conversion is lossless for every configuration built from
+     * decoded requests (e.g. the ones from Driver::readRequest): converting
+     * back gives the same values, which encode to the same packets. Decoded
+     * angles may differ from the original by floating-point rounding only.
+     * Other values are rounded to the units above.
+     */
+    struct ConfigurationSnapshot
+    {
+        enum Flags
+        {
+            HAS_RPY         = 1,
+            HAS_LAT_LON_ALT = 2
+        };
+
+        /** Time of last update, in microseconds */
+        int64_t time;
+        /** Latitude and longitude in 1e-6 units */
+        int32_t latitude;
+        int32_t longitude;
+        /** Altitude in decimeters */
+        int32_t altitude;
+        /** Roll, pitch and yaw in tenths of degrees, or tenths of degrees
+         * per second depending on the command that set them
+         */
+        int16_t rpy[3];
+        uint8_t command_id;
+        uint8_t rate_status_pt;
+        uint8_t rate_status_imu;
+        uint8_t control_mode;
+        /** Combination of Flags telling which optional fields are set */
+        uint8_t flags;
+        uint8_t padding;
+
+        static ConfigurationSnapshot fromConfiguration(
+            RequestedConfiguration const& configuration);
+        RequestedConfiguration toConfiguration() const;
+    };
+}
+
+#endif
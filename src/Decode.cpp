@@ -0,0 +1,204 @@
+#include <indra_heads_protocol/CaptureDecoder.hpp>
+#include <indra_heads_protocol/Bundle.hpp>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+void usage()
+{
+    std::cout
+        << "usage: indra_heads_protocol_decode [OPTIONS] CAPTURE\n"
+        << "\n"
+        << "Decodes a raw capture of the link (the bytes as they were received,\n"
+        << "in both directions or in one) on all cores and reports the decoding\n"
+        << "throughput and what the capture contains.\n"
+        << "\n"
+        << "Options:\n"
+        << "  --threads N        number of decoding threads, 0 for one per core\n"
+        << "                     (default 0)\n"
+        << "  --chunk-size KB    size of the chunks decoded in parallel\n"
+        << "                     (default 4096)\n"
+        << "  --csv FILE         write the decoded packets as CSV, one per line\n"
+        << "  --generate MB      write a synthetic capture of MB megabytes in\n"
+        << "                     CAPTURE instead of decoding it\n"
+        << std::endl;
+}
+
+static const int COMMAND_COUNT = ID_BUNDLE + 1;
+
+static const char* COMMAND_NAMES[COMMAND_COUNT] = {
+    "stop", "self-test", "rate-pt", "rate-imu",
+    "angles-pos-rel", "angles-pos-geo", "angles-vel-rel", "angles-vel-geo",
+    "target", "features", "bundle"
+};
+
+/** Write a capture of requests and responses with a bit of line noise */
+void generate(std::string const& path, size_t megabytes)
+{
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+    std::ofstream out(path, std::ios::binary);
+    size_t size = megabytes << 20;
+    size_t written = 0;
+    std::vector<uint8_t> packet;
+    while (written < size)
+    {
+        switch(rng() % 8)
+        {
+            case 0:
+                packet = requests::packetize(requests::Stop());
+                break;
+            case 1:
+                packet = requests::packetize(requests::StatusRefreshRatePT(RATE_20HZ));
+                break;
+            case 2:
+                packet = requests::packetize(requests::AnglesGeo(
+                    angle(rng), angle(rng) / 2, angle(rng)));
+                break;
+            case 3:
+                packet = requests::packetize(requests::AngularVelocityGeo(
+                    angle(rng), angle(rng), angle(rng)));
+                break;
+            case 4:
+                packet = requests::packetize(requests::PositionGeo(
+                    angle(rng) / 4, angle(rng) / 2, rng() % 1000));
+                break;
+            case 5:
+            {
+                Bundle bundle;
+                bundle.add(requests::AnglesGeo(angle(rng), 0, 0));
+                bundle.add(requests::StatusRefreshRatePT(RATE_50HZ));
+                packet = bundle.packetize();
+                break;
+            }
+            case 6:
+                // Line noise
+                packet.resize(1 + rng() % 4);
+                for (auto& byte : packet)
+                    byte = rng();
+                break;
+            default:
+                packet = requests::packetize(reply::Response(ID_ANGLES_GEO, STATUS_OK));
+                break;
+        }
+        out.write(reinterpret_cast<char const*>(packet.data()), packet.size());
+        written += packet.size();
+    }
+}
+
+void writeCSV(std::string const& path, CaptureColumns const& columns)
+{
+    std::ofstream out(path);
+    out << "offset,command,type,code,value0,value1,value2\n";
+    out << std::setprecision(9);
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        out << columns.offsets[i] << ","
+            << COMMAND_NAMES[columns.command_ids[i]] << ","
+            << (columns.message_types[i] == MSG_RESPONSE ? "response" : "request") << ","
+            << static_cast<int>(columns.codes[i]);
+        for (int v = 0; v < 3; ++v)
+        {
+            out << ",";
+            if (!std::isnan(columns.values[v][i]))
+                out << columns.values[v][i];
+        }
+        out << "\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t threads = 0;
+    size_t chunk_size = 4096 << 10;
+    size_t generate_size = 0;
+    string csv;
+    string path;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+        if (arg == "--help") {
+            usage();
+            return 0;
+        }
+        else if (arg == "--threads" && has_value) {
+            threads = std::stoul(argv[++i]);
+        }
+        else if (arg == "--chunk-size" && has_value) {
+            chunk_size = std::stoul(argv[++i]) << 10;
+        }
+        else if (arg == "--csv" && has_value) {
+            csv = argv[++i];
+        }
+        else if (arg == "--generate" && has_value) {
+            generate_size = std::stoul(argv[++i]);
+        }
+        else {
+            path = arg;
+        }
+    }
+    if (path.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    if (generate_size)
+    {
+        generate(path, generate_size);
+        return 0;
+    }
+
+    CaptureDecoder decoder(threads, chunk_size);
+    MappedFile file(path);
+    auto start = std::chrono::steady_clock::now();
+    CaptureColumns columns = decoder.decode(file.data(), file.size());
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    CaptureStatistics const& stats = decoder.getStatistics();
+    std::cout
+        << "bytes:            " << stats.bytes << "\n"
+        << "packets:          " << stats.packets << "\n"
+        << "rows:             " << columns.size() << "\n"
+        << "discarded bytes:  " << stats.discarded_bytes << "\n"
+        << "truncated bytes:  " << stats.truncated_bytes << "\n"
+        << "chunks:           " << stats.chunks
+        << " (" << stats.stitched_packets << " packets framed again when stitching)\n"
+        << "threads:          " << decoder.getThreadCount() << "\n"
+        << "time:             " << std::fixed << std::setprecision(3) << seconds << " s\n"
+        << "throughput:       " << std::setprecision(1)
+        << stats.bytes / seconds / 1e6 << " MB/s\n";
+
+    uint64_t request_counts[COMMAND_COUNT] = { 0 };
+    uint64_t response_counts[COMMAND_COUNT] = { 0 };
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        if (columns.message_types[i] == MSG_RESPONSE)
+            ++response_counts[columns.command_ids[i]];
+        else
+            ++request_counts[columns.command_ids[i]];
+    }
+    std::cout << "\n" << std::setw(16) << "command"
+        << std::setw(12) << "requests" << std::setw(12) << "responses" << "\n";
+    for (int i = 0; i < COMMAND_COUNT; ++i)
+    {
+        if (request_counts[i] || response_counts[i])
+        {
+            std::cout << std::setw(16) << COMMAND_NAMES[i]
+                << std::setw(12) << request_counts[i] << std::setw(12) << response_counts[i] << "\n";
+        }
+    }
+
+    if (!csv.empty())
+        writeCSV(csv, columns);
+    return 0;
+}
@@ -0,0 +1,272 @@
+#include <indra_heads_protocol/DecodePipeline.hpp>
+#include <indra_heads_protocol/Response.hpp>
+#include <cstring>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+/** How many times a thread re-checks the ring before going to sleep */
+static const int SPIN_COUNT = 64;
+
+static size_t roundUpToPowerOfTwo(size_t value)
+{
+    size_t result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+FrameRing::FrameRing(size_t capacity)
+    : mFrames(roundUpToPowerOfTwo(std::max<size_t>(capacity, 1)))
+    , mMask(mFrames.size() - 1)
+    , mHead(0)
+    , mTail(0)
+{
+}
+
+size_t FrameRing::getCapacity() const
+{
+    return mFrames.size();
+}
+
+size_t FrameRing::size() const
+{
+    return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+}
+
+bool FrameRing::push(int64_t time, uint8_t const* data, size_t size)
+{
+    size_t tail = mTail.load(std::memory_order_relaxed);
+    if (tail - mHead.load(std::memory_order_acquire) == mFrames.size())
+        return false;
+
+    RawFrame& frame = mFrames[tail & mMask];
+    frame.time = time;
+    frame.size = size;
+    std::memcpy(frame.data, data, size);
+    mTail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool FrameRing::pop(RawFrame& frame)
+{
+    size_t head = mHead.load(std::memory_order_relaxed);
+    if (head == mTail.load(std::memory_order_acquire))
+        return false;
+
+    RawFrame const& source = mFrames[head & mMask];
+    frame.time = source.time;
+    frame.size = source.size;
+    std::memcpy(frame.data, source.data, source.size);
+    mHead.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+DecodePipeline::DecodePipeline(Driver& driver, size_t ring_capacity,
+                               OverflowPolicy policy)
+    : mDriver(driver)
+    , mRing(ring_capacity)
+    , mOverflowPolicy(policy)
+    , mQuit(false)
+    , mIOFinished(false)
+    , mFramesRead(0)
+    , mFramesDispatched(0)
+    , mFramesDropped(0)
+    , mBackpressureWaits(0)
+    , mMaxRingUsage(0)
+    , mDispatchSleeping(false)
+    , mIOSleeping(false)
+{
+}
+
+DecodePipeline::~DecodePipeline()
+{
+    stop();
+}
+
+void DecodePipeline::setRequestHandler(RequestHandler handler)
+{
+    mRequestHandler = handler;
+}
+
+void DecodePipeline::setResponseHandler(ResponseHandler handler)
+{
+    mResponseHandler = handler;
+}
+
+void DecodePipeline::start()
+{
+    if (mIOThread.joinable())
+        throw std::logic_error("DecodePipeline already started");
+
+    mQuit = false;
+    mIOFinished = false;
+    mIOThread = std::thread([this]() { runIO(); });
+    mDispatchThread = std::thread([this]() { runDispatch(); });
+}
+
+void DecodePipeline::stop()
+{
+    mQuit = true;
+    wakeUpAll();
+    if (mIOThread.joinable())
+        mIOThread.join();
+    if (mDispatchThread.joinable())
+        mDispatchThread.join();
+}
+
+void DecodePipeline::wait()
+{
+    if (mIOThread.joinable())
+        mIOThread.join();
+    if (mDispatchThread.joinable())
+        mDispatchThread.join();
+}
+
+void DecodePipeline::wakeUp(std::atomic<bool>& sleeping, std::condition_variable& condition)
+{
+    // Pairs with the fence in sleepUntil: either the sleeper sees our
+    // change to the ring, or we see that it is sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!sleeping.load(std::memory_order_relaxed))
+        return;
+
+    std::lock_guard<std::mutex> lock(mSleepLock);
+    condition.notify_one();
+}
+
+template<typename Predicate>
+void DecodePipeline::sleepUntil(std::atomic<bool>& sleeping, std::condition_variable& condition,
+                                Predicate predicate)
+{
+    for (int i = 0; i < SPIN_COUNT; ++i)
+    {
+        if (predicate())
+            return;
+        std::this_thread::yield();
+    }
+
+    std::unique_lock<std::mutex> lock(mSleepLock);
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    condition.wait(lock, predicate);
+    sleeping.store(false, std::memory_order_relaxed);
+}
+
+void DecodePipeline::wakeUpAll()
+{
+    std::lock_guard<std::mutex> lock(mSleepLock);
+    mFramesAvailable.notify_all();
+    mRoomAvailable.notify_all();
+}
+
+bool DecodePipeline::isIOFinished() const
+{
+    return mIOFinished;
+}
+
+void DecodePipeline::runIO()
+{
+    uint8_t buffer[MAX_PACKET_SIZE];
+    base::Time const timeout = base::Time::fromMilliseconds(100);
+    while (!mQuit)
+    {
+        int size;
+        try {
+            size = mDriver.readPacket(buffer, MAX_PACKET_SIZE, timeout);
+        }
+        catch(iodrivers_base::TimeoutError&) {
+            continue;
+        }
+        catch(std::exception&) {
+            break;
+        }
+
+        ++mFramesRead;
+        int64_t time = base::Time::now().toMicroseconds();
+        if (mRing.push(time, buffer, size))
+        {
+            wakeUp(mDispatchSleeping, mFramesAvailable);
+            continue;
+        }
+
+        if (mOverflowPolicy == DROP_NEWEST)
+        {
+            ++mFramesDropped;
+            continue;
+        }
+
+        ++mBackpressureWaits;
+        while (!mQuit && !mRing.push(time, buffer, size))
+        {
+            sleepUntil(mIOSleeping, mRoomAvailable, [this]() {
+                return mQuit || mRing.size() < mRing.getCapacity();
+            });
+        }
+        wakeUp(mDispatchSleeping, mFramesAvailable);
+    }
+    mIOFinished = true;
+    wakeUpAll();
+}
+
+void DecodePipeline::runDispatch()
+{
+    RawFrame frame;
+    while (!mQuit)
+    {
+        uint64_t usage = mRing.size();
+        if (usage > mMaxRingUsage)
+            mMaxRingUsage = usage;
+
+        if (mRing.pop(frame))
+        {
+            wakeUp(mIOSleeping, mRoomAvailable);
+            dispatch(frame);
+        }
+        else if (mIOFinished)
+        {
+            // The I/O thread may have pushed between our pop and its exit
+            while (mRing.pop(frame))
+                dispatch(frame);
+            return;
+        }
+        else
+        {
+            sleepUntil(mDispatchSleeping, mFramesAvailable, [this]() {
+                return mQuit || mIOFinished || mRing.size() != 0;
+            });
+        }
+    }
+}
+
+void DecodePipeline::dispatch(RawFrame const& frame)
+{
+    if (frame.data[1] == MSG_RESPONSE)
+    {
+        Response response {
+            static_cast<CommandIDs>(frame.data[0]),
+            reply::parse(reinterpret_cast<packets::Response const&>(frame.data[0]))
+        };
+        if (mResponseHandler)
+            mResponseHandler(response);
+    }
+    else
+    {
+        mRequestedConfiguration.time = base::Time::fromMicroseconds(frame.time);
+        CommandIDs command_id = Driver::decodeRequest(frame.data, mRequestedConfiguration);
+        if (mRequestHandler)
+            mRequestHandler(command_id, mRequestedConfiguration);
+    }
+    ++mFramesDispatched;
+}
+
+PipelineStatistics DecodePipeline::getStatistics() const
+{
+    PipelineStatistics stats;
+    stats.frames_read = mFramesRead;
+    stats.frames_dispatched = mFramesDispatched;
+    stats.frames_dropped = mFramesDropped;
+    stats.backpressure_waits = mBackpressureWaits;
+    stats.max_ring_usage = mMaxRingUsage;
+    return stats;
+}
@@ -0,0 +1,161 @@
+#ifndef INDRA_HEADS_DECODE_PIPELINE_HPP
+#define INDRA_HEADS_DECODE_PIPELINE_HPP
+
+#include <indra_heads_protocol/Driver.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace indra_heads_protocol
+{
+    /** A framed packet, as read by the I/O stage of DecodePipeline */
+    struct RawFrame
+    {
+        /** Reception time, in microseconds */
+        int64_t time;
+        uint8_t size;
+        uint8_t data[MAX_PACKET_SIZE];
+    };
+
+    /** Lock-free single-producer single-consumer ring of raw frames
+     *
+     * The capacity is rounded up to a power of two. All storage is
+     * allocated at construction
+     */
+    class FrameRing
+    {
+        std::vector<RawFrame> mFrames;
+        size_t mMask;
+        std::atomic<size_t> mHead;
+        std::atomic<size_t> mTail;
+
+    public:
+        explicit FrameRing(size_t capacity);
+
+        size_t getCapacity() const;
+        size_t size() const;
+
+        /** Producer side. Returns false if the ring is full */
+        bool push(int64_t time, uint8_t const* data, size_t size);
+        /** Consumer side. Returns false if the ring is empty */
+        bool pop(RawFrame& frame);
+    };
+
+    struct PipelineStatistics
+    {
+        /** Frames read and framed by the I/O thread */
+        uint64_t frames_read = 0;
+        /** Frames decoded and given to the handlers */
+        uint64_t frames_dispatched = 0;
+        /** Frames discarded because the ring was full (DROP_NEWEST) */
+        uint64_t frames_dropped = 0;
+        /** How many times the I/O thread had to wait for the ring to have
+         * room (BLOCK)
+         */
+        uint64_t backpressure_waits = 0;
+        /** Maximum number of frames that were waiting in the ring */
+        uint64_t max_ring_usage = 0;
+    };
+
+    /** Two-stage receive path for a Driver
+     *
+     * An I/O thread reads from the driver and only frames packets (which
+     * includes the CRC check), pushing them into a FrameRing. A dispatch
+     * thread decodes them and calls the handlers. Requests update a
+     * RequestedConfiguration owned by the dispatch thread, the same way
+     * Driver::readRequest does.
+     *
+     * A thread that finds the ring empty (dispatch) or full (I/O with
+     * BLOCK) spins briefly, then sleeps until the other one signals it, so
+     * that an idle pipeline does not use any CPU. The ring itself stays
+     * lock-free, the mutex is only taken when a thread is asleep.
+     *
+     * The driver must not be read from by other threads while the pipeline
+     * is running. Writing (e.g. writeResponse from a handler) is fine.
+     *
+     * This is only worth it when decoding and handling are expensive enough
+     * to be the bottleneck; see the 'pipeline' benchmark.
+     */
+    class DecodePipeline
+    {
+    public:
+        enum OverflowPolicy
+        {
+            /** Drop frames that arrive while the ring is full */
+            DROP_NEWEST,
+            /** Stop reading until the dispatch thread made room */
+            BLOCK
+        };
+
+        typedef std::function<void (CommandIDs, RequestedConfiguration const&)> RequestHandler;
+        typedef std::function<void (Response const&)> ResponseHandler;
+
+    private:
+        Driver& mDriver;
+        FrameRing mRing;
+        OverflowPolicy mOverflowPolicy;
+        RequestHandler mRequestHandler;
+        ResponseHandler mResponseHandler;
+        RequestedConfiguration mRequestedConfiguration;
+
+        std::atomic<bool> mQuit;
+        std::atomic<bool> mIOFinished;
+        std::atomic<uint64_t> mFramesRead;
+        std::atomic<uint64_t> mFramesDispatched;
+        std::atomic<uint64_t> mFramesDropped;
+        std::atomic<uint64_t> mBackpressureWaits;
+        std::atomic<uint64_t> mMaxRingUsage;
+        std::thread mIOThread;
+        std::thread mDispatchThread;
+
+        std::mutex mSleepLock;
+        std::condition_variable mFramesAvailable;
+        std::condition_variable mRoomAvailable;
+        std::atomic<bool> mDispatchSleeping;
+        std::atomic<bool> mIOSleeping;
+
+        void runIO();
+        void runDispatch();
+        void dispatch(RawFrame const& frame);
+
+        /** Wake up a thread if it is sleeping on the given condition */
+        void wakeUp(std::atomic<bool>& sleeping, std::condition_variable& condition);
+        /** Spin, then sleep until the predicate is true */
+        template<typename Predicate>
+        void sleepUntil(std::atomic<bool>& sleeping, std::condition_variable& condition,
+                        Predicate predicate);
+        /** Wake up both threads, e.g. on stop */
+        void wakeUpAll();
+
+    public:
+        DecodePipeline(Driver& driver, size_t ring_capacity = 1024,
+                       OverflowPolicy policy = BLOCK);
+        ~DecodePipeline();
+
+        void setRequestHandler(RequestHandler handler);
+        void setResponseHandler(ResponseHandler handler);
+
+        /** Start the I/O and dispatch threads */
+        void start();
+
+        /** Stop both threads. Frames still in the ring are discarded */
+        void stop();
+
+        /** Wait for the I/O thread to reach the end of the stream (or an
+         * I/O error), and for the dispatch thread to drain the ring
+         */
+        void wait();
+
+        /** Whether the I/O thread stopped because of the end of stream or
+         * an I/O error
+         */
+        bool isIOFinished() const;
+
+        PipelineStatistics getStatistics() const;
+    };
+}
+
+#endif
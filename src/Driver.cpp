@@ -1,13 +1,34 @@
 #include <indra_heads_protocol/Driver.hpp>
 #include <indra_heads_protocol/Protocol.hpp>
 #include <indra_heads_protocol/Response.hpp>
+#include <indra_heads_protocol/Tracing.hpp>
 #include <iostream>
+#include <cstring>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
 
 using namespace std;
 using namespace indra_heads_protocol;
 
 Driver::Driver()
     : iodrivers_base::Driver(indra_heads_protocol::MAX_PACKET_SIZE * 10)
+    , mRequestedConfigurationHistory(64)
+    , mReadingPacket(false)
+    , mCRCFailures(0)
+    , mRejectedBytesLeft(0)
+    , mRequestQueueHead(0)
+    , mRequestQueueSize(0)
+    , mWatchdogFD(-1)
+    , mSetpointTimeouts(RequestedConfiguration::POSITION_GEO + 1)
+    , mWatchdogStopCount(0)
+    , mRetransmitCount(0)
+    , mRetransmissions(0)
+    , mPeerFeatures(0)
 {
     // NOTE: MAX_PACKET_SIZE here is this->MAX_PACKET_SIZE which is initialized
     // using the value passed to the constructor above. The confusion here stems
@@ -15,93 +36,285 @@ Driver::Driver()
     // the size of the internal buffer.
     mReadBuffer.resize(MAX_PACKET_SIZE);
     mWriteBuffer.resize(MAX_PACKET_SIZE);
+    setRequestQueueCapacity(16);
+    clearAcknowledgedConfiguration();
+}
+
+Driver::~Driver()
+{
+    if (mWatchdogFD != -1)
+        ::close(mWatchdogFD);
+}
+
+void Driver::clear()
+{
+    iodrivers_base::Driver::clear();
+    mParser.reset();
+    mRejectedBytesLeft = 0;
 }
 
 int Driver::extractPacket(uint8_t const* buffer, size_t buffer_size) const
 {
-    if (buffer_size == 0)
-        return 0;
-    else if (buffer[0] > ID_LAST)
-        return -1;
-    else if (buffer_size < 2)
-        return 0;
-    else if (buffer[1] > MSG_LAST_TYPE)
-        return -1;
-
-    size_t packet_size   = packets::getPacketSize(
-            static_cast<CommandIDs>(buffer[0]),
-            static_cast<MessageTypes>(buffer[1]));
-    size_t expected_size = packet_size + sizeof(crc_t);
-    if (buffer_size < expected_size)
-        return 0;
-
-    crc_t expected_crc = *reinterpret_cast<crc_t const*>(buffer + packet_size);
-    crc_t actual_crc   = details::compute_crc(buffer, packet_size);
-    if (actual_crc != expected_crc)
-        return -1;
-    return expected_size;
+    int result = mParser.extract(buffer, buffer_size);
+    if (!mReadingPacket)
+        return result;
+    else if (result > 0)
+        mRejectedBytesLeft = 0;
+    if (result >= 0)
+        return result;
+
+    // Each rejection discards one byte
+    bool resynchronizing = (mRejectedBytesLeft != 0);
+    if (resynchronizing)
+        --mRejectedBytesLeft;
+    else if (mParser.getRejectedSize() > 1)
+        mRejectedBytesLeft = mParser.getRejectedSize() - 1;
+
+    if (!resynchronizing && mParser.getLastRejection() == PacketParser::REJECTED_CRC)
+    {
+        ++mCRCFailures;
+        INDRA_HEADS_TRACE(crc_failure, buffer[0], buffer[1], buffer_size);
+    }
+    else
+        INDRA_HEADS_TRACE(byte_discarded, buffer[0]);
+    return result;
+}
+
+namespace
+{
+    /** Sets a flag for the lifetime of the object */
+    struct FlagGuard
+    {
+        bool& flag;
+        explicit FlagGuard(bool& flag) : flag(flag) { flag = true; }
+        ~FlagGuard() { flag = false; }
+    };
+}
+
+int Driver::tracePacketFramed(uint8_t const* buffer, int size)
+{
+    INDRA_HEADS_TRACE(packet_framed, buffer[0], buffer[1], size);
+    return size;
+}
+
+int Driver::readPacket(uint8_t* buffer, int buffer_size)
+{
+    FlagGuard reading(mReadingPacket);
+    return tracePacketFramed(buffer, iodrivers_base::Driver::readPacket(buffer, buffer_size));
+}
+
+int Driver::readPacket(uint8_t* buffer, int buffer_size, base::Time const& packet_timeout)
+{
+    FlagGuard reading(mReadingPacket);
+    return tracePacketFramed(buffer, iodrivers_base::Driver::readPacket(
+        buffer, buffer_size, packet_timeout));
+}
+
+int Driver::readPacket(uint8_t* buffer, int buffer_size, base::Time const& packet_timeout,
+                       base::Time const& first_byte_timeout)
+{
+    FlagGuard reading(mReadingPacket);
+    return tracePacketFramed(buffer, iodrivers_base::Driver::readPacket(
+        buffer, buffer_size, packet_timeout, first_byte_timeout));
+}
+
+void Driver::writeRequest(uint8_t const* buffer, size_t size)
+{
+    writePacket(buffer, size);
+    INDRA_HEADS_TRACE(request_sent, buffer[0], size);
+}
+
+void Driver::setRequestQueueCapacity(size_t capacity)
+{
+    mRequestQueue.resize(capacity);
+    mRequestQueueHead = 0;
+    mRequestQueueSize = 0;
+}
+
+size_t Driver::getQueuedRequestCount() const
+{
+    return mRequestQueueSize;
+}
+
+Driver::QueuedRequest* Driver::pushQueuedRequest()
+{
+    if (mRequestQueueSize == mRequestQueue.size())
+        return nullptr;
+
+    size_t index = (mRequestQueueHead + mRequestQueueSize) % mRequestQueue.size();
+    ++mRequestQueueSize;
+    return &mRequestQueue[index];
+}
+
+size_t Driver::writeQueuedRequests()
+{
+    return writeQueuedRequests(mRequestQueueSize);
+}
+
+size_t Driver::writeQueuedRequests(size_t max_count)
+{
+    size_t count = 0;
+    while (mRequestQueueSize != 0 && count < max_count)
+    {
+        QueuedRequest const& request = mRequestQueue[mRequestQueueHead];
+        writeRequest(request.data, request.size);
+        mRequestQueueHead = (mRequestQueueHead + 1) % mRequestQueue.size();
+        --mRequestQueueSize;
+        ++count;
+    }
+    return count;
+}
+
+static bool isSetpoint(CommandIDs command_id)
+{
+    switch(command_id)
+    {
+        case ID_ANGLES_RELATIVE:
+        case ID_ANGLES_GEO:
+        case ID_ANGULAR_VELOCITY_RELATIVE:
+        case ID_ANGULAR_VELOCITY_GEO:
+        case ID_STABILIZATION_TARGET:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/** Whether a request packet carries a setpoint, directly or in a bundle */
+static bool hasSetpoint(uint8_t const* packet)
+{
+    if (packet[0] != ID_BUNDLE)
+        return isSetpoint(static_cast<CommandIDs>(packet[0]));
+
+    uint8_t const* entry = packet + BUNDLE_HEADER_SIZE;
+    uint8_t const* end = entry + packet[2];
+    for (; entry < end; entry += bundles::getEntrySize(entry[0]))
+    {
+        if (isSetpoint(static_cast<CommandIDs>(entry[0])))
+            return true;
+    }
+    return false;
+}
+
+size_t Driver::cancelQueuedSetpoints()
+{
+    size_t capacity = mRequestQueue.size();
+    size_t kept = 0;
+    for (size_t i = 0; i < mRequestQueueSize; ++i)
+    {
+        QueuedRequest const& request = mRequestQueue[(mRequestQueueHead + i) % capacity];
+        if (isSetpoint(request.command_id))
+            continue;
+        if (kept != i)
+            mRequestQueue[(mRequestQueueHead + kept) % capacity] = request;
+        ++kept;
+    }
+
+    size_t cancelled = mRequestQueueSize - kept;
+    mRequestQueueSize = kept;
+    return cancelled;
 }
 
 CommandIDs Driver::readRequest()
 {
-    readPacket(mReadBuffer.data(), MAX_PACKET_SIZE);
+    return readRequest(getReadTimeout());
+}
+
+CommandIDs Driver::readRequest(base::Time const& timeout)
+{
+    readPacket(mReadBuffer.data(), MAX_PACKET_SIZE, timeout);
     if (mReadBuffer[1] == MSG_RESPONSE)
         throw std::runtime_error("expected a command packet but got a response");
 
     mRequestedConfiguration.time = base::Time::now();
+    RequestedConfiguration::ControlModes previous_mode = mRequestedConfiguration.control_mode;
+    CommandIDs command_id = decodeRequest(mReadBuffer.data(), mRequestedConfiguration);
+    mRequestedConfigurationHistory.push(mRequestedConfiguration);
+    // Only a fresh setpoint keeps the current one from going stale
+    if (hasSetpoint(mReadBuffer.data()) ||
+        mRequestedConfiguration.control_mode != previous_mode)
+        armWatchdog();
+    INDRA_HEADS_TRACE(request_decoded, command_id,
+                      mRequestedConfiguration.time.toMicroseconds());
+    return command_id;
+}
 
-    switch(mReadBuffer[0])
+CommandIDs Driver::decodeRequest(uint8_t const* packet,
+                                 RequestedConfiguration& configuration)
+{
+    switch(packet[0])
     {
         case ID_STOP:
-            mRequestedConfiguration.command_id = ID_STOP;
-            mRequestedConfiguration.control_mode = RequestedConfiguration::STOP;
+            configuration.command_id = ID_STOP;
+            configuration.control_mode = RequestedConfiguration::STOP;
             return ID_STOP;
         case ID_BITE:
-            mRequestedConfiguration.command_id = ID_BITE;
-            mRequestedConfiguration.control_mode = RequestedConfiguration::SELF_TEST;
+            configuration.command_id = ID_BITE;
+            configuration.control_mode = RequestedConfiguration::SELF_TEST;
             return ID_BITE;
         case ID_STATUS_REFRESH_RATE_PT:
-            mRequestedConfiguration.command_id = ID_STATUS_REFRESH_RATE_PT;
-            mRequestedConfiguration.rate_status_pt =
-                requests::decode(reinterpret_cast<packets::StatusRefreshRate&>(mReadBuffer[0]));
+            configuration.command_id = ID_STATUS_REFRESH_RATE_PT;
+            configuration.rate_status_pt =
+                requests::decode(reinterpret_cast<packets::StatusRefreshRate const&>(packet[0]));
             return ID_STATUS_REFRESH_RATE_PT;
         case ID_STATUS_REFRESH_RATE_IMU:
-            mRequestedConfiguration.command_id = ID_STATUS_REFRESH_RATE_IMU;
-            mRequestedConfiguration.rate_status_imu =
-                requests::decode(reinterpret_cast<packets::StatusRefreshRate&>(mReadBuffer[0]));
+            configuration.command_id = ID_STATUS_REFRESH_RATE_IMU;
+            configuration.rate_status_imu =
+                requests::decode(reinterpret_cast<packets::StatusRefreshRate const&>(packet[0]));
             return ID_STATUS_REFRESH_RATE_IMU;
         case ID_ANGLES_RELATIVE:
-            mRequestedConfiguration.command_id = ID_ANGLES_RELATIVE;
-            mRequestedConfiguration.control_mode = RequestedConfiguration::ANGLES_RELATIVE;
-            mRequestedConfiguration.rpy =
-                requests::decode(reinterpret_cast<packets::Angles&>(mReadBuffer[0]));
+            configuration.command_id = ID_ANGLES_RELATIVE;
+            configuration.control_mode = RequestedConfiguration::ANGLES_RELATIVE;
+            configuration.rpy =
+                requests::decode(reinterpret_cast<packets::Angles const&>(packet[0]));
             return ID_ANGLES_RELATIVE;
         case ID_ANGLES_GEO:
-            mRequestedConfiguration.command_id = ID_ANGLES_GEO;
-            mRequestedConfiguration.control_mode = RequestedConfiguration::ANGLES_GEO;
-            mRequestedConfiguration.rpy =
-                requests::decode(reinterpret_cast<packets::Angles&>(mReadBuffer[0]));
+            configuration.command_id = ID_ANGLES_GEO;
+            configuration.control_mode = RequestedConfiguration::ANGLES_GEO;
+            configuration.rpy =
+                requests::decode(reinterpret_cast<packets::Angles const&>(packet[0]));
             return ID_ANGLES_GEO;
         case ID_ANGULAR_VELOCITY_RELATIVE:
-            mRequestedConfiguration.command_id = ID_ANGULAR_VELOCITY_RELATIVE;
-            mRequestedConfiguration.control_mode =
+            configuration.command_id = ID_ANGULAR_VELOCITY_RELATIVE;
+            configuration.control_mode =
                 RequestedConfiguration::ANGULAR_VELOCITY_RELATIVE;
-            mRequestedConfiguration.rpy =
-                requests::decode(reinterpret_cast<packets::AngularVelocities&>(mReadBuffer[0]));
+            configuration.rpy =
+                requests::decode(reinterpret_cast<packets::AngularVelocities const&>(packet[0]));
             return ID_ANGULAR_VELOCITY_RELATIVE;
         case ID_ANGULAR_VELOCITY_GEO:
-            mRequestedConfiguration.command_id = ID_ANGULAR_VELOCITY_GEO;
-            mRequestedConfiguration.control_mode =
+            configuration.command_id = ID_ANGULAR_VELOCITY_GEO;
+            configuration.control_mode =
                 RequestedConfiguration::ANGULAR_VELOCITY_GEO;
-            mRequestedConfiguration.rpy =
-                requests::decode(reinterpret_cast<packets::AngularVelocities&>(mReadBuffer[0]));
+            configuration.rpy =
+                requests::decode(reinterpret_cast<packets::AngularVelocities const&>(packet[0]));
             return ID_ANGULAR_VELOCITY_GEO;
         case ID_STABILIZATION_TARGET:
-            mRequestedConfiguration.command_id = ID_STABILIZATION_TARGET;
-            mRequestedConfiguration.control_mode = RequestedConfiguration::POSITION_GEO;
-            mRequestedConfiguration.lat_lon_alt =
-                requests::decode(reinterpret_cast<packets::PositionGeo&>(mReadBuffer[0]));
+            configuration.command_id = ID_STABILIZATION_TARGET;
+            configuration.control_mode = RequestedConfiguration::POSITION_GEO;
+            configuration.lat_lon_alt =
+                requests::decode(reinterpret_cast<packets::PositionGeo const&>(packet[0]));
             return ID_STABILIZATION_TARGET;
+        case ID_FEATURES:
+            return ID_FEATURES;
+        case ID_BUNDLE:
+        {
+            // The framing validated the payload. Each entry is decoded as
+            // the request it stands for
+            uint8_t const* entry = packet + BUNDLE_HEADER_SIZE;
+            uint8_t const* end = entry + packet[2];
+            uint8_t request[indra_heads_protocol::MAX_PACKET_SIZE];
+            request[1] = MSG_REQUEST;
+            while (entry < end)
+            {
+                int entry_size = bundles::getEntrySize(entry[0]);
+                request[0] = entry[0];
+                std::memcpy(request + 2, entry + 1, entry_size - 1);
+                decodeRequest(request, configuration);
+                entry += entry_size;
+            }
+            configuration.command_id = ID_BUNDLE;
+            return ID_BUNDLE;
+        }
         default:
             throw std::logic_error("should never have reached this");
             // Never reached;
@@ -114,22 +327,437 @@ CommandIDs Driver::readRequest()
 void Driver::writeResponse(Response response)
 {
     auto packet = reply::Response(response.command_id, response.status);
-    sendRequest(packet);
+    requests::packetize(mWriteBuffer.data(), packet);
+    writePacket(mWriteBuffer.data(), sizeof(packet) + sizeof(crc_t));
+    INDRA_HEADS_TRACE(response_sent, response.command_id, response.status);
+}
+
+void Driver::writeFeatures(uint8_t features)
+{
+    writeResponse(Response { ID_FEATURES, static_cast<ResponseStatus>(features) });
+}
+
+void Driver::writeResponses(Response const* responses, size_t count)
+{
+    if (count == 0)
+        return;
+
+    size_t const packet_size = sizeof(packets::Response) + sizeof(crc_t);
+    if (mResponseBuffer.size() < count * packet_size)
+        mResponseBuffer.resize(count * packet_size);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto packet = reply::Response(responses[i].command_id, responses[i].status);
+        requests::packetize(mResponseBuffer.data() + i * packet_size, packet);
+    }
+    writePacket(mResponseBuffer.data(), count * packet_size);
+    for (size_t i = 0; i < count; ++i)
+        INDRA_HEADS_TRACE(response_sent, responses[i].command_id, responses[i].status);
 }
 
 Response Driver::readResponse()
 {
-    readPacket(mReadBuffer.data(), MAX_PACKET_SIZE);
+    return readResponse(getReadTimeout());
+}
+
+Response Driver::readResponse(base::Time const& timeout)
+{
+    readPacket(mReadBuffer.data(), MAX_PACKET_SIZE, timeout);
     if (mReadBuffer[1] == MSG_REQUEST)
         throw std::runtime_error("expected a response packet but got a request");
 
-    return Response {
+    Response response {
         static_cast<CommandIDs>(mReadBuffer[0]),
         reply::parse(reinterpret_cast<packets::Response const&>(mReadBuffer[0]))
     };
+    INDRA_HEADS_TRACE(response_matched, response.command_id, response.status);
+    return response;
 }
 
 RequestedConfiguration Driver::getRequestedConfiguration() const
 {
     return mRequestedConfiguration;
 }
+
+ConfigurationHistory const& Driver::getRequestedConfigurationHistory() const
+{
+    return mRequestedConfigurationHistory;
+}
+
+void Driver::setRequestedConfigurationHistoryCapacity(size_t capacity)
+{
+    mRequestedConfigurationHistory.setCapacity(capacity);
+}
+
+Response Driver::transactPacket(uint8_t const* packet, size_t size, bool idempotent)
+{
+    CommandIDs command_id = static_cast<CommandIDs>(packet[0]);
+    int attempts = 1 + (idempotent ? mRetransmitCount : 0);
+    Response response;
+    for (int i = 0; i < attempts; ++i)
+    {
+        if (i != 0)
+            ++mRetransmissions;
+        base::Time sent = base::Time::now();
+        writeRequest(packet, size);
+        if (waitTransactionResponse(command_id, sent, i == 0, response))
+        {
+            if (response.status == STATUS_OK)
+                acknowledgePacket(packet, size);
+            return response;
+        }
+    }
+    throw iodrivers_base::TimeoutError(iodrivers_base::TimeoutError::PACKET,
+                                       "no response from the head");
+}
+
+void Driver::sendRequest(Bundle const& bundle)
+{
+    size_t size = bundle.packetize(mWriteBuffer.data());
+    writeRequest(mWriteBuffer.data(), size);
+}
+
+Response Driver::transact(Bundle const& bundle)
+{
+    if (mPeerFeatures & FEATURE_BUNDLE)
+    {
+        uint8_t buffer[MAX_PACKET_SIZE];
+        size_t size = bundle.packetize(buffer);
+        Response response = transactPacket(buffer, size, bundle.isIdempotent());
+        if (response.status == STATUS_OK)
+            acknowledgeRequest(bundle);
+        return response;
+    }
+
+    for (auto const& packet : bundle.packetizeCommands())
+    {
+        Response response = transactPacket(packet.data(), packet.size(),
+            packets::isIdempotent(static_cast<CommandIDs>(packet[0])));
+        if (response.status != STATUS_OK)
+            return Response { ID_BUNDLE, response.status };
+    }
+    return Response { ID_BUNDLE, STATUS_OK };
+}
+
+uint8_t Driver::negotiateFeatures()
+{
+    // A head that does not answer is not slow, it just predates the
+    // extensions. Do not let that inflate the response timeouts
+    RoundTripEstimator round_trip = mRoundTrip;
+    try {
+        Response response = transact(requests::Features());
+        mPeerFeatures = static_cast<uint8_t>(response.status);
+    }
+    catch(iodrivers_base::TimeoutError&) {
+        mRoundTrip = round_trip;
+        mPeerFeatures = 0;
+    }
+    return mPeerFeatures;
+}
+
+uint8_t Driver::getPeerFeatures() const
+{
+    return mPeerFeatures;
+}
+
+void Driver::acknowledgePacket(uint8_t const* packet, size_t size)
+{
+    AcknowledgedRequest* part;
+    switch(packet[0])
+    {
+        case ID_STATUS_REFRESH_RATE_PT:
+            part = &mAcknowledged[ACKNOWLEDGED_RATE_PT];
+            break;
+        case ID_STATUS_REFRESH_RATE_IMU:
+            part = &mAcknowledged[ACKNOWLEDGED_RATE_IMU];
+            break;
+        case ID_STOP:
+        case ID_ANGLES_RELATIVE:
+        case ID_ANGLES_GEO:
+        case ID_ANGULAR_VELOCITY_RELATIVE:
+        case ID_ANGULAR_VELOCITY_GEO:
+        case ID_STABILIZATION_TARGET:
+            part = &mAcknowledged[ACKNOWLEDGED_CONTROL];
+            break;
+        case ID_BITE:
+            // The self-test replaces the previous control mode, but must
+            // not be started again on reconnection
+            mAcknowledged[ACKNOWLEDGED_CONTROL].size = 0;
+            return;
+        default:
+            return;
+    }
+    part->size = size;
+    std::memcpy(part->data, packet, size);
+}
+
+void Driver::acknowledgeRequest(Bundle const& bundle)
+{
+    for (auto const& packet : bundle.packetizeCommands())
+        acknowledgePacket(packet.data(), packet.size());
+}
+
+RequestedConfiguration Driver::getAcknowledgedConfiguration() const
+{
+    RequestedConfiguration configuration;
+    for (auto const& request : mAcknowledged)
+    {
+        if (request.size)
+            decodeRequest(request.data, configuration);
+    }
+    return configuration;
+}
+
+size_t Driver::getAcknowledgedRequestCount() const
+{
+    size_t count = 0;
+    for (auto const& request : mAcknowledged)
+        count += request.size ? 1 : 0;
+    return count;
+}
+
+void Driver::clearAcknowledgedConfiguration()
+{
+    for (auto& request : mAcknowledged)
+        request.size = 0;
+}
+
+Response Driver::restoreConfiguration()
+{
+    bool pending[ACKNOWLEDGED_PART_COUNT];
+    size_t pending_count = 0;
+    for (int i = 0; i < ACKNOWLEDGED_PART_COUNT; ++i)
+    {
+        pending[i] = mAcknowledged[i].size != 0;
+        pending_count += pending[i] ? 1 : 0;
+    }
+
+    Response result { ID_BUNDLE, STATUS_OK };
+    uint8_t burst[ACKNOWLEDGED_PART_COUNT * indra_heads_protocol::MAX_PACKET_SIZE];
+    int attempts = 1 + mRetransmitCount;
+    for (int attempt = 0; attempt < attempts && pending_count; ++attempt)
+    {
+        size_t size = 0;
+        for (int i = 0; i < ACKNOWLEDGED_PART_COUNT; ++i)
+        {
+            if (!pending[i])
+                continue;
+            std::memcpy(burst + size, mAcknowledged[i].data, mAcknowledged[i].size);
+            size += mAcknowledged[i].size;
+        }
+        if (attempt != 0)
+            mRetransmissions += pending_count;
+
+        base::Time sent = base::Time::now();
+        writePacket(burst, size);
+        for (int i = 0; i < ACKNOWLEDGED_PART_COUNT; ++i)
+        {
+            if (pending[i])
+                INDRA_HEADS_TRACE(request_sent, mAcknowledged[i].data[0], mAcknowledged[i].size);
+        }
+
+        // Only the first response is a round-trip sample, the others waited
+        // for the head to process the requests before them
+        bool sample = attempt == 0;
+        base::Time deadline = sent + mRoundTrip.getTimeout();
+        while (pending_count)
+        {
+            base::Time now = base::Time::now();
+            if (!(now < deadline))
+                break;
+
+            Response response;
+            try {
+                response = readResponse(deadline - now);
+            }
+            catch(iodrivers_base::TimeoutError&) {
+                break;
+            }
+
+            int part = 0;
+            while (part < ACKNOWLEDGED_PART_COUNT &&
+                   !(pending[part] && mAcknowledged[part].data[0] == response.command_id))
+                ++part;
+            if (part == ACKNOWLEDGED_PART_COUNT)
+                continue;
+
+            if (sample)
+                mRoundTrip.addSample(base::Time::now() - sent);
+            sample = false;
+            pending[part] = false;
+            --pending_count;
+            if (response.status != STATUS_OK && result.status == STATUS_OK)
+                result.status = response.status;
+        }
+        if (!pending_count)
+            return result;
+
+        mRoundTrip.backoff();
+        bool idempotent = true;
+        for (int i = 0; i < ACKNOWLEDGED_PART_COUNT; ++i)
+        {
+            if (pending[i])
+                idempotent = idempotent && packets::isIdempotent(
+                    static_cast<CommandIDs>(mAcknowledged[i].data[0]));
+        }
+        if (!idempotent)
+            break;
+    }
+    if (pending_count)
+    {
+        throw iodrivers_base::TimeoutError(iodrivers_base::TimeoutError::PACKET,
+                                           "no response from the head");
+    }
+    return result;
+}
+
+bool Driver::waitTransactionResponse(CommandIDs command_id, base::Time const& sent,
+                                     bool sample, Response& response)
+{
+    base::Time deadline = sent + mRoundTrip.getTimeout();
+    while (true)
+    {
+        base::Time now = base::Time::now();
+        if (!(now < deadline))
+            break;
+
+        try {
+            response = readResponse(deadline - now);
+        }
+        catch(iodrivers_base::TimeoutError&) {
+            break;
+        }
+        if (response.command_id != command_id)
+            continue;
+
+        // Karn's algorithm: the response to a retransmitted request may be
+        // for any of the transmissions
+        if (sample)
+            mRoundTrip.addSample(base::Time::now() - sent);
+        return true;
+    }
+    mRoundTrip.backoff();
+    return false;
+}
+
+void Driver::setRetransmitCount(int count)
+{
+    mRetransmitCount = count;
+}
+
+int Driver::getRetransmitCount() const
+{
+    return mRetransmitCount;
+}
+
+uint64_t Driver::getRetransmissionCount() const
+{
+    return mRetransmissions;
+}
+
+RoundTripEstimator& Driver::getRoundTripEstimator()
+{
+    return mRoundTrip;
+}
+
+RoundTripEstimator const& Driver::getRoundTripEstimator() const
+{
+    return mRoundTrip;
+}
+
+void Driver::setSetpointTimeout(RequestedConfiguration::ControlModes mode,
+                                base::Time const& timeout)
+{
+    if (mWatchdogFD == -1)
+    {
+        mWatchdogFD = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (mWatchdogFD == -1)
+            throw iodrivers_base::UnixError("failed to create the watchdog timerfd");
+    }
+    mSetpointTimeouts.at(mode) = timeout;
+}
+
+int Driver::getWatchdogFileDescriptor() const
+{
+    return mWatchdogFD;
+}
+
+uint64_t Driver::getWatchdogStopCount() const
+{
+    return mWatchdogStopCount;
+}
+
+uint64_t Driver::getCRCFailureCount() const
+{
+    return mCRCFailures;
+}
+
+void Driver::armWatchdog()
+{
+    if (mWatchdogFD == -1)
+        return;
+
+    base::Time timeout = mSetpointTimeouts[mRequestedConfiguration.control_mode];
+    itimerspec spec = {};
+    spec.it_value.tv_sec  = timeout.toMicroseconds() / 1000000;
+    spec.it_value.tv_nsec = (timeout.toMicroseconds() % 1000000) * 1000;
+    timerfd_settime(mWatchdogFD, 0, &spec, nullptr);
+}
+
+bool Driver::processWatchdog()
+{
+    uint64_t expirations;
+    if (mWatchdogFD == -1 ||
+        ::read(mWatchdogFD, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return false;
+
+    // The timer is re-armed on every setpoint and change of control mode,
+    // an expiration means that the current setpoint is stale
+    if (mRequestedConfiguration.control_mode == RequestedConfiguration::STOP)
+        return false;
+
+    mRequestedConfiguration.time = base::Time::now();
+    mRequestedConfiguration.command_id = ID_STOP;
+    mRequestedConfiguration.control_mode = RequestedConfiguration::STOP;
+    mRequestedConfigurationHistory.push(mRequestedConfiguration);
+    ++mWatchdogStopCount;
+    INDRA_HEADS_TRACE(watchdog_stop, mWatchdogStopCount);
+    return true;
+}
+
+void Driver::setupLowLatencySerial(MessageTypes expected_message)
+{
+    int fd = getFileDescriptor();
+    termios tio;
+    if (tcgetattr(fd, &tio) != 0)
+        throw iodrivers_base::UnixError("failed to get the serial port attributes");
+
+    if (expected_message == MSG_RESPONSE)
+        tio.c_cc[VMIN] = packets::getPacketSize(ID_STOP, MSG_RESPONSE) + sizeof(crc_t);
+    else
+        tio.c_cc[VMIN] = MIN_PACKET_SIZE;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio) != 0)
+        throw iodrivers_base::UnixError("failed to set the serial port attributes");
+
+#if defined(TIOCGSERIAL) && defined(ASYNC_LOW_LATENCY)
+    // Best effort, most USB adapters and ptys do not support it
+    serial_struct serial;
+    if (ioctl(fd, TIOCGSERIAL, &serial) == 0)
+    {
+        serial.flags |= ASYNC_LOW_LATENCY;
+        ioctl(fd, TIOCSSERIAL, &serial);
+    }
+#endif
+
+    tcflush(fd, TCIFLUSH);
+    clear();
+}
+
+void Driver::setupRealTime(RealTimeConfiguration const& config)
+{
+    realtime::setupCurrentThread(config);
+    std::memset(mReadBuffer.data(), 0, mReadBuffer.size());
+    std::memset(mWriteBuffer.data(), 0, mWriteBuffer.size());
+}
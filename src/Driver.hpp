@@ -4,14 +4,91 @@
 #include <iodrivers_base/Driver.hpp>
 #include <indra_heads_protocol/RequestedConfiguration.hpp>
 #include <indra_heads_protocol/Response.hpp>
+#include <indra_heads_protocol/PacketParser.hpp>
+#include <indra_heads_protocol/RealTime.hpp>
+#include <indra_heads_protocol/ConfigurationHistory.hpp>
+#include <indra_heads_protocol/RoundTripEstimator.hpp>
+#include <indra_heads_protocol/Bundle.hpp>
 
 namespace indra_heads_protocol
 {
     class Driver : public iodrivers_base::Driver
     {
         std::vector<uint8_t> mWriteBuffer;
+        std::vector<uint8_t> mResponseBuffer;
         std::vector<uint8_t> mReadBuffer;
         RequestedConfiguration mRequestedConfiguration;
+        ConfigurationHistory mRequestedConfigurationHistory;
+        /** Framing state, kept across extractPacket calls so that partial
+         * packets are not re-validated from scratch on every new chunk
+         */
+        mutable PacketParser mParser;
+        /** Set while readPacket runs. extractPacket only traces rejections
+         * then, as the bytes hasPacket looks at are looked at again by the
+         * next readPacket
+         */
+        bool mReadingPacket;
+        mutable uint64_t mCRCFailures;
+        /** Bytes left in the last packet that was rejected as a whole.
+         * iodrivers_base resynchronizes one byte at a time, so these get
+         * framed again; the rejections they lead to are not CRC failures
+         * of their own
+         */
+        mutable size_t mRejectedBytesLeft;
+        int tracePacketFramed(uint8_t const* buffer, int size);
+
+        /** A framed request waiting in the outgoing queue */
+        struct QueuedRequest
+        {
+            CommandIDs command_id;
+            uint8_t size;
+            uint8_t data[indra_heads_protocol::MAX_PACKET_SIZE];
+        };
+        /** Preallocated ring buffer of requests waiting to be written */
+        std::vector<QueuedRequest> mRequestQueue;
+        size_t mRequestQueueHead;
+        size_t mRequestQueueSize;
+
+        QueuedRequest* pushQueuedRequest();
+        void writeRequest(uint8_t const* buffer, size_t size);
+
+        /** Stale setpoint watchdog, see setSetpointTimeout */
+        int mWatchdogFD;
+        std::vector<base::Time> mSetpointTimeouts;
+        uint64_t mWatchdogStopCount;
+        void armWatchdog();
+
+        /** Adaptive response timeouts, see transact */
+        RoundTripEstimator mRoundTrip;
+        int mRetransmitCount;
+        uint64_t mRetransmissions;
+        bool waitTransactionResponse(CommandIDs command_id, base::Time const& sent,
+                                     bool sample, Response& response);
+        Response transactPacket(uint8_t const* packet, size_t size, bool idempotent);
+
+        /** Features of the head, as returned by negotiateFeatures */
+        uint8_t mPeerFeatures;
+
+        /** Parts of the configuration replayed by restoreConfiguration, in
+         * replay order
+         */
+        enum AcknowledgedParts
+        {
+            ACKNOWLEDGED_RATE_PT,
+            ACKNOWLEDGED_RATE_IMU,
+            ACKNOWLEDGED_CONTROL,
+            ACKNOWLEDGED_PART_COUNT
+        };
+        /** Last request the head acknowledged for each part, as framed on
+         * the wire. An empty request means nothing was acknowledged yet
+         */
+        struct AcknowledgedRequest
+        {
+            uint8_t size;
+            uint8_t data[indra_heads_protocol::MAX_PACKET_SIZE];
+        };
+        AcknowledgedRequest mAcknowledged[ACKNOWLEDGED_PART_COUNT];
+        void acknowledgePacket(uint8_t const* packet, size_t size);
 
     protected:
         int extractPacket(uint8_t const* buffer, size_t buffer_size) const;
@@ -23,37 +100,431 @@ namespace indra_heads_protocol
         class InvalidState : public std::runtime_error { };
 
         Driver();
+        ~Driver();
+
+        /** Discard the buffered input, including the packet the framing was
+         * in the middle of
+         *
+         * This hides iodrivers_base::Driver::clear, which does not know about
+         * the framing state. Without it, a packet with the same header than
+         * the discarded one would be taken as its continuation.
+         */
+        void clear();
+
+        using iodrivers_base::Driver::readPacket;
+
+        /** Read a packet, see iodrivers_base::Driver::readPacket
+         *
+         * These hide iodrivers_base's to fire the framing tracepoints (see
+         * Tracing.hpp) once per packet. Firing them from extractPacket
+         * would trace the packets that hasPacket sees twice.
+         */
+        int readPacket(uint8_t* buffer, int buffer_size);
+        int readPacket(uint8_t* buffer, int buffer_size, base::Time const& packet_timeout);
+        int readPacket(uint8_t* buffer, int buffer_size, base::Time const& packet_timeout,
+                       base::Time const& first_byte_timeout);
 
         /** Write a request
          *
          * Build the request packet itself using the functions
          * in indra_heads_protocol::requests
+         *
+         * The packet is framed in a preallocated buffer, this does not
+         * allocate
          */
         template<typename T>
         void sendRequest(T const& packet)
         {
-            mWriteBuffer = requests::packetize(packet);
-            writePacket(mWriteBuffer.data(), mWriteBuffer.size());
+            static_assert(sizeof(T) + sizeof(crc_t) <= indra_heads_protocol::MAX_PACKET_SIZE,
+                          "packet larger than MAX_PACKET_SIZE");
+            requests::packetize(mWriteBuffer.data(), packet);
+            writeRequest(mWriteBuffer.data(), sizeof(T) + sizeof(crc_t));
+        }
+
+        /** Write a request that has been framed at compile time
+         *
+         * See indra_heads_protocol::framed. The bytes are written as-is
+         */
+        template<size_t N>
+        void sendRequest(framed::Packet<N> const& packet)
+        {
+            static_assert(N <= indra_heads_protocol::MAX_PACKET_SIZE,
+                          "packet larger than MAX_PACKET_SIZE");
+            writeRequest(packet.data, N);
+        }
+
+        /** Queue a request, to be written later by writeQueuedRequests
+         *
+         * @return false if the queue is full, in which case the request is
+         *   not queued
+         */
+        template<typename T>
+        bool queueRequest(T const& packet)
+        {
+            static_assert(sizeof(T) + sizeof(crc_t) <= indra_heads_protocol::MAX_PACKET_SIZE,
+                          "packet larger than MAX_PACKET_SIZE");
+            QueuedRequest* request = pushQueuedRequest();
+            if (!request)
+                return false;
+            request->command_id = static_cast<CommandIDs>(packet.command_id);
+            request->size = sizeof(T) + sizeof(crc_t);
+            requests::packetize(request->data, packet);
+            return true;
+        }
+
+        /** Queue a request that has been framed at compile time */
+        template<size_t N>
+        bool queueRequest(framed::Packet<N> const& packet)
+        {
+            static_assert(N <= indra_heads_protocol::MAX_PACKET_SIZE,
+                          "packet larger than MAX_PACKET_SIZE");
+            QueuedRequest* request = pushQueuedRequest();
+            if (!request)
+                return false;
+            request->command_id = packet.command_id();
+            request->size = N;
+            std::memcpy(request->data, packet.data, N);
+            return true;
+        }
+
+        /** Write at most max_count requests from the outgoing queue
+         *
+         * @return the number of requests written
+         */
+        size_t writeQueuedRequests(size_t max_count);
+
+        /** Write all the requests from the outgoing queue
+         *
+         * @return the number of requests written
+         */
+        size_t writeQueuedRequests();
+
+        /** Number of requests waiting in the outgoing queue */
+        size_t getQueuedRequestCount() const;
+
+        /** Change the capacity of the outgoing queue
+         *
+         * The queue is preallocated. This drops the requests that are
+         * currently queued.
+         */
+        void setRequestQueueCapacity(size_t capacity);
+
+        /** Remove the setpoints (angles, angular velocities and stabilization
+         * targets) from the outgoing queue
+         *
+         * @return the number of requests removed
+         */
+        size_t cancelQueuedSetpoints();
+
+        /** Write a STOP or BITE request, bypassing the outgoing queue
+         *
+         * The setpoints that are waiting in the queue are cancelled, since
+         * they would override the STOP or BITE once written. Requests that
+         * do not control the motion (status refresh rates) stay queued.
+         *
+         * @throw std::invalid_argument if the packet is neither a STOP nor a
+         *   BITE
+         */
+        template<typename T>
+        void sendPriorityRequest(T const& packet)
+        {
+            if (packet.command_id != ID_STOP && packet.command_id != ID_BITE)
+                throw std::invalid_argument("only STOP and BITE can be sent as priority requests");
+            cancelQueuedSetpoints();
+            sendRequest(packet);
+        }
+
+        /** Write a STOP or BITE request framed at compile time, e.g.
+         * framed::STOP, bypassing the outgoing queue
+         *
+         * Unlike the generic version, this does not encode anything
+         */
+        template<size_t N>
+        void sendPriorityRequest(framed::Packet<N> const& packet)
+        {
+            if (packet.command_id() != ID_STOP && packet.command_id() != ID_BITE)
+                throw std::invalid_argument("only STOP and BITE can be sent as priority requests");
+            cancelQueuedSetpoints();
+            sendRequest(packet);
+        }
+
+        /** Send a request and wait for its response
+         *
+         * The response timeout is derived from the round-trip times measured
+         * on the previous transactions (see getRoundTripEstimator). Responses
+         * to other commands are discarded while waiting.
+         *
+         * Idempotent requests (see packets::isIdempotent) are retransmitted
+         * on timeout, up to the count set with setRetransmitCount.
+         *
+         * @throw iodrivers_base::TimeoutError if no response arrived after
+         *   the last retransmission
+         */
+        template<typename T>
+        Response transact(T const& packet)
+        {
+            static_assert(sizeof(T) + sizeof(crc_t) <= indra_heads_protocol::MAX_PACKET_SIZE,
+                          "packet larger than MAX_PACKET_SIZE");
+            uint8_t buffer[sizeof(T) + sizeof(crc_t)];
+            requests::packetize(buffer, packet);
+            return transactPacket(buffer, sizeof(buffer),
+                packets::isIdempotent(static_cast<CommandIDs>(packet.command_id)));
+        }
+
+        /** Send a bundle of requests and wait for its aggregated response
+         *
+         * If the head advertised FEATURE_BUNDLE in negotiateFeatures, this
+         * is a single transaction. Otherwise, the commands are sent as
+         * separate transactions, in order, stopping at the first one that
+         * does not succeed. The returned response is for ID_BUNDLE in both
+         * cases, with the status of that first failure or STATUS_OK.
+         *
+         * @throw iodrivers_base::TimeoutError as transact
+         */
+        Response transact(Bundle const& bundle);
+
+        /** Write a bundle of requests
+         *
+         * Only send bundles to heads that support them, see
+         * negotiateFeatures
+         */
+        void sendRequest(Bundle const& bundle);
+
+        /** Ask the head which protocol extensions it supports
+         *
+         * Heads that predate the extensions do not answer, which is
+         * interpreted as no extensions. This waits for the response timeout
+         * of transact(), so negotiate once per connection.
+         *
+         * @return the bitfield of Features values, also available through
+         *   getPeerFeatures
+         */
+        uint8_t negotiateFeatures();
+
+        /** The features returned by the last negotiateFeatures, zero if it
+         * was never called
+         */
+        uint8_t getPeerFeatures() const;
+
+        /** Record that the head accepted a request (STATUS_OK)
+         *
+         * The last accepted status refresh rates and control request make
+         * the configuration that restoreConfiguration replays. transact
+         * records them already, call this only when matching the responses
+         * by other means
+         */
+        template<typename T>
+        void acknowledgeRequest(T const& packet)
+        {
+            static_assert(sizeof(T) + sizeof(crc_t) <= indra_heads_protocol::MAX_PACKET_SIZE,
+                          "packet larger than MAX_PACKET_SIZE");
+            uint8_t buffer[sizeof(T) + sizeof(crc_t)];
+            requests::packetize(buffer, packet);
+            acknowledgePacket(buffer, sizeof(buffer));
+        }
+
+        /** Record that the head accepted a request framed at compile time */
+        template<size_t N>
+        void acknowledgeRequest(framed::Packet<N> const& packet)
+        {
+            acknowledgePacket(packet.data, N);
         }
 
+        /** Record that the head accepted all the commands of a bundle */
+        void acknowledgeRequest(Bundle const& bundle);
+
+        /** The configuration made of the acknowledged requests
+         *
+         * Parts that were never acknowledged keep the defaults of
+         * RequestedConfiguration
+         */
+        RequestedConfiguration getAcknowledgedConfiguration() const;
+
+        /** How many requests restoreConfiguration would write, at most
+         * three
+         */
+        size_t getAcknowledgedRequestCount() const;
+
+        /** Forget the acknowledged configuration, e.g. when connecting to
+         * a different head
+         */
+        void clearAcknowledgedConfiguration();
+
+        /** Replay the acknowledged configuration after a reconnection
+         *
+         * The last acknowledged status refresh rates and control request
+         * (STOP, angles, angular velocities or stabilization target) are
+         * written back to back in a single write, and their responses are
+         * awaited together: the head is operational again after one round
+         * trip instead of one per request. A self-test is not replayed.
+         *
+         * If some responses are missing, the requests are written again as
+         * transact does, as long as they all are idempotent.
+         *
+         * Reset the round-trip estimate before calling this if the new
+         * connection may be slower than the previous one.
+         *
+         * @return a response for ID_BUNDLE, with the status of the first
+         *   replayed request that did not succeed or STATUS_OK. Nothing is
+         *   written, and STATUS_OK returned, if nothing was acknowledged
+         * @throw iodrivers_base::TimeoutError if some responses are still
+         *   missing
+         */
+        Response restoreConfiguration();
+
+        /** How many times transact() retransmits idempotent requests on
+         * timeout. Zero (the default) disables retransmission.
+         */
+        void setRetransmitCount(int count);
+        int getRetransmitCount() const;
+
+        /** How many retransmissions transact() did so far */
+        uint64_t getRetransmissionCount() const;
+
+        /** The round-trip time estimate of this connection
+         *
+         * Reset it when reconnecting
+         */
+        RoundTripEstimator& getRoundTripEstimator();
+        RoundTripEstimator const& getRoundTripEstimator() const;
+
         /** Read a command and return which command was received
          *
          * This internally updates the requested configuration that can be
          * accessed with getRequestedCommand()
+         *
+         * ID_BUNDLE means that all the bundled commands have been applied to
+         * the requested configuration, in order. It gets a single response.
+         * ID_FEATURES leaves the configuration untouched and must be
+         * answered with writeFeatures.
          */
         CommandIDs readRequest();
 
+        /** Read a command within the given timeout and return which command
+         * was received
+         */
+        CommandIDs readRequest(base::Time const& timeout);
+
+        /** Update a requested configuration with a framed request packet
+         *
+         * This is the decoding part of readRequest. It does not update the
+         * configuration's time
+         */
+        static CommandIDs decodeRequest(uint8_t const* packet,
+                                        RequestedConfiguration& configuration);
+
         /** Send a response packet
          */
         void writeResponse(Response response);
 
+        /** Answer a requests::Features query
+         *
+         * @param features bitfield of the Features values this head
+         *   supports
+         */
+        void writeFeatures(uint8_t features);
+
+        /** Send several response packets in a single write
+         *
+         * The packets are framed back to back in a buffer that is kept
+         * between calls, so this only allocates when count grows
+         */
+        void writeResponses(Response const* responses, size_t count);
+
         /** Read a response packet and return the status
          */
         Response readResponse();
 
+        /** Read a response packet within the given timeout and return the
+         * status
+         */
+        Response readResponse(base::Time const& timeout);
+
         /** Returns the current requested configuration
          */
         RequestedConfiguration getRequestedConfiguration() const;
+
+        /** Returns the history of the requested configurations
+         *
+         * Each successful readRequest adds the updated configuration to it.
+         */
+        ConfigurationHistory const& getRequestedConfigurationHistory() const;
+
+        /** Change how many configurations are kept in the history
+         *
+         * The history is preallocated, and this clears it. Set to zero to
+         * disable it.
+         */
+        void setRequestedConfigurationHistoryCapacity(size_t capacity);
+
+        /** Set how long the given control mode can stay without a fresh
+         * setpoint
+         *
+         * This is meant for the head side. When no setpoint (angles,
+         * angular velocities or stabilization target) nor change of
+         * control mode arrived in readRequest within this time, the
+         * watchdog switches the requested configuration to STOP. Other
+         * requests, e.g. status refresh rates, do not keep a setpoint
+         * alive. A null timeout (the default) disables the watchdog for
+         * this mode.
+         *
+         * The watchdog is a timerfd. Add getWatchdogFileDescriptor() to
+         * the event loop that waits on the driver, and call processWatchdog()
+         * when it becomes readable.
+         */
+        void setSetpointTimeout(RequestedConfiguration::ControlModes mode,
+                                base::Time const& timeout);
+
+        /** The file descriptor of the watchdog timer, or -1 if no setpoint
+         * timeout has been set
+         */
+        int getWatchdogFileDescriptor() const;
+
+        /** Handle the expiration of the watchdog timer
+         *
+         * @return true if the requested configuration got switched to STOP.
+         *   The caller should then stop the head.
+         */
+        bool processWatchdog();
+
+        /** How many times the watchdog switched the configuration to STOP */
+        uint64_t getWatchdogStopCount() const;
+
+        /** How many packets readPacket rejected because of their CRC
+         *
+         * Unlike iodrivers_base's bad_rx, which counts bytes, this counts
+         * each rejected packet once. The rejections that come from
+         * resynchronizing within a rejected packet are not counted, and
+         * neither are the ones seen by hasPacket, which readPacket sees
+         * again.
+         */
+        uint64_t getCRCFailureCount() const;
+
+        /** Configure the driver's serial port for low latency
+         *
+         * It sets VMIN to the size of the smallest packet of the expected
+         * type (the response size on the client side, MIN_PACKET_SIZE on
+         * the head side) and VTIME to zero, so that the driver wakes up
+         * once per packet instead of on arbitrary byte counts. It also
+         * enables the kernel's low-latency flag if the port supports it,
+         * and discards any stale input.
+         *
+         * Call it after each (re)connection, e.g. after openURI. It throws
+         * iodrivers_base::UnixError if the stream is not a terminal
+         */
+        void setupLowLatencySerial(MessageTypes expected_message);
+
+        /** Switch to the real-time operating mode
+         *
+         * It must be called from the thread that will do the I/O, after the
+         * driver is opened. It applies the configuration to the calling
+         * thread and touches the driver's buffers so that they are resident
+         * when memory gets locked.
+         *
+         * Once in steady state, readRequest, readResponse, sendRequest and
+         * writeResponse do not allocate.
+         */
+        void setupRealTime(RealTimeConfiguration const& config);
     };
 }
 
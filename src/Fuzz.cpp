@@ -0,0 +1,479 @@
+/** Fuzzing of the framing and decoding paths
+ *
+ * Built with FUZZING=ON (clang only), this is a libFuzzer target. Built
+ * with INDRA_HEADS_FUZZ_REPLAY defined, it is indra_heads_protocol_fuzz_replay,
+ * which generates the seed corpus and replays a corpus, reporting the
+ * slowest inputs in bytes per second.
+ *
+ * The first byte of an input selects the size of the chunks in which the
+ * rest of it is delivered. Each input goes through:
+ *
+ * - PacketParser, fed in chunks the way iodrivers_base calls extractPacket
+ * - Driver::readPacket, followed by the decoding of readRequest and
+ *   readResponse
+ *
+ * and both must find the same packets than a stateless framing of the
+ * whole input. Any difference aborts.
+ *
+ * <code>
+ * indra_heads_protocol_fuzz_replay --seed corpus
+ * indra_heads_protocol_fuzz -max_len=512 corpus
+ * indra_heads_protocol_fuzz_replay --top 20 corpus
+ * </code>
+ */
+
+#include <indra_heads_protocol/Bundle.hpp>
+#include <indra_heads_protocol/Driver.hpp>
+#include <indra_heads_protocol/PacketParser.hpp>
+#include <iodrivers_base/TestStream.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+typedef std::vector<std::pair<size_t, size_t>> PacketList;
+
+static void fail(char const* what, PacketList const& expected, PacketList const& actual)
+{
+    fprintf(stderr, "%s: expected %zu packets, got %zu\n",
+            what, expected.size(), actual.size());
+    for (size_t i = 0; i < std::min(expected.size(), actual.size()); ++i)
+    {
+        if (expected[i] != actual[i])
+        {
+            fprintf(stderr, "  first difference at packet %zu: expected %zu bytes at %zu, got %zu bytes at %zu\n",
+                    i, expected[i].second, expected[i].first,
+                    actual[i].second, actual[i].first);
+            break;
+        }
+    }
+    abort();
+}
+
+/** Stateless framing, which re-validates the whole buffer on each call */
+static int referenceExtract(uint8_t const* buffer, size_t buffer_size)
+{
+    if (buffer_size == 0)
+        return 0;
+    else if (!packets::isValidCommandID(buffer[0]))
+        return -1;
+    else if (buffer_size < 2)
+        return 0;
+    else if (buffer[1] > MSG_LAST_TYPE)
+        return -1;
+
+    bool bundle = buffer[0] == ID_BUNDLE && buffer[1] == MSG_REQUEST;
+    size_t packet_size;
+    if (bundle)
+    {
+        if (buffer_size < BUNDLE_HEADER_SIZE)
+            return 0;
+        else if (buffer[2] == 0 || buffer[2] > MAX_BUNDLE_PAYLOAD)
+            return -1;
+        packet_size = BUNDLE_HEADER_SIZE + buffer[2];
+    }
+    else
+    {
+        packet_size = packets::getPacketSize(
+            static_cast<CommandIDs>(buffer[0]),
+            static_cast<MessageTypes>(buffer[1]));
+    }
+    size_t expected_size = packet_size + sizeof(crc_t);
+    if (buffer_size < expected_size)
+        return 0;
+
+    crc_t expected_crc = *reinterpret_cast<crc_t const*>(buffer + packet_size);
+    if (details::compute_crc(buffer, packet_size) != expected_crc)
+        return -1;
+    else if (bundle && !bundles::isValidPayload(buffer + BUNDLE_HEADER_SIZE, buffer[2]))
+        return -1;
+    return expected_size;
+}
+
+static PacketList frameReference(uint8_t const* stream, size_t size)
+{
+    PacketList result;
+    size_t start = 0;
+    while (start < size)
+    {
+        int r = referenceExtract(stream + start, size - start);
+        if (r == 0)
+            break;
+        else if (r < 0)
+            start += -r;
+        else
+        {
+            result.push_back(std::make_pair(start, static_cast<size_t>(r)));
+            start += r;
+        }
+    }
+    return result;
+}
+
+static PacketList frameInChunks(uint8_t const* stream, size_t size, size_t chunk_size)
+{
+    PacketList result;
+    PacketParser parser;
+    std::vector<uint8_t> buffer(MAX_PACKET_SIZE + chunk_size);
+    size_t buffer_size = 0;
+    // Position of buffer[0] in the stream
+    size_t offset = 0;
+    for (size_t i = 0; i < size; i += chunk_size)
+    {
+        size_t chunk = std::min(chunk_size, size - i);
+        std::memcpy(buffer.data() + buffer_size, stream + i, chunk);
+        buffer_size += chunk;
+
+        size_t start = 0;
+        while (start < buffer_size)
+        {
+            int r = parser.extract(buffer.data() + start, buffer_size - start);
+            if (r == 0)
+                break;
+            else if (r < 0)
+                start += -r;
+            else
+            {
+                result.push_back(std::make_pair(offset + start, static_cast<size_t>(r)));
+                start += r;
+            }
+        }
+        std::memmove(buffer.data(), buffer.data() + start, buffer_size - start);
+        buffer_size -= start;
+        offset += start;
+        if (buffer_size > MAX_PACKET_SIZE)
+        {
+            fprintf(stderr, "PacketParser kept %zu bytes, more than a packet\n", buffer_size);
+            abort();
+        }
+    }
+    return result;
+}
+
+/** Read all the packets from the stream through Driver, decoding them as
+ * readRequest and readResponse do
+ *
+ * @return the sizes of the packets that have been read
+ */
+static std::vector<size_t> readWithDriver(uint8_t const* stream, size_t size)
+{
+    // The driver is reused across inputs, as a long-running process would,
+    // so that state leaking through clear() shows up as well
+    static Driver driver;
+    if (!driver.isValid())
+        driver.openURI("test://");
+    driver.clear();
+
+    iodrivers_base::TestStream* test_stream =
+        dynamic_cast<iodrivers_base::TestStream*>(driver.getMainStream());
+    test_stream->pushDataToDevice(std::vector<uint8_t>(stream, stream + size));
+
+    std::vector<size_t> result;
+    uint8_t packet[MAX_PACKET_SIZE];
+    RequestedConfiguration configuration;
+    while (true)
+    {
+        int packet_size;
+        try {
+            packet_size = driver.readPacket(packet, MAX_PACKET_SIZE, base::Time());
+        }
+        catch(iodrivers_base::TimeoutError&) {
+            break;
+        }
+        result.push_back(packet_size);
+
+        if (packet[1] == MSG_RESPONSE)
+            reply::parse(reinterpret_cast<packets::Response const&>(packet[0]));
+        else
+            Driver::decodeRequest(packet, configuration);
+    }
+    return result;
+}
+
+/** Run a fuzzer input through the framing and decoding paths
+ *
+ * @return the number of packets found
+ */
+static size_t processInput(uint8_t const* data, size_t size)
+{
+    if (size == 0)
+        return 0;
+
+    size_t chunk_size = data[0] % 32 + 1;
+    uint8_t const* stream = data + 1;
+    size -= 1;
+
+    PacketList expected = frameReference(stream, size);
+    PacketList chunked = frameInChunks(stream, size, chunk_size);
+    if (chunked != expected)
+        fail("PacketParser", expected, chunked);
+
+    std::vector<size_t> read = readWithDriver(stream, size);
+    PacketList read_sizes;
+    for (size_t s : read)
+        read_sizes.push_back(std::make_pair(0, s));
+    PacketList expected_sizes;
+    for (auto const& p : expected)
+        expected_sizes.push_back(std::make_pair(0, p.second));
+    if (read_sizes != expected_sizes)
+        fail("Driver::readPacket", expected_sizes, read_sizes);
+    return expected.size();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size)
+{
+    processInput(data, size);
+    return 0;
+}
+
+#ifdef INDRA_HEADS_FUZZ_REPLAY
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <dirent.h>
+#include <sys/stat.h>
+
+void usage()
+{
+    std::cout
+        << "usage: indra_heads_protocol_fuzz_replay [--top N] [--min-size N] PATH...\n"
+        << "       indra_heads_protocol_fuzz_replay --seed DIR\n"
+        << "\n"
+        << "Runs the inputs of the fuzzing corpus (files, or directories of\n"
+        << "files) through the fuzz target, then replays the slowest ones and\n"
+        << "reports their throughput. A crash or a framing mismatch aborts.\n"
+        << "\n"
+        << "  --top N       number of slow inputs to report (default 10)\n"
+        << "  --min-size N  only rank inputs of at least N bytes, the smaller\n"
+        << "                ones are dominated by the per-input overhead\n"
+        << "                (default 64)\n"
+        << "  --seed DIR    write the seed corpus, built from packetize, in DIR\n"
+        << std::endl;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+struct Input
+{
+    std::string name;
+    std::vector<uint8_t> data;
+    double seconds_per_byte = 0;
+};
+
+void writeSeed(std::string const& dir, std::string const& name,
+               uint8_t chunk_selector, std::vector<uint8_t> const& stream)
+{
+    std::ofstream file(dir + "/" + name, std::ios::binary);
+    file.put(chunk_selector);
+    file.write(reinterpret_cast<char const*>(stream.data()), stream.size());
+    if (!file)
+        throw std::runtime_error("failed to write " + dir + "/" + name);
+}
+
+Bundle makeSeedBundle()
+{
+    Bundle bundle;
+    bundle.add(requests::AnglesGeo(0.1, 0.3, 0.2));
+    bundle.add(requests::PositionGeo(48.858370, -2.294481, 30));
+    bundle.add(requests::StatusRefreshRatePT(RATE_50HZ));
+    bundle.add(requests::Stop());
+    return bundle;
+}
+
+void writeSeedCorpus(std::string const& dir)
+{
+    mkdir(dir.c_str(), 0755);
+
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> packets = {
+        { "stop", requests::packetize(requests::Stop()) },
+        { "bite", requests::packetize(requests::BITE()) },
+        { "rate-pt", requests::packetize(requests::StatusRefreshRatePT(RATE_20HZ)) },
+        { "rate-imu", requests::packetize(requests::StatusRefreshRateIMU(RATE_10HZ)) },
+        { "angles-rel", requests::packetize(requests::AnglesRelative(0.1, 0.3, 0.2)) },
+        { "angles-geo", requests::packetize(requests::AnglesGeo(-0.1, 3, -2)) },
+        { "velocity-rel", requests::packetize(requests::AngularVelocityRelative(0.1, -0.2, 0.3)) },
+        { "velocity-geo", requests::packetize(requests::AngularVelocityGeo(-0.4, 0, 0.4)) },
+        { "target", requests::packetize(requests::PositionGeo(48.858370, -2.294481, -30)) },
+        { "response-ok", requests::packetize(reply::Response(ID_STOP, STATUS_OK)) },
+        { "response-failed", requests::packetize(reply::Response(ID_ANGLES_GEO, STATUS_FAILED)) },
+        { "features", requests::packetize(requests::Features()) },
+        { "features-response", requests::packetize(reply::Features(FEATURE_BUNDLE)) },
+        { "bundle", makeSeedBundle().packetize() }
+    };
+
+    std::vector<uint8_t> all;
+    for (auto const& p : packets)
+    {
+        writeSeed(dir, "seed-" + p.first, 31, p.second);
+        all.insert(all.end(), p.second.begin(), p.second.end());
+    }
+    for (uint8_t chunk : { 0, 2, 6, 31 })
+        writeSeed(dir, "seed-all-chunk" + std::to_string(chunk + 1), chunk, all);
+
+    // Resynchronization: a broken CRC, a truncated packet and garbage
+    // before valid packets
+    std::vector<uint8_t> bad_crc = packets[8].second;
+    bad_crc.back() ^= 0x5A;
+    bad_crc.insert(bad_crc.end(), all.begin(), all.end());
+    writeSeed(dir, "seed-bad-crc", 3, bad_crc);
+
+    std::vector<uint8_t> truncated(packets[4].second.begin(), packets[4].second.end() - 3);
+    truncated.insert(truncated.end(), all.begin(), all.end());
+    writeSeed(dir, "seed-truncated", 0, truncated);
+
+    std::vector<uint8_t> garbage = { 0xFF, 0x00, 0x05, 0x07, 0x02, 0x01, 0x08, 0x00 };
+    garbage.insert(garbage.end(), all.begin(), all.end());
+    writeSeed(dir, "seed-garbage", 4, garbage);
+
+    // Headers of the largest packet with a bad CRC, one after the other:
+    // the framing resynchronizes one byte at a time after having waited
+    // for a whole packet each time
+    std::vector<uint8_t> resync;
+    for (int i = 0; i < 256; ++i)
+    {
+        resync.push_back(ID_STABILIZATION_TARGET);
+        resync.push_back(MSG_REQUEST);
+    }
+    writeSeed(dir, "seed-resync", 0, resync);
+}
+
+void loadInputs(std::string const& path, std::vector<Input>& inputs)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        throw std::runtime_error("cannot access " + path);
+
+    if (S_ISDIR(info.st_mode))
+    {
+        DIR* dir = opendir(path.c_str());
+        if (!dir)
+            throw std::runtime_error("cannot open " + path);
+        std::vector<std::string> names;
+        while (dirent* entry = readdir(dir))
+        {
+            if (entry->d_name[0] != '.')
+                names.push_back(entry->d_name);
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+        for (auto const& name : names)
+            loadInputs(path + "/" + name, inputs);
+        return;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    Input input;
+    input.name = path;
+    input.data.assign(std::istreambuf_iterator<char>(file),
+                      std::istreambuf_iterator<char>());
+    inputs.push_back(input);
+}
+
+/** Replay the input until at least min_seconds have elapsed
+ *
+ * @return the time spent per byte
+ */
+double measure(Input const& input, double min_seconds)
+{
+    size_t bytes = std::max<size_t>(input.data.size(), 1);
+    size_t count = 0;
+    auto start = Clock::now();
+    double elapsed = 0;
+    do
+    {
+        processInput(input.data.data(), input.data.size());
+        ++count;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    while (elapsed < min_seconds);
+    return elapsed / (count * bytes);
+}
+
+int main(int argc, char** argv)
+{
+    size_t top = 10;
+    size_t min_size = 64;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help")
+        {
+            usage();
+            return 0;
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            writeSeedCorpus(argv[++i]);
+            return 0;
+        }
+        else if (arg == "--top" && i + 1 < argc)
+            top = std::stoul(argv[++i]);
+        else if (arg == "--min-size" && i + 1 < argc)
+            min_size = std::stoul(argv[++i]);
+        else
+            paths.push_back(arg);
+    }
+    if (paths.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    std::vector<Input> inputs;
+    for (auto const& path : paths)
+        loadInputs(path, inputs);
+
+    // First pass: quick timing of every input, which also checks them all
+    size_t total_bytes = 0;
+    double total_seconds = 0;
+    for (auto& input : inputs)
+    {
+        input.seconds_per_byte = measure(input, 0);
+        total_bytes += input.data.size();
+        total_seconds += input.seconds_per_byte * input.data.size();
+    }
+    std::cout << inputs.size() << " inputs, " << total_bytes << " bytes, "
+              << std::fixed << std::setprecision(2)
+              << total_bytes / total_seconds / 1e6 << " MB/s on a single pass"
+              << std::endl;
+
+    // Second pass: replay the slowest ones long enough for a stable figure
+    inputs.erase(std::remove_if(inputs.begin(), inputs.end(),
+                                [min_size](Input const& input) {
+                                    return input.data.size() < min_size;
+                                }),
+                 inputs.end());
+    std::sort(inputs.begin(), inputs.end(),
+              [](Input const& a, Input const& b) {
+                  return a.seconds_per_byte > b.seconds_per_byte;
+              });
+    inputs.resize(std::min(top, inputs.size()));
+    for (auto& input : inputs)
+        input.seconds_per_byte = measure(input, 0.1);
+    std::sort(inputs.begin(), inputs.end(),
+              [](Input const& a, Input const& b) {
+                  return a.seconds_per_byte > b.seconds_per_byte;
+              });
+
+    std::cout << "slowest inputs:" << std::endl;
+    for (auto const& input : inputs)
+    {
+        std::cout
+            << "  " << std::setw(10) << 1 / input.seconds_per_byte / 1e6 << " MB/s"
+            << std::setw(8) << input.data.size() << " bytes  "
+            << input.name << std::endl;
+    }
+    return 0;
+}
+
+#endif
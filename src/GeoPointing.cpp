@@ -0,0 +1,114 @@
+#include <indra_heads_protocol/GeoPointing.hpp>
+#include <Eigen/Geometry>
+#include <cmath>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+static const double WGS84_A = 6378137.0;
+static const double WGS84_F = 1 / 298.257223563;
+static const double WGS84_E2 = WGS84_F * (2 - WGS84_F);
+
+static double toRadians(double degrees)
+{
+    return degrees * M_PI / 180;
+}
+
+Eigen::Vector3d geodesy::toECEF(GeoTarget const& position)
+{
+    double lat = toRadians(position.latitude);
+    double lon = toRadians(position.longitude);
+    double sin_lat = std::sin(lat);
+    double cos_lat = std::cos(lat);
+    double n = WGS84_A / std::sqrt(1 - WGS84_E2 * sin_lat * sin_lat);
+    return Eigen::Vector3d(
+        (n + position.altitude) * cos_lat * std::cos(lon),
+        (n + position.altitude) * cos_lat * std::sin(lon),
+        (n * (1 - WGS84_E2) + position.altitude) * sin_lat);
+}
+
+Eigen::Matrix3d geodesy::ecefToENU(GeoTarget const& position)
+{
+    double lat = toRadians(position.latitude);
+    double lon = toRadians(position.longitude);
+    double sin_lat = std::sin(lat), cos_lat = std::cos(lat);
+    double sin_lon = std::sin(lon), cos_lon = std::cos(lon);
+
+    Eigen::Matrix3d result;
+    result <<
+        -sin_lon,            cos_lon,           0,
+        -sin_lat * cos_lon, -sin_lat * sin_lon, cos_lat,
+         cos_lat * cos_lon,  cos_lat * sin_lon, sin_lat;
+    return result;
+}
+
+static Eigen::Matrix3d ecefToBody(GeoTarget const& platform_position,
+                                  Eigen::Vector3d const& platform_rpy)
+{
+    Eigen::Matrix3d body2enu =
+        (Eigen::AngleAxisd(platform_rpy.z(), Eigen::Vector3d::UnitZ()) *
+         Eigen::AngleAxisd(platform_rpy.y(), Eigen::Vector3d::UnitY()) *
+         Eigen::AngleAxisd(platform_rpy.x(), Eigen::Vector3d::UnitX())).toRotationMatrix();
+    return body2enu.transpose() * geodesy::ecefToENU(platform_position);
+}
+
+void GeoPointing::setTargets(std::vector<GeoTarget> const& targets)
+{
+    mTargets.resize(3, targets.size());
+    for (size_t i = 0; i < targets.size(); ++i)
+        mTargets.col(i) = geodesy::toECEF(targets[i]);
+    mDirections.resize(3, targets.size());
+    mYaw.resize(targets.size());
+    mPitch.resize(targets.size());
+}
+
+size_t GeoPointing::getTargetCount() const
+{
+    return mTargets.cols();
+}
+
+void GeoPointing::update(GeoTarget const& platform_position,
+                         Eigen::Vector3d const& platform_rpy)
+{
+    Eigen::Matrix3d rotation = ecefToBody(platform_position, platform_rpy);
+    Eigen::Vector3d origin = geodesy::toECEF(platform_position);
+
+    // rotation * (targets - origin), without the 3xN temporary that the
+    // subtraction would allocate
+    mDirections.noalias() = rotation * mTargets;
+    mDirections.colwise() -= rotation * origin;
+    for (long i = 0; i < mDirections.cols(); ++i)
+    {
+        double x = mDirections(0, i);
+        double y = mDirections(1, i);
+        double z = mDirections(2, i);
+        mYaw[i] = std::atan2(y, x);
+        mPitch[i] = std::atan2(-z, std::sqrt(x * x + y * y));
+    }
+}
+
+Eigen::ArrayXd const& GeoPointing::getYaw() const
+{
+    return mYaw;
+}
+
+Eigen::ArrayXd const& GeoPointing::getPitch() const
+{
+    return mPitch;
+}
+
+Eigen::ArrayXd GeoPointing::getRange() const
+{
+    return mDirections.colwise().norm().transpose().array();
+}
+
+Eigen::Vector2d GeoPointing::solve(GeoTarget const& platform_position,
+                                   Eigen::Vector3d const& platform_rpy,
+                                   GeoTarget const& target)
+{
+    Eigen::Vector3d direction = ecefToBody(platform_position, platform_rpy) *
+        (geodesy::toECEF(target) - geodesy::toECEF(platform_position));
+    return Eigen::Vector2d(
+        std::atan2(direction.y(), direction.x()),
+        std::atan2(-direction.z(), direction.head<2>().norm()));
+}
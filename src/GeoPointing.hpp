@@ -0,0 +1,76 @@
+#ifndef INDRA_HEADS_GEO_POINTING_HPP
+#define INDRA_HEADS_GEO_POINTING_HPP
+
+#include <indra_heads_protocol/Protocol.hpp>
+#include <Eigen/Core>
+#include <vector>
+
+namespace indra_heads_protocol
+{
+    /** WGS84 geodesy helpers
+     *
+     * Latitudes and longitudes are in degrees and altitudes in meters above
+     * the ellipsoid, as in GeoTarget
+     */
+    namespace geodesy
+    {
+        /** Earth-centered, earth-fixed coordinates of a geodetic position */
+        Eigen::Vector3d toECEF(GeoTarget const& position);
+
+        /** Rotation from ECEF to the local east-north-up frame at the given
+         * geodetic position
+         */
+        Eigen::Matrix3d ecefToENU(GeoTarget const& position);
+    }
+
+    /** Computes the yaw and pitch that point the head towards geodetic
+     * targets
+     *
+     * The platform pose is its geodetic position and its attitude as
+     * roll/pitch/yaw in the local east-north-up frame, i.e. the body-to-ENU
+     * rotation is Rz(yaw) * Ry(pitch) * Rx(roll). The resulting angles are
+     * in the head (platform body) frame, in the same convention: pointing
+     * along Rz(yaw) * Ry(pitch) * X, so that a positive pitch points
+     * downwards.
+     *
+     * Targets are converted to ECEF once in setTargets. Each update() then
+     * costs one 3xN matrix product and the final atan2s, which is what makes
+     * the streaming use - fixed targets, moving platform, one update per
+     * status message - cheap. Once the target count is stable, update()
+     * does not allocate.
+     */
+    class GeoPointing
+    {
+        Eigen::Matrix3Xd mTargets;
+        Eigen::Matrix3Xd mDirections;
+        Eigen::ArrayXd mYaw;
+        Eigen::ArrayXd mPitch;
+
+    public:
+        void setTargets(std::vector<GeoTarget> const& targets);
+        size_t getTargetCount() const;
+
+        /** Recompute the pointing angles of all targets for a new platform
+         * pose
+         */
+        void update(GeoTarget const& platform_position,
+                    Eigen::Vector3d const& platform_rpy);
+
+        /** Yaw of each target, in the order given to setTargets */
+        Eigen::ArrayXd const& getYaw() const;
+        /** Pitch of each target, in the order given to setTargets */
+        Eigen::ArrayXd const& getPitch() const;
+
+        /** Distance from the platform to each target */
+        Eigen::ArrayXd getRange() const;
+
+        /** One-shot pointing angles of a single target, as
+         * Vector2d(yaw, pitch)
+         */
+        static Eigen::Vector2d solve(GeoTarget const& platform_position,
+                                     Eigen::Vector3d const& platform_rpy,
+                                     GeoTarget const& target);
+    };
+}
+
+#endif
@@ -0,0 +1,348 @@
+#include <indra_heads_protocol/Driver.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+void usage()
+{
+    std::cout
+        << "usage: indra_heads_protocol_loadgen [OPTIONS] URI\n"
+        << "\n"
+        << "Opens connections to a head (or to indra_heads_protocol_sim) and\n"
+        << "drives a mix of requests, waiting for each response before sending\n"
+        << "the next request on the same connection. URI is an iodrivers_base\n"
+        << "URI, e.g. tcp://localhost:17001 or serial:///dev/ttyS0:115200\n"
+        << "\n"
+        << "Options:\n"
+        << "  --connections N   number of connections to open (default 1)\n"
+        << "  --rate HZ         requests per second on each connection, 0 for\n"
+        << "                    as fast as possible (default 0). With a rate,\n"
+        << "                    latencies count from when each request was due\n"
+        << "  --duration S      duration of the test in seconds (default 10)\n"
+        << "  --timeout MS      response timeout in milliseconds (default 1000)\n"
+        << "  --mix MIX         comma-separated list of COMMAND:WEIGHT\n"
+        << "                    (default angles-vel-geo:1)\n"
+        << "  --low-latency     configure serial ports for low latency\n"
+        << "  --adaptive        derive the response timeout from the measured\n"
+        << "                    round-trip time instead of using --timeout\n"
+        << "\n"
+        << "Commands: stop, self-test, rate-pt, rate-imu, angles-pos-geo,\n"
+        << "angles-pos-rel, angles-vel-geo, angles-vel-rel, target\n"
+        << std::endl;
+}
+
+static const int COMMAND_COUNT = ID_LAST + 1;
+
+static const char* COMMAND_NAMES[COMMAND_COUNT] = {
+    "stop", "self-test", "rate-pt", "rate-imu",
+    "angles-pos-rel", "angles-pos-geo", "angles-vel-rel", "angles-vel-geo",
+    "target"
+};
+
+CommandIDs command_from_arg(std::string const& arg)
+{
+    for (int i = 0; i < COMMAND_COUNT; ++i)
+    {
+        if (arg == COMMAND_NAMES[i])
+            return static_cast<CommandIDs>(i);
+    }
+    throw std::invalid_argument("unknown command " + arg);
+}
+
+struct LoadConfiguration
+{
+    std::string uri;
+    int connections = 1;
+    double rate = 0;
+    double duration = 10;
+    double timeout_ms = 1000;
+    bool low_latency = false;
+    bool adaptive = false;
+    std::vector<double> weights = std::vector<double>(COMMAND_COUNT, 0);
+};
+
+std::vector<double> parse_mix(std::string const& mix)
+{
+    std::vector<double> weights(COMMAND_COUNT, 0);
+    std::istringstream stream(mix);
+    std::string entry;
+    while (std::getline(stream, entry, ','))
+    {
+        size_t colon = entry.find(':');
+        if (colon == std::string::npos)
+            weights[command_from_arg(entry)] = 1;
+        else
+            weights[command_from_arg(entry.substr(0, colon))] = std::stod(entry.substr(colon + 1));
+    }
+    return weights;
+}
+
+struct ConnectionStats
+{
+    std::vector<std::vector<uint32_t>> latencies_us =
+        std::vector<std::vector<uint32_t>>(COMMAND_COUNT);
+    std::vector<uint64_t> timeouts = std::vector<uint64_t>(COMMAND_COUNT, 0);
+    std::vector<uint64_t> failures = std::vector<uint64_t>(COMMAND_COUNT, 0);
+    /** Response packets rejected because of their CRC */
+    uint64_t crc_failures = 0;
+    /** The adaptive response timeout at the end of the run */
+    base::Time final_timeout;
+    std::string error;
+};
+
+template<typename RNG>
+void sendRandomRequest(Driver& driver, CommandIDs command_id, RNG& rng)
+{
+    std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+    std::uniform_real_distribution<double> velocity(-0.5, 0.5);
+    switch(command_id)
+    {
+        case ID_STOP:
+            driver.sendRequest(requests::Stop());
+            break;
+        case ID_BITE:
+            driver.sendRequest(requests::BITE());
+            break;
+        case ID_STATUS_REFRESH_RATE_PT:
+            driver.sendRequest(requests::StatusRefreshRatePT(RATE_50HZ));
+            break;
+        case ID_STATUS_REFRESH_RATE_IMU:
+            driver.sendRequest(requests::StatusRefreshRateIMU(RATE_50HZ));
+            break;
+        case ID_ANGLES_RELATIVE:
+            driver.sendRequest(requests::AnglesRelative(angle(rng), angle(rng), angle(rng)));
+            break;
+        case ID_ANGLES_GEO:
+            driver.sendRequest(requests::AnglesGeo(angle(rng), angle(rng), angle(rng)));
+            break;
+        case ID_ANGULAR_VELOCITY_RELATIVE:
+            driver.sendRequest(requests::AngularVelocityRelative(
+                velocity(rng), velocity(rng), velocity(rng)));
+            break;
+        case ID_ANGULAR_VELOCITY_GEO:
+            driver.sendRequest(requests::AngularVelocityGeo(
+                velocity(rng), velocity(rng), velocity(rng)));
+            break;
+        case ID_STABILIZATION_TARGET:
+            driver.sendRequest(requests::PositionGeo(
+                angle(rng) * 90 / M_PI, angle(rng) * 180 / M_PI, 100));
+            break;
+        // parse_mix only accepts the base protocol commands
+        case ID_FEATURES:
+        case ID_BUNDLE:
+            throw std::invalid_argument("cannot generate extension requests");
+    }
+}
+
+void runConnection(int index, LoadConfiguration const& conf, ConnectionStats& stats)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Driver driver;
+    try {
+        driver.openURI(conf.uri);
+        if (conf.low_latency)
+            driver.setupLowLatencySerial(MSG_RESPONSE);
+    }
+    catch(std::exception& e) {
+        stats.error = e.what();
+        return;
+    }
+    base::Time timeout = base::Time::fromMilliseconds(conf.timeout_ms);
+    RoundTripEstimator& round_trip = driver.getRoundTripEstimator();
+
+    std::mt19937 rng(index);
+    std::discrete_distribution<int> pick(conf.weights.begin(), conf.weights.end());
+
+    auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(conf.duration));
+    auto period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(conf.rate > 0 ? 1 / conf.rate : 0));
+    auto next = Clock::now();
+    try {
+        while (Clock::now() < end)
+        {
+            // With --rate, latencies are measured from the time the request
+            // was due, not from the time it left. When the head falls
+            // behind, the requests leave late and that wait is part of
+            // what the control host sees
+            auto scheduled = Clock::now();
+            if (conf.rate > 0)
+            {
+                std::this_thread::sleep_until(next);
+                scheduled = next;
+                next += period;
+            }
+
+            CommandIDs command_id = static_cast<CommandIDs>(pick(rng));
+            if (conf.adaptive)
+                timeout = round_trip.getTimeout();
+            auto start = Clock::now();
+            sendRandomRequest(driver, command_id, rng);
+            try {
+                while (true)
+                {
+                    Response response = driver.readResponse(timeout);
+                    if (response.command_id != command_id)
+                        continue;
+
+                    auto now = Clock::now();
+                    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                        now - scheduled).count();
+                    stats.latencies_us[command_id].push_back(latency);
+                    // The timeouts only depend on the round-trip time
+                    auto round_trip_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        now - start).count();
+                    round_trip.addSample(base::Time::fromMicroseconds(round_trip_us));
+                    if (response.status != STATUS_OK)
+                        ++stats.failures[command_id];
+                    break;
+                }
+            }
+            catch(iodrivers_base::TimeoutError&) {
+                ++stats.timeouts[command_id];
+                round_trip.backoff();
+            }
+        }
+    }
+    catch(std::exception& e) {
+        stats.error = e.what();
+    }
+    stats.crc_failures = driver.getCRCFailureCount();
+    stats.final_timeout = round_trip.getTimeout();
+}
+
+double percentile(std::vector<uint32_t> const& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t index = std::ceil(p * sorted.size());
+    return sorted[std::max<size_t>(index, 1) - 1];
+}
+
+void report(LoadConfiguration const& conf, std::vector<ConnectionStats> const& stats)
+{
+    std::vector<std::vector<uint32_t>> latencies(COMMAND_COUNT);
+    std::vector<uint64_t> timeouts(COMMAND_COUNT, 0);
+    std::vector<uint64_t> failures(COMMAND_COUNT, 0);
+    uint64_t total = 0;
+    base::Time max_timeout;
+    for (auto const& s : stats)
+    {
+        if (!s.error.empty())
+            std::cout << "connection error: " << s.error << std::endl;
+        for (int i = 0; i < COMMAND_COUNT; ++i)
+        {
+            latencies[i].insert(latencies[i].end(),
+                s.latencies_us[i].begin(), s.latencies_us[i].end());
+            timeouts[i] += s.timeouts[i];
+            failures[i] += s.failures[i];
+            total += s.latencies_us[i].size();
+        }
+        max_timeout = std::max(max_timeout, s.final_timeout);
+    }
+
+    std::cout
+        << conf.connections << " connections, " << total << " responses in "
+        << conf.duration << "s: " << std::fixed << std::setprecision(1)
+        << total / conf.duration << " requests/s\n"
+        << "CRC failures per connection:";
+    for (auto const& s : stats)
+        std::cout << " " << s.crc_failures;
+    std::cout << "\n";
+    if (conf.rate > 0)
+        std::cout << "latencies are measured from the scheduled send time\n";
+    if (conf.adaptive)
+        std::cout << "largest adaptive timeout: " << max_timeout.toMilliseconds() << "ms\n";
+    std::cout << "\n"
+        << std::left << std::setw(16) << "command" << std::right
+        << std::setw(10) << "count"
+        << std::setw(10) << "timeouts"
+        << std::setw(10) << "failed"
+        << std::setw(12) << "p50(ms)"
+        << std::setw(12) << "p99(ms)"
+        << std::setw(12) << "p99.9(ms)"
+        << std::endl;
+
+    for (int i = 0; i < COMMAND_COUNT; ++i)
+    {
+        if (latencies[i].empty() && timeouts[i] == 0)
+            continue;
+
+        std::sort(latencies[i].begin(), latencies[i].end());
+        std::cout
+            << std::left << std::setw(16) << COMMAND_NAMES[i] << std::right
+            << std::setw(10) << latencies[i].size()
+            << std::setw(10) << timeouts[i]
+            << std::setw(10) << failures[i]
+            << std::setprecision(3)
+            << std::setw(12) << percentile(latencies[i], 0.5) / 1000
+            << std::setw(12) << percentile(latencies[i], 0.99) / 1000
+            << std::setw(12) << percentile(latencies[i], 0.999) / 1000
+            << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    LoadConfiguration conf;
+    conf.weights[ID_ANGULAR_VELOCITY_GEO] = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+        if (arg == "--help") {
+            usage();
+            return 0;
+        }
+        else if (arg == "--connections" && has_value) {
+            conf.connections = std::stol(argv[++i]);
+        }
+        else if (arg == "--rate" && has_value) {
+            conf.rate = std::stod(argv[++i]);
+        }
+        else if (arg == "--duration" && has_value) {
+            conf.duration = std::stod(argv[++i]);
+        }
+        else if (arg == "--timeout" && has_value) {
+            conf.timeout_ms = std::stod(argv[++i]);
+        }
+        else if (arg == "--mix" && has_value) {
+            conf.weights = parse_mix(argv[++i]);
+        }
+        else if (arg == "--low-latency") {
+            conf.low_latency = true;
+        }
+        else if (arg == "--adaptive") {
+            conf.adaptive = true;
+        }
+        else {
+            conf.uri = arg;
+        }
+    }
+    if (conf.uri.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    std::vector<ConnectionStats> stats(conf.connections);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < conf.connections; ++i)
+        threads.emplace_back(runConnection, i, std::cref(conf), std::ref(stats[i]));
+    for (auto& thread : threads)
+        thread.join();
+
+    report(conf, stats);
+    return 0;
+}
@@ -1,8 +1,19 @@
 #include <indra_heads_protocol/Driver.hpp>
 #include <iodrivers_base/IOStream.hpp>
+#include <algorithm>
+#include <cctype>
+#include <csignal>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <vector>
 #include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -12,7 +23,30 @@ using namespace indra_heads_protocol;
 void usage()
 {
     std::cout
-        << "usage: indra_heads_protocol_cmd PORT\n"
+        << "usage: indra_heads_protocol_cmd [OPTIONS] PORT\n"
+        << "\n"
+        << "Options:\n"
+        << "  --mlock              lock the process memory\n"
+        << "  --rt-cpu CPU         pin the I/O thread to the given CPU\n"
+        << "  --rt-priority PRIO   run the I/O thread with the given SCHED_FIFO priority\n"
+        << "  --retransmit N       retransmit angles, rates and targets up to N times\n"
+        << "                       when their response times out\n"
+        << "  --script FILE        replay FILE against the first head that connects,\n"
+        << "                       print a latency summary and exit\n"
+        << "  --fast               ignore the script times and send as fast as possible\n"
+        << "  --window N           maximum number of scripted requests waiting for a\n"
+        << "                       response (default 16)\n"
+        << "\n"
+        << "Each line of a script is TIME COMMAND [ARGS...], with TIME in seconds from\n"
+        << "the start of the replay and COMMAND one of the interactive commands below.\n"
+        << "Fields are separated by spaces or commas, so that CSV trajectories can be\n"
+        << "used directly. Lines starting with # and a CSV header are ignored.\n"
+        << "\n"
+        << "Response timeouts adapt to the round-trip time measured on the connection\n"
+        << "\n"
+        << "When a head reconnects, the status rates and control request it last\n"
+        << "acknowledged are sent again in a single burst, and the time it took to be\n"
+        << "operational again is reported\n"
         << std::endl;
 }
 
@@ -66,23 +100,106 @@ void verify_argc(int expected, int actual)
 
 static const int STATUS_TIMEOUT = 10;
 
-template<typename T>
-int request(Driver& driver, T const& packet)
+/** Wait for the response to the given command
+ *
+ * The deadline is derived from the round-trip time measured on the
+ * connection. Unless sample is false (retransmitted request), the round-trip
+ * time of this request is added to the estimate.
+ *
+ * While waiting, the operator can still type 'stop'. It is sent right away
+ * through the driver's priority path, and the wait switches to the response
+ * to the STOP, in which case command_id is changed to ID_STOP.
+ */
+int waitResponse(Driver& driver, CommandIDs& command_id, base::Time sent, bool sample)
 {
-    driver.sendRequest(packet);
+    RoundTripEstimator& round_trip = driver.getRoundTripEstimator();
+    bool stdin_open = true;
+    base::Time deadline = sent + round_trip.getTimeout();
     while(true)
     {
         try {
-            Response response = driver.readResponse();
-            if (response.command_id == packet.command_id)
-                return response.status;
+            Response response = driver.readResponse(base::Time());
+            if (response.command_id != command_id)
+                continue;
+            if (sample)
+                round_trip.addSample(base::Time::now() - sent);
+            return response.status;
         }
-        catch(iodrivers_base::TimeoutError) {
+        catch(iodrivers_base::TimeoutError&) {
+        }
+
+        base::Time now = base::Time::now();
+        if (now >= deadline)
+        {
+            round_trip.backoff();
             return STATUS_TIMEOUT;
         }
+
+        pollfd fds[2];
+        fds[0].fd = driver.getFileDescriptor();
+        fds[0].events = POLLIN;
+        fds[1].fd = STDIN_FILENO;
+        fds[1].events = POLLIN;
+        poll(fds, stdin_open ? 2 : 1, (deadline - now).toMilliseconds() + 1);
+        if (!stdin_open || !fds[1].revents)
+            continue;
+
+        string cmd;
+        if (!(std::cin >> cmd)) {
+            stdin_open = false;
+        }
+        else if (cmd == "stop") {
+            sent = base::Time::now();
+            driver.sendPriorityRequest(framed::STOP);
+            command_id = ID_STOP;
+            sample = true;
+            deadline = sent + round_trip.getTimeout();
+        }
+        else {
+            std::cout << "waiting for a reply, only 'stop' is accepted" << std::endl;
+        }
     }
 }
 
+int stop(Driver& driver)
+{
+    base::Time sent = base::Time::now();
+    driver.sendPriorityRequest(framed::STOP);
+    CommandIDs command_id = ID_STOP;
+    int status = waitResponse(driver, command_id, sent, true);
+    if (status == STATUS_OK)
+        driver.acknowledgeRequest(framed::STOP);
+    return status;
+}
+
+template<typename T>
+int request(Driver& driver, T const& packet)
+{
+    CommandIDs const sent_id = static_cast<CommandIDs>(packet.command_id);
+    int attempts = 1 + (packets::isIdempotent(sent_id) ? driver.getRetransmitCount() : 0);
+    int status = STATUS_TIMEOUT;
+    for (int i = 0; i < attempts && status == STATUS_TIMEOUT; ++i)
+    {
+        if (i != 0)
+            std::cout << "Timeout, retransmitting" << std::endl;
+
+        base::Time sent = base::Time::now();
+        driver.sendRequest(packet);
+        CommandIDs command_id = sent_id;
+        status = waitResponse(driver, command_id, sent, i == 0);
+        // Never retransmit after the operator stopped the head
+        if (command_id != sent_id)
+        {
+            if (status == STATUS_OK)
+                driver.acknowledgeRequest(framed::STOP);
+            return status;
+        }
+    }
+    if (status == STATUS_OK)
+        driver.acknowledgeRequest(packet);
+    return status;
+}
+
 void displayResponse(int status)
 {
     if (status == STATUS_OK)
@@ -148,18 +265,322 @@ Eigen::Vector3d askRPY()
     return Eigen::Vector3d(roll, pitch, yaw);
 }
 
-void handleClient(int client_fd)
+struct ScriptEntry
+{
+    /** When to send the request, from the start of the replay */
+    base::Time time;
+    CommandIDs command_id;
+    std::function<void (Driver&)> send;
+};
+
+struct ScriptConfiguration
+{
+    std::string path;
+    bool as_fast_as_possible = false;
+    size_t window = 16;
+};
+
+char const* commandName(CommandIDs command_id)
+{
+    switch(command_id)
+    {
+        case ID_STOP: return "stop";
+        case ID_BITE: return "self-test";
+        case ID_STATUS_REFRESH_RATE_PT: return "rate-pt";
+        case ID_STATUS_REFRESH_RATE_IMU: return "rate-imu";
+        case ID_ANGLES_RELATIVE: return "angles-pos-rel";
+        case ID_ANGLES_GEO: return "angles-pos-geo";
+        case ID_ANGULAR_VELOCITY_RELATIVE: return "angles-vel-rel";
+        case ID_ANGULAR_VELOCITY_GEO: return "angles-vel-geo";
+        case ID_STABILIZATION_TARGET: return "target";
+        case ID_FEATURES: return "features";
+        case ID_BUNDLE: return "bundle";
+    }
+    return "unknown";
+}
+
+template<typename T>
+ScriptEntry makeScriptEntry(base::Time time, T const& packet)
+{
+    ScriptEntry entry;
+    entry.time = time;
+    entry.command_id = static_cast<CommandIDs>(packet.command_id);
+    entry.send = [packet](Driver& driver) { driver.sendRequest(packet); };
+    return entry;
+}
+
+ScriptEntry parseScriptLine(std::vector<std::string> const& fields)
+{
+    if (fields.size() < 2)
+        throw std::invalid_argument("expected TIME COMMAND [ARGS...]");
+
+    base::Time time = base::Time::fromMicroseconds(std::stod(fields[0]) * 1e6);
+    string const& cmd = fields[1];
+    std::vector<double> args;
+    if (cmd == "rate-pt" || cmd == "rate-imu")
+    {
+        if (fields.size() != 3)
+            throw std::invalid_argument(cmd + " expects RATE");
+    }
+    else
+    {
+        for (size_t i = 2; i < fields.size(); ++i)
+            args.push_back(std::stod(fields[i]));
+    }
+
+    size_t expected_args = 0;
+    if (cmd == "stop" || cmd == "self-test" || cmd == "rate-pt" || cmd == "rate-imu")
+        expected_args = 0;
+    else if (cmd == "angles-pos-geo" || cmd == "angles-pos-rel" ||
+             cmd == "angles-vel-geo" || cmd == "angles-vel-rel" || cmd == "target")
+        expected_args = 3;
+    else
+        throw std::invalid_argument("unknown command " + cmd);
+    if (args.size() != expected_args)
+        throw std::invalid_argument(cmd + " expects " + std::to_string(expected_args) + " arguments");
+
+    // Angles are given as ROLL PITCH YAW
+    if (cmd == "stop")
+        return makeScriptEntry(time, requests::Stop());
+    else if (cmd == "self-test")
+        return makeScriptEntry(time, requests::BITE());
+    else if (cmd == "rate-pt")
+        return makeScriptEntry(time, requests::StatusRefreshRatePT(rate_from_arg(fields[2])));
+    else if (cmd == "rate-imu")
+        return makeScriptEntry(time, requests::StatusRefreshRateIMU(rate_from_arg(fields[2])));
+    else if (cmd == "angles-pos-geo")
+        return makeScriptEntry(time, requests::AnglesGeo(args[2], args[1], args[0]));
+    else if (cmd == "angles-pos-rel")
+        return makeScriptEntry(time, requests::AnglesRelative(args[2], args[1], args[0]));
+    else if (cmd == "angles-vel-geo")
+        return makeScriptEntry(time, requests::AngularVelocityGeo(args[2], args[1], args[0]));
+    else if (cmd == "angles-vel-rel")
+        return makeScriptEntry(time, requests::AngularVelocityRelative(args[2], args[1], args[0]));
+    else
+        return makeScriptEntry(time, requests::PositionGeo(args[0], args[1], args[2]));
+}
+
+std::vector<ScriptEntry> loadScript(std::string const& path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("cannot open " + path);
+
+    std::vector<ScriptEntry> entries;
+    std::string line;
+    for (int line_number = 1; std::getline(file, line); ++line_number)
+    {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream stream(line);
+        std::vector<std::string> fields;
+        std::string field;
+        while (stream >> field)
+            fields.push_back(field);
+
+        if (fields.empty() || fields[0][0] == '#')
+            continue;
+        // CSV header
+        if (entries.empty() && !std::isdigit(fields[0][0]) && fields[0][0] != '.')
+            continue;
+
+        try {
+            entries.push_back(parseScriptLine(fields));
+        }
+        catch(std::exception& e) {
+            throw std::runtime_error(path + ":" + std::to_string(line_number) + ": " + e.what());
+        }
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+        [](ScriptEntry const& a, ScriptEntry const& b) { return a.time < b.time; });
+    return entries;
+}
+
+struct CommandSummary
+{
+    std::vector<int64_t> latencies_us;
+    int timeouts = 0;
+    int failures = 0;
+};
+
+void reportScript(std::vector<CommandSummary>& summaries, base::Time duration)
+{
+    std::cout
+        << std::left << std::setw(16) << "command" << std::right
+        << std::setw(8) << "count"
+        << std::setw(10) << "timeouts"
+        << std::setw(8) << "failed"
+        << std::setw(10) << "p50(ms)"
+        << std::setw(10) << "p99(ms)"
+        << std::setw(10) << "max(ms)"
+        << std::endl;
+
+    int total = 0;
+    for (int i = 0; i <= ID_LAST; ++i)
+    {
+        CommandSummary& summary = summaries[i];
+        std::vector<int64_t>& latencies = summary.latencies_us;
+        if (latencies.empty() && summary.timeouts == 0)
+            continue;
+
+        total += latencies.size() + summary.timeouts;
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double p) {
+            if (latencies.empty())
+                return 0.0;
+            size_t index = std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()));
+            return latencies[index] / 1000.0;
+        };
+        std::cout
+            << std::left << std::setw(16) << commandName(static_cast<CommandIDs>(i)) << std::right
+            << std::setw(8) << latencies.size() + summary.timeouts
+            << std::setw(10) << summary.timeouts
+            << std::setw(8) << summary.failures
+            << std::fixed << std::setprecision(3)
+            << std::setw(10) << percentile(0.5)
+            << std::setw(10) << percentile(0.99)
+            << std::setw(10) << (latencies.empty() ? 0.0 : latencies.back() / 1000.0)
+            << std::endl;
+    }
+    std::cout
+        << total << " requests in " << duration.toSeconds() << "s" << std::endl;
+}
+
+/** Replay a script, pipelining the requests
+ *
+ * Requests are sent at their scripted time (or as soon as possible), as
+ * long as less than the configured window of requests wait for a response.
+ * Responses are matched with the oldest pending request of the same command.
+ *
+ * The head answers in order, so pending requests wait for the ones before
+ * them. Timeouts and round-trip samples are measured from the time a request
+ * reached the front of the line, while the reported latencies include the
+ * time spent in line.
+ *
+ * @return the process exit code: 0 if all requests succeeded
+ */
+int runScript(Driver& driver, std::vector<ScriptEntry> const& entries,
+              ScriptConfiguration const& conf)
+{
+    struct PendingRequest
+    {
+        CommandIDs command_id;
+        base::Time sent;
+    };
+
+    RoundTripEstimator& round_trip = driver.getRoundTripEstimator();
+    std::vector<CommandSummary> summaries(ID_LAST + 1);
+    std::deque<PendingRequest> pending;
+    size_t next = 0;
+    base::Time start = base::Time::now();
+    base::Time last_response = start;
+    auto deadline = [&]() {
+        return std::max(pending.front().sent, last_response) + round_trip.getTimeout();
+    };
+    while (next < entries.size() || !pending.empty())
+    {
+        base::Time now = base::Time::now();
+        while (!pending.empty() && !(now < deadline()))
+        {
+            ++summaries[pending.front().command_id].timeouts;
+            pending.pop_front();
+            round_trip.backoff();
+            last_response = now;
+        }
+
+        while (next < entries.size() && pending.size() < conf.window &&
+               (conf.as_fast_as_possible || !(now < start + entries[next].time)))
+        {
+            entries[next].send(driver);
+            pending.push_back(PendingRequest { entries[next].command_id, now });
+            ++next;
+        }
+
+        base::Time wakeup = now + base::Time::fromSeconds(1);
+        if (!pending.empty())
+            wakeup = std::min(wakeup, deadline());
+        if (next < entries.size() && pending.size() < conf.window && !conf.as_fast_as_possible)
+            wakeup = std::min(wakeup, start + entries[next].time);
+
+        Response response;
+        try {
+            response = driver.readResponse(now < wakeup ? wakeup - now : base::Time());
+        }
+        catch(iodrivers_base::TimeoutError&) {
+            continue;
+        }
+
+        now = base::Time::now();
+        auto it = std::find_if(pending.begin(), pending.end(),
+            [&response](PendingRequest const& r) { return r.command_id == response.command_id; });
+        if (it == pending.end())
+            continue;
+
+        base::Time latency = now - it->sent;
+        round_trip.addSample(now - std::max(it->sent, last_response));
+        last_response = now;
+        CommandSummary& summary = summaries[response.command_id];
+        summary.latencies_us.push_back(latency.toMicroseconds());
+        if (response.status != STATUS_OK)
+            ++summary.failures;
+        pending.erase(it);
+    }
+
+    reportScript(summaries, base::Time::now() - start);
+    for (auto const& summary : summaries)
+    {
+        if (summary.timeouts || summary.failures)
+            return 1;
+    }
+    return 0;
+}
+
+void setupDriver(Driver& driver, int client_fd, RealTimeConfiguration const& rt_config,
+                 int retransmit_count)
 {
-    Driver driver;
     driver.setMainStream(new iodrivers_base::FDStream(client_fd, true));
+    // Nothing from the previous connection applies to this one
+    driver.clear();
+    driver.getRoundTripEstimator().reset();
     driver.setReadTimeout(base::Time::fromSeconds(10));
     driver.setWriteTimeout(base::Time::fromSeconds(10));
+    driver.setupRealTime(rt_config);
+    driver.setRetransmitCount(retransmit_count);
+}
+
+/** Send again the configuration the head acknowledged on the previous
+ * connection
+ *
+ * @param disconnected when the previous connection got closed, to report the
+ *   time it took for the head to be operational again
+ */
+void restoreConfiguration(Driver& driver, base::Time const& disconnected)
+{
+    size_t count = driver.getAcknowledgedRequestCount();
+    if (count == 0)
+        return;
+
+    base::Time start = base::Time::now();
+    int status = STATUS_TIMEOUT;
+    try {
+        status = driver.restoreConfiguration().status;
+    }
+    catch(iodrivers_base::TimeoutError&) {
+    }
+    base::Time end = base::Time::now();
+    std::cout << std::fixed << std::setprecision(1)
+        << "Restored " << count << " requests in "
+        << (end - start).toSeconds() * 1e3 << "ms, operational "
+        << (end - disconnected).toSeconds() * 1e3 << "ms after the previous connection closed: ";
+    displayResponse(status);
+}
 
+void handleClient(Driver& driver)
+{
     while(true)
     {
         string cmd = ask("Command ?");
         if (cmd == "stop") {
-            displayResponse(request(driver, requests::Stop()));
+            displayResponse(stop(driver));
         }
         else if (cmd == "self-test") {
             displayResponse(request(driver, requests::BITE()));
@@ -177,22 +598,22 @@ void handleClient(int client_fd)
         else if (cmd == "angles-pos-geo") {
             auto rpy = askRPY();
             displayResponse(
-                request(driver, requests::AnglesGeo(rpy.x(), rpy.y(), rpy.z())));
+                request(driver, requests::AnglesGeo(rpy)));
         }
         else if (cmd == "angles-pos-rel") {
             auto rpy = askRPY();
             displayResponse(
-                request(driver, requests::AnglesRelative(rpy.x(), rpy.y(), rpy.z())));
+                request(driver, requests::AnglesRelative(rpy)));
         }
         else if (cmd == "angles-vel-rel") {
             auto rpy = askRPY();
             displayResponse(
-                request(driver, requests::AngularVelocityRelative(rpy.x(), rpy.y(), rpy.z())));
+                request(driver, requests::AngularVelocityRelative(rpy)));
         }
         else if (cmd == "angles-vel-geo") {
             auto rpy = askRPY();
             displayResponse(
-                request(driver, requests::AngularVelocityGeo(rpy.x(), rpy.y(), rpy.z())));
+                request(driver, requests::AngularVelocityGeo(rpy)));
         }
         else if (cmd == "target") {
             string latitude_s  = ask("Lat  ?");
@@ -221,9 +642,53 @@ int main(int argc, char** argv)
     }
 
     int port = 17001;
-    if (argc > 1)
+    RealTimeConfiguration rt_config;
+    int retransmit_count = 0;
+    ScriptConfiguration script;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--mlock") {
+            rt_config.lock_memory = true;
+        }
+        else if (arg == "--rt-cpu") {
+            verify_argc_atleast(i + 2, argc);
+            rt_config.cpu = std::stol(argv[++i]);
+        }
+        else if (arg == "--rt-priority") {
+            verify_argc_atleast(i + 2, argc);
+            rt_config.priority = std::stol(argv[++i]);
+        }
+        else if (arg == "--retransmit") {
+            verify_argc_atleast(i + 2, argc);
+            retransmit_count = std::stol(argv[++i]);
+        }
+        else if (arg == "--script") {
+            verify_argc_atleast(i + 2, argc);
+            script.path = argv[++i];
+        }
+        else if (arg == "--fast") {
+            script.as_fast_as_possible = true;
+        }
+        else if (arg == "--window") {
+            verify_argc_atleast(i + 2, argc);
+            script.window = std::max(1l, std::stol(argv[++i]));
+        }
+        else {
+            port = std::stol(arg);
+        }
+    }
+
+    std::vector<ScriptEntry> script_entries;
+    if (!script.path.empty())
     {
-        port = std::stol(argv[1]);
+        try {
+            script_entries = loadScript(script.path);
+        }
+        catch(std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
     }
 
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -242,12 +707,18 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    // A head that disconnects must not kill the process on the next write
+    signal(SIGPIPE, SIG_IGN);
+
+    // Kept across connections, so that it can restore the configuration
+    Driver driver;
+    base::Time disconnected = base::Time::now();
     while(true)
     {
         int client_fd = -1;
         while (client_fd < 0)
         {
-            std::cout << "Waiting for connection on port " << argv[1] << std::endl;
+            std::cout << "Waiting for connection on port " << port << std::endl;
             if (listen(server_fd, 1) == -1)
             {
                 std::cerr << strerror(errno) << std::endl;
@@ -261,7 +732,19 @@ int main(int argc, char** argv)
                 usleep(100000);
             }
         }
-        handleClient(client_fd);
+        setupDriver(driver, client_fd, rt_config, retransmit_count);
+        if (!script.path.empty())
+            return runScript(driver, script_entries, script);
+
+        try {
+            restoreConfiguration(driver, disconnected);
+            handleClient(driver);
+        }
+        catch(iodrivers_base::UnixError& e) {
+            std::cerr << "connection lost: " << e.what() << std::endl;
+        }
+        disconnected = base::Time::now();
+        driver.close();
     }
 
     return 0;
@@ -0,0 +1,329 @@
+#include <indra_heads_protocol/Multicast.hpp>
+#include <iodrivers_base/Exceptions.hpp>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+namespace
+{
+    static const uint32_t DATAGRAM_MAGIC = 0x4d484449; // "IDHM"
+
+    struct DatagramHeader
+    {
+        uint32_t magic;
+        uint32_t session;
+        uint64_t first_sequence;
+        uint32_t record_count;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(DatagramHeader) == 24, "DatagramHeader is expected to have no padding");
+
+    /** Payload sizes, after the type byte */
+    static const size_t COMMAND_SIZE = sizeof(ConfigurationSnapshot);
+    static const size_t RESPONSE_SIZE = sizeof(int64_t) + 2;
+
+    in_addr parseAddress(std::string const& address)
+    {
+        in_addr result;
+        if (inet_pton(AF_INET, address.c_str(), &result) != 1)
+            throw std::invalid_argument(address + " is not an IPv4 address");
+        return result;
+    }
+
+    in_addr parseGroup(std::string const& group)
+    {
+        in_addr result = parseAddress(group);
+        if (!IN_MULTICAST(ntohl(result.s_addr)))
+            throw std::invalid_argument(group + " is not a multicast address");
+        return result;
+    }
+
+    void setOption(int fd, int level, int option, void const* value, socklen_t size,
+                   char const* name)
+    {
+        if (setsockopt(fd, level, option, value, size) == -1)
+            throw iodrivers_base::UnixError(std::string("failed to set ") + name);
+    }
+}
+
+MulticastPublisher::MulticastPublisher(std::string const& group, int port,
+                                       MulticastPublisherConfiguration const& configuration)
+    : mSession(std::random_device()())
+    , mNextSequence(0)
+    , mMaxDatagramSize(configuration.max_datagram_size)
+    , mPendingRecords(0)
+{
+    if (mMaxDatagramSize < sizeof(DatagramHeader) + 1 + COMMAND_SIZE || mMaxDatagramSize > 65507)
+        throw std::invalid_argument("invalid multicast datagram size");
+
+    std::memset(&mGroup, 0, sizeof(mGroup));
+    mGroup.sin_family = AF_INET;
+    mGroup.sin_port = htons(port);
+    mGroup.sin_addr = parseGroup(group);
+    in_addr interface;
+    interface.s_addr = htonl(INADDR_ANY);
+    if (!configuration.interface.empty())
+        interface = parseAddress(configuration.interface);
+
+    mFD = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (mFD == -1)
+        throw iodrivers_base::UnixError("failed to create the multicast socket");
+    try
+    {
+        int ttl = configuration.ttl;
+        setOption(mFD, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl), "IP_MULTICAST_TTL");
+        int loopback = configuration.loopback ? 1 : 0;
+        setOption(mFD, IPPROTO_IP, IP_MULTICAST_LOOP, &loopback, sizeof(loopback), "IP_MULTICAST_LOOP");
+        if (!configuration.interface.empty())
+            setOption(mFD, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface), "IP_MULTICAST_IF");
+    }
+    catch(...)
+    {
+        ::close(mFD);
+        throw;
+    }
+
+    mDatagram.reserve(mMaxDatagramSize);
+    mDatagram.resize(sizeof(DatagramHeader));
+}
+
+MulticastPublisher::~MulticastPublisher()
+{
+    flush();
+    ::close(mFD);
+}
+
+uint8_t* MulticastPublisher::reserve(MulticastRecord::Types type, size_t size)
+{
+    if (mDatagram.size() + 1 + size > mMaxDatagramSize)
+        flush();
+
+    size_t offset = mDatagram.size();
+    mDatagram.resize(offset + 1 + size);
+    mDatagram[offset] = type;
+    ++mPendingRecords;
+    ++mNextSequence;
+    return mDatagram.data() + offset + 1;
+}
+
+void MulticastPublisher::publishCommand(ConfigurationSnapshot const& configuration)
+{
+    std::memcpy(reserve(MulticastRecord::COMMAND, COMMAND_SIZE), &configuration, COMMAND_SIZE);
+}
+
+void MulticastPublisher::publishRequest(Driver const& driver)
+{
+    publishCommand(ConfigurationSnapshot::fromConfiguration(driver.getRequestedConfiguration()));
+}
+
+void MulticastPublisher::publishResponse(Response const& response, base::Time const& time)
+{
+    uint8_t* record = reserve(MulticastRecord::RESPONSE, RESPONSE_SIZE);
+    int64_t microseconds = time.toMicroseconds();
+    std::memcpy(record, &microseconds, sizeof(microseconds));
+    record[sizeof(microseconds)] = response.command_id;
+    record[sizeof(microseconds) + 1] = response.status;
+}
+
+void MulticastPublisher::flush()
+{
+    if (mPendingRecords == 0)
+        return;
+
+    DatagramHeader header;
+    header.magic = DATAGRAM_MAGIC;
+    header.session = mSession;
+    header.first_sequence = mNextSequence - mPendingRecords;
+    header.record_count = mPendingRecords;
+    header.reserved = 0;
+    std::memcpy(mDatagram.data(), &header, sizeof(header));
+
+    ssize_t ret = sendto(mFD, mDatagram.data(), mDatagram.size(), 0,
+                         reinterpret_cast<sockaddr const*>(&mGroup), sizeof(mGroup));
+    if (ret == static_cast<ssize_t>(mDatagram.size()))
+    {
+        ++mStatistics.datagrams;
+        mStatistics.records += mPendingRecords;
+        mStatistics.bytes += ret;
+    }
+    else
+        ++mStatistics.dropped_datagrams;
+
+    mPendingRecords = 0;
+    mDatagram.resize(sizeof(DatagramHeader));
+}
+
+size_t MulticastPublisher::getPendingRecordCount() const
+{
+    return mPendingRecords;
+}
+
+uint32_t MulticastPublisher::getSession() const
+{
+    return mSession;
+}
+
+uint64_t MulticastPublisher::getNextSequence() const
+{
+    return mNextSequence;
+}
+
+MulticastPublisherStatistics const& MulticastPublisher::getStatistics() const
+{
+    return mStatistics;
+}
+
+MulticastSubscriber::MulticastSubscriber(std::string const& group, int port,
+                                         std::string const& interface)
+    : mSynchronized(false)
+    , mSession(0)
+    , mNextSequence(0)
+    , mDatagram(65536)
+{
+    ip_mreq membership;
+    membership.imr_multiaddr = parseGroup(group);
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (!interface.empty())
+        membership.imr_interface = parseAddress(interface);
+
+    mFD = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (mFD == -1)
+        throw iodrivers_base::UnixError("failed to create the multicast socket");
+    try
+    {
+        // Let several subscribers of the same host listen on the port
+        int enable = 1;
+        setOption(mFD, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable), "SO_REUSEADDR");
+
+        // Binding to the group, and not to any address, filters out the
+        // unicast datagrams sent to the same port
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr = membership.imr_multiaddr;
+        if (bind(mFD, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1)
+            throw iodrivers_base::UnixError("failed to bind the multicast socket");
+        setOption(mFD, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership),
+                  "IP_ADD_MEMBERSHIP");
+    }
+    catch(...)
+    {
+        ::close(mFD);
+        throw;
+    }
+}
+
+MulticastSubscriber::~MulticastSubscriber()
+{
+    ::close(mFD);
+}
+
+int MulticastSubscriber::getFileDescriptor() const
+{
+    return mFD;
+}
+
+MulticastSubscriberStatistics const& MulticastSubscriber::getStatistics() const
+{
+    return mStatistics;
+}
+
+bool MulticastSubscriber::decode(size_t size, uint64_t first_sequence,
+                                 std::vector<MulticastRecord>& records)
+{
+    uint8_t const* data = mDatagram.data() + sizeof(DatagramHeader);
+    uint8_t const* end = mDatagram.data() + size;
+    uint64_t sequence = first_sequence;
+    while (data != end)
+    {
+        MulticastRecord record = MulticastRecord();
+        record.sequence = sequence++;
+        record.type = static_cast<MulticastRecord::Types>(*data++);
+        if (record.type == MulticastRecord::COMMAND && end - data >= static_cast<ptrdiff_t>(COMMAND_SIZE))
+        {
+            std::memcpy(&record.configuration, data, COMMAND_SIZE);
+            data += COMMAND_SIZE;
+        }
+        else if (record.type == MulticastRecord::RESPONSE && end - data >= static_cast<ptrdiff_t>(RESPONSE_SIZE))
+        {
+            std::memcpy(&record.time, data, sizeof(record.time));
+            record.response.command_id = static_cast<CommandIDs>(data[sizeof(record.time)]);
+            record.response.status = static_cast<ResponseStatus>(data[sizeof(record.time) + 1]);
+            data += RESPONSE_SIZE;
+        }
+        else
+            return false;
+        records.push_back(record);
+    }
+    return true;
+}
+
+size_t MulticastSubscriber::read(std::vector<MulticastRecord>& records, base::Time const& timeout)
+{
+    pollfd fd = { mFD, POLLIN, 0 };
+    int timeout_ms = (timeout.toMicroseconds() + 999) / 1000;
+    int ret = poll(&fd, 1, timeout_ms);
+    if (ret == -1)
+        throw iodrivers_base::UnixError("failed to wait on the multicast socket");
+    else if (ret == 0)
+        return 0;
+
+    ssize_t size = recv(mFD, mDatagram.data(), mDatagram.size(), MSG_DONTWAIT);
+    if (size == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    else if (size == -1)
+        throw iodrivers_base::UnixError("failed to read from the multicast socket");
+
+    DatagramHeader header;
+    if (size < static_cast<ssize_t>(sizeof(header)))
+    {
+        ++mStatistics.invalid_datagrams;
+        return 0;
+    }
+    std::memcpy(&header, mDatagram.data(), sizeof(header));
+
+    size_t initial_size = records.size();
+    if (header.magic != DATAGRAM_MAGIC ||
+        !decode(size, header.first_sequence, records) ||
+        records.size() - initial_size != header.record_count)
+    {
+        records.resize(initial_size);
+        ++mStatistics.invalid_datagrams;
+        return 0;
+    }
+
+    if (!mSynchronized || header.session != mSession)
+    {
+        if (mSynchronized)
+            ++mStatistics.session_changes;
+        mSynchronized = true;
+        mSession = header.session;
+        mNextSequence = header.first_sequence;
+    }
+
+    if (header.first_sequence < mNextSequence)
+    {
+        records.resize(initial_size);
+        ++mStatistics.late_datagrams;
+        return 0;
+    }
+    else if (header.first_sequence > mNextSequence)
+    {
+        ++mStatistics.gaps;
+        mStatistics.missed_records += header.first_sequence - mNextSequence;
+    }
+
+    mNextSequence = header.first_sequence + header.record_count;
+    ++mStatistics.datagrams;
+    mStatistics.records += header.record_count;
+    return header.record_count;
+}
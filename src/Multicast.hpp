@@ -0,0 +1,216 @@
+#ifndef INDRA_HEADS_MULTICAST_HPP
+#define INDRA_HEADS_MULTICAST_HPP
+
+#include <indra_heads_protocol/ConfigurationSnapshot.hpp>
+#include <indra_heads_protocol/Driver.hpp>
+#include <indra_heads_protocol/Response.hpp>
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+
+namespace indra_heads_protocol
+{
+    /** Fan-out of decoded commands and responses to any number of consoles
+     * through a UDP multicast group
+     *
+     * Records are batched in datagrams. Each datagram starts with a header
+     * holding the publisher's session (a random number chosen when it is
+     * created) and the sequence number of its first record, followed by
+     * the records themselves: a type byte, then either a
+     * ConfigurationSnapshot (COMMAND) or a time and a response (RESPONSE).
+     *
+     * Delivery is best-effort. Subscribers use the sequence numbers to
+     * count the records they missed; they cannot ask for them again, as
+     * each record supersedes the previous ones anyway.
+     *
+     * Datagrams are in host byte order.
+     */
+    namespace multicast
+    {
+        /** The default datagram size, which fits in an Ethernet frame */
+        static const size_t DEFAULT_DATAGRAM_SIZE = 1472;
+    }
+
+    /** A record received by MulticastSubscriber */
+    struct MulticastRecord
+    {
+        enum Types
+        {
+            /** A decoded request, i.e. the requested configuration right
+             * after it. Its time is the configuration's
+             */
+            COMMAND = 1,
+            /** The response to a request */
+            RESPONSE = 2
+        };
+
+        uint64_t sequence;
+        Types type;
+        /** For COMMAND records */
+        ConfigurationSnapshot configuration;
+        /** For RESPONSE records. The time is in microseconds */
+        int64_t time;
+        Response response;
+    };
+
+    struct MulticastPublisherConfiguration
+    {
+        /** Largest datagram, header included */
+        size_t max_datagram_size = multicast::DEFAULT_DATAGRAM_SIZE;
+        /** Time-to-live of the datagrams. One keeps them on the local
+         * network
+         */
+        int ttl = 1;
+        /** Whether subscribers on this host get the datagrams */
+        bool loopback = true;
+        /** Address of the interface to publish on, e.g. 127.0.0.1. Empty
+         * to let the routing table decide
+         */
+        std::string interface;
+    };
+
+    struct MulticastPublisherStatistics
+    {
+        uint64_t records = 0;
+        uint64_t datagrams = 0;
+        uint64_t bytes = 0;
+        /** Datagrams the kernel refused, e.g. because its buffers were
+         * full. Subscribers see them as gaps
+         */
+        uint64_t dropped_datagrams = 0;
+    };
+
+    /** Publishes records to a multicast group, see multicast
+     *
+     * Records are added to the current datagram, which is sent once full
+     * or on flush(). Flush after each burst of requests, e.g. after each
+     * RequestServer::serve, to bound the latency: the cost of a datagram
+     * does not depend on the number of subscribers, only on the number of
+     * datagrams.
+     *
+     * The socket is non-blocking, so that publishing never delays the
+     * control loop. A datagram that cannot be sent right away is dropped.
+     */
+    class MulticastPublisher
+    {
+        int mFD;
+        sockaddr_in mGroup;
+        uint32_t mSession;
+        uint64_t mNextSequence;
+        std::vector<uint8_t> mDatagram;
+        size_t mMaxDatagramSize;
+        uint32_t mPendingRecords;
+        MulticastPublisherStatistics mStatistics;
+
+        uint8_t* reserve(MulticastRecord::Types type, size_t size);
+
+    public:
+        /**
+         * @throw std::invalid_argument if the group is not an IPv4
+         *   multicast address or the datagram size cannot hold a record
+         * @throw iodrivers_base::UnixError if the socket cannot be set up
+         */
+        MulticastPublisher(std::string const& group, int port,
+                           MulticastPublisherConfiguration const& configuration =
+                               MulticastPublisherConfiguration());
+        /** Flushes the pending records */
+        ~MulticastPublisher();
+        MulticastPublisher(MulticastPublisher const&) = delete;
+        MulticastPublisher& operator =(MulticastPublisher const&) = delete;
+
+        /** Publish a decoded request, as the configuration it led to */
+        void publishCommand(ConfigurationSnapshot const& configuration);
+
+        /** Publish the request that the driver just read, i.e. its
+         * requested configuration
+         */
+        void publishRequest(Driver const& driver);
+
+        /** Publish a response */
+        void publishResponse(Response const& response, base::Time const& time);
+
+        /** Send the pending records, if any */
+        void flush();
+
+        /** Number of records waiting for the next flush */
+        size_t getPendingRecordCount() const;
+
+        /** The random session number that identifies this publisher */
+        uint32_t getSession() const;
+
+        /** The sequence number of the next record */
+        uint64_t getNextSequence() const;
+
+        MulticastPublisherStatistics const& getStatistics() const;
+    };
+
+    struct MulticastSubscriberStatistics
+    {
+        uint64_t datagrams = 0;
+        uint64_t records = 0;
+        /** Records missing between the datagrams that were received */
+        uint64_t missed_records = 0;
+        /** Number of gaps, i.e. of times records were missing */
+        uint64_t gaps = 0;
+        /** Datagrams older than the last one received, which are dropped */
+        uint64_t late_datagrams = 0;
+        /** Datagrams that are not valid publisher datagrams */
+        uint64_t invalid_datagrams = 0;
+        /** Times the session changed, i.e. the publisher got restarted */
+        uint64_t session_changes = 0;
+    };
+
+    /** Receives the records of a MulticastPublisher and detects the ones
+     * that got lost
+     *
+     * Several subscribers can listen on the same group and port on the same
+     * host.
+     */
+    class MulticastSubscriber
+    {
+        int mFD;
+        bool mSynchronized;
+        uint32_t mSession;
+        uint64_t mNextSequence;
+        std::vector<uint8_t> mDatagram;
+        MulticastSubscriberStatistics mStatistics;
+
+        /** Decode a datagram's records and append them
+         *
+         * @return false if the datagram is invalid, in which case nothing
+         *   is appended
+         */
+        bool decode(size_t size, uint64_t first_sequence, std::vector<MulticastRecord>& records);
+
+    public:
+        /**
+         * @param interface address of the interface to listen on, e.g.
+         *   127.0.0.1. Empty to let the kernel decide
+         * @throw std::invalid_argument if the group is not an IPv4
+         *   multicast address
+         * @throw iodrivers_base::UnixError if the socket cannot be set up
+         */
+        MulticastSubscriber(std::string const& group, int port,
+                            std::string const& interface = std::string());
+        ~MulticastSubscriber();
+        MulticastSubscriber(MulticastSubscriber const&) = delete;
+        MulticastSubscriber& operator =(MulticastSubscriber const&) = delete;
+
+        /** Read one datagram and append its records
+         *
+         * @param timeout how long to wait for a datagram. A null timeout
+         *   only reads one that is already there
+         * @return the number of records appended, zero on timeout or if the
+         *   datagram was dropped
+         * @throw iodrivers_base::UnixError on socket errors
+         */
+        size_t read(std::vector<MulticastRecord>& records, base::Time const& timeout);
+
+        /** The file descriptor to wait on, e.g. with poll */
+        int getFileDescriptor() const;
+
+        MulticastSubscriberStatistics const& getStatistics() const;
+    };
+}
+
+#endif
@@ -0,0 +1,144 @@
+#include <indra_heads_protocol/PacketParser.hpp>
+#include <indra_heads_protocol/Bundle.hpp>
+#include <algorithm>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+namespace
+{
+    /** Lookup table for the protocol's CRC-8 (polynomial 0x07, no reflection,
+     * zero init and xor-out), so that the running CRC can be updated byte
+     * per byte without going through a full compute_crc call
+     */
+    struct CRCTable
+    {
+        uint8_t values[256];
+
+        CRCTable()
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                uint8_t crc = i;
+                for (int bit = 0; bit < 8; ++bit)
+                    crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+                values[i] = crc;
+            }
+        }
+    };
+    static const CRCTable CRC_TABLE;
+}
+
+PacketParser::PacketParser()
+    : mLastRejection(REJECTED_NONE)
+    , mRejectedSize(0)
+{
+    reset();
+}
+
+void PacketParser::reset()
+{
+    mHeader[0] = 0;
+    mHeader[1] = 0;
+    mHeader[2] = 0;
+    mPacketSize = 0;
+    mProcessed = 0;
+    mCRC = 0;
+}
+
+size_t PacketParser::getProcessedSize() const
+{
+    return mProcessed;
+}
+
+PacketParser::Rejection PacketParser::getLastRejection() const
+{
+    return mLastRejection;
+}
+
+size_t PacketParser::getRejectedSize() const
+{
+    return mRejectedSize;
+}
+
+bool PacketParser::isBundleRequest(uint8_t const* header)
+{
+    return header[0] == ID_BUNDLE && header[1] == MSG_REQUEST;
+}
+
+int PacketParser::reject(Rejection reason, size_t size)
+{
+    mLastRejection = reason;
+    mRejectedSize = size;
+    return -1;
+}
+
+bool PacketParser::isContinuation(uint8_t const* buffer, size_t buffer_size) const
+{
+    return mPacketSize != 0 &&
+        buffer_size >= mProcessed &&
+        buffer[0] == mHeader[0] &&
+        buffer[1] == mHeader[1] &&
+        (!isBundleRequest(mHeader) || buffer[2] == mHeader[2]);
+}
+
+int PacketParser::extract(uint8_t const* buffer, size_t buffer_size)
+{
+    if (!isContinuation(buffer, buffer_size))
+    {
+        reset();
+
+        if (buffer_size == 0)
+            return 0;
+        else if (!packets::isValidCommandID(buffer[0]))
+            return reject(REJECTED_COMMAND_ID);
+        else if (buffer_size < 2)
+            return 0;
+        else if (buffer[1] > MSG_LAST_TYPE)
+            return reject(REJECTED_MESSAGE_TYPE);
+
+        if (isBundleRequest(buffer))
+        {
+            // The size is in the third byte of the header
+            if (buffer_size < BUNDLE_HEADER_SIZE)
+                return 0;
+            else if (buffer[2] == 0 || buffer[2] > MAX_BUNDLE_PAYLOAD)
+                return reject(REJECTED_BUNDLE);
+            mPacketSize = BUNDLE_HEADER_SIZE + buffer[2];
+        }
+        else
+        {
+            mPacketSize = packets::getPacketSize(
+                static_cast<CommandIDs>(buffer[0]),
+                static_cast<MessageTypes>(buffer[1]));
+        }
+        mHeader[0] = buffer[0];
+        mHeader[1] = buffer[1];
+        mHeader[2] = buffer_size > 2 ? buffer[2] : 0;
+    }
+
+    size_t crc_end = min(buffer_size, mPacketSize);
+    if (crc_end > mProcessed)
+    {
+        uint8_t crc = mCRC;
+        for (size_t i = mProcessed; i < crc_end; ++i)
+            crc = CRC_TABLE.values[crc ^ buffer[i]];
+        mCRC = crc;
+        mProcessed = crc_end;
+    }
+
+    size_t expected_size = mPacketSize + sizeof(crc_t);
+    if (buffer_size < expected_size)
+        return 0;
+
+    crc_t expected_crc = *reinterpret_cast<crc_t const*>(buffer + mPacketSize);
+    crc_t actual_crc   = mCRC;
+    bool bundle = isBundleRequest(mHeader);
+    reset();
+    if (actual_crc != expected_crc)
+        return reject(REJECTED_CRC, expected_size);
+    else if (bundle && !bundles::isValidPayload(buffer + BUNDLE_HEADER_SIZE,
+                                                 expected_size - BUNDLE_HEADER_SIZE - sizeof(crc_t)))
+        return reject(REJECTED_BUNDLE, expected_size);
+    return expected_size;
+}
@@ -0,0 +1,86 @@
+#ifndef INDRA_HEADS_PACKET_PARSER_HPP
+#define INDRA_HEADS_PACKET_PARSER_HPP
+
+#include <indra_heads_protocol/Protocol.hpp>
+
+namespace indra_heads_protocol
+{
+    /** Byte-incremental packet framing
+     *
+     * It implements the framing rules of the protocol (valid command ID,
+     * valid message type, packet size given by the header, trailing CRC,
+     * and for bundles a well-formed payload) but
+     * keeps its state between calls, so that a packet that arrives in pieces
+     * is validated only once: the header is checked when it arrives, the
+     * packet size is computed once and the CRC is only updated with the bytes
+     * that were not seen yet.
+     *
+     * extract() has the same semantics than iodrivers_base's extractPacket.
+     * It must be given a buffer that starts at the same position until it
+     * returns something else than zero, which is how iodrivers_base calls
+     * extractPacket. A buffer that does not match what the parser has
+     * already seen (shorter, or with a different header) restarts the
+     * parsing from scratch.
+     */
+    class PacketParser
+    {
+    public:
+        /** Why extract() rejected the start of the buffer the last time it
+         * returned a negative value
+         */
+        enum Rejection
+        {
+            REJECTED_NONE,
+            REJECTED_COMMAND_ID,
+            REJECTED_MESSAGE_TYPE,
+            REJECTED_CRC,
+            /** A bundle with an invalid size or payload */
+            REJECTED_BUNDLE
+        };
+
+    private:
+        /** Command ID, message type and, for bundles, payload size */
+        uint8_t mHeader[3];
+        /** The size of the packet, without the CRC. Zero if the header has
+         * not been received yet
+         */
+        size_t mPacketSize;
+        /** How many bytes of the packet have been fed to the CRC */
+        size_t mProcessed;
+        crc_t mCRC;
+        Rejection mLastRejection;
+        size_t mRejectedSize;
+
+        int reject(Rejection reason, size_t size = 1);
+        static bool isBundleRequest(uint8_t const* header);
+        bool isContinuation(uint8_t const* buffer, size_t buffer_size) const;
+
+    public:
+        PacketParser();
+
+        /** Look for a packet at the start of buffer
+         *
+         * @return zero if more bytes are needed, -1 if the first byte
+         *   should be discarded and the size of the packet (CRC included)
+         *   if a valid packet starts the buffer
+         */
+        int extract(uint8_t const* buffer, size_t buffer_size);
+
+        /** Forget about the packet currently being parsed */
+        void reset();
+
+        /** How many bytes of the current packet have been processed so far */
+        size_t getProcessedSize() const;
+
+        /** Reason for the last rejection */
+        Rejection getLastRejection() const;
+
+        /** Size of what the last rejection was about: the whole packet, CRC
+         * included, for REJECTED_CRC and REJECTED_BUNDLE, and the first
+         * byte otherwise
+         */
+        size_t getRejectedSize() const;
+    };
+}
+
+#endif
@@ -17,6 +17,10 @@ int packets::getPacketSize(CommandIDs command_id, MessageTypes message_type)
             return sizeof(packets::SimpleMessage);
         case ID_BITE:
             return sizeof(packets::SimpleMessage);
+        case ID_FEATURES:
+            return sizeof(packets::SimpleMessage);
+        case ID_BUNDLE:
+            throw std::invalid_argument("the size of bundles is given by their header");
         case ID_STATUS_REFRESH_RATE_PT:
             return sizeof(packets::StatusRefreshRate);
         case ID_STATUS_REFRESH_RATE_IMU:
@@ -34,6 +38,29 @@ int packets::getPacketSize(CommandIDs command_id, MessageTypes message_type)
     };
 }
 
+bool packets::isValidCommandID(uint8_t command_id)
+{
+    return command_id <= ID_LAST ||
+        command_id == ID_FEATURES ||
+        command_id == ID_BUNDLE;
+}
+
+bool packets::isIdempotent(CommandIDs command_id)
+{
+    switch(command_id)
+    {
+        case ID_FEATURES:
+        case ID_STATUS_REFRESH_RATE_PT:
+        case ID_STATUS_REFRESH_RATE_IMU:
+        case ID_ANGLES_RELATIVE:
+        case ID_ANGLES_GEO:
+        case ID_STABILIZATION_TARGET:
+            return true;
+        default:
+            return false;
+    }
+}
+
 crc_t details::compute_crc(uint8_t const* buffer, uint32_t size)
 {
     return boost::crc<8, 7, 0, 0, false, false>(buffer, size);
@@ -46,10 +73,7 @@ void details::encode_crc(uint8_t* encoded, crc_t crc)
 
 void details::encode_angle(uint8_t* encoded, double angle)
 {
-    double normalized = std::fmod(angle, 2 * M_PI);
-    if (normalized < 0)
-        normalized += 2 * M_PI;
-    uint16_t integral  = std::floor(normalized * 360 / M_PI);
+    uint16_t integral = angle_count(angle);
     encoded[0] = (integral & 0xFF00) >> 8;
     encoded[1] = (integral & 0x00FF);
 }
@@ -68,8 +92,8 @@ double details::decode_angle(uint8_t const* angle)
 
 void details::encode_angular_velocity(uint8_t* encoded, double velocity)
 {
-    encoded[0] = velocity > 0 ? 0 : 1;
-    encoded[1] = std::round(std::abs(velocity) * 1800 / M_PI);
+    encoded[0] = sign(velocity);
+    encoded[1] = angular_velocity_count(velocity);
 }
 
 double details::decode_angular_velocity(uint8_t const* encoded)
@@ -81,8 +105,8 @@ double details::decode_angular_velocity(uint8_t const* encoded)
 
 void details::encode_latlon(uint8_t* encoded, double angle)
 {
-    uint32_t integral = std::round(std::abs(angle) * 1e6);
-    encoded[0] = angle > 0 ? 0 : 1;
+    uint32_t integral = latlon_count(angle);
+    encoded[0] = sign(angle);
     encoded[1] = (integral & 0xFF000000) >> 24;
     encoded[2] = (integral & 0x00FF0000) >> 16;
     encoded[3] = (integral & 0x0000FF00) >> 8;
@@ -103,8 +127,8 @@ double details::decode_latlon(uint8_t const* encoded)
 
 void details::encode_altitude(uint8_t* encoded, double altitude)
 {
-    uint16_t integral = static_cast<uint16_t>(std::round(std::abs(altitude) * 10));
-    encoded[0] = altitude > 0 ? 0 : 1;
+    uint16_t integral = altitude_count(altitude);
+    encoded[0] = sign(altitude);
     encoded[1] = (integral & 0xFF00) >> 8;
     encoded[2] = (integral & 0x00FF) >> 0;
 }
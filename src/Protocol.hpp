@@ -18,11 +18,28 @@ namespace indra_heads_protocol
         ID_ANGLES_GEO      = 5,
         ID_ANGULAR_VELOCITY_RELATIVE = 6,
         ID_ANGULAR_VELOCITY_GEO = 7,
-        ID_STABILIZATION_TARGET = 8
+        ID_STABILIZATION_TARGET = 8,
+        /** Protocol extensions. Heads that predate them discard these IDs,
+         * so they are only used after negotiation, see Features
+         */
+        ID_FEATURES = 9,
+        ID_BUNDLE = 10
     };
 
+    /** Last ID of the base protocol */
     static const int ID_LAST = ID_STABILIZATION_TARGET;
 
+    /** Protocol extensions a head may support
+     *
+     * A client asks with requests::Features(). The head answers with a
+     * Response to ID_FEATURES whose status byte is a bitfield of these
+     * values. A head that does not answer supports none of them.
+     */
+    enum Features {
+        /** Several commands in a single frame, see Bundle */
+        FEATURE_BUNDLE = 1
+    };
+
     typedef std::int8_t crc_t;
     static const int MIN_PACKET_SIZE = 2 + sizeof(crc_t);
 
@@ -77,11 +94,96 @@ namespace indra_heads_protocol
         double decode_angular_velocity(uint8_t const* encoded);
         double decode_latlon(uint8_t const* encoded);
         double decode_altitude(uint8_t const* encoded);
+
+        /** Compile-time building blocks of the encoders above
+         *
+         * The runtime encoders are written in terms of these, so that the
+         * packets built by the framed namespace are byte-for-byte the ones
+         * built by packetize
+         */
+        constexpr double constexpr_floor(double value)
+        {
+            return (static_cast<double>(static_cast<int64_t>(value)) > value) ?
+                static_cast<double>(static_cast<int64_t>(value)) - 1 :
+                static_cast<double>(static_cast<int64_t>(value));
+        }
+
+        // Round half away from zero, like std::round, for positive values
+        constexpr double constexpr_round(double value)
+        {
+            return (value - constexpr_floor(value) >= 0.5) ? constexpr_floor(value) + 1 : constexpr_floor(value);
+        }
+
+        constexpr double constexpr_abs(double value)
+        {
+            return value < 0 ? -value : value;
+        }
+
+        constexpr uint8_t crc8_shift(uint8_t crc, int bits)
+        {
+            return bits == 0 ? crc : crc8_shift(
+                static_cast<uint8_t>((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1),
+                bits - 1);
+        }
+
+        /** CRC-8 (polynomial 0x07, zero init) of a byte sequence */
+        constexpr uint8_t crc8(uint8_t crc)
+        {
+            return crc;
+        }
+
+        template<typename... Bytes>
+        constexpr uint8_t crc8(uint8_t crc, uint8_t byte, Bytes... bytes)
+        {
+            return crc8(crc8_shift(crc ^ byte, 8), bytes...);
+        }
+
+        constexpr uint16_t angle_count(double angle)
+        {
+            return static_cast<uint16_t>(constexpr_floor(
+                (angle - 2 * M_PI * constexpr_floor(angle / (2 * M_PI))) * 360 / M_PI));
+        }
+
+        constexpr uint8_t angular_velocity_count(double velocity)
+        {
+            return static_cast<uint8_t>(constexpr_round(constexpr_abs(velocity) * 1800 / M_PI));
+        }
+
+        constexpr uint32_t latlon_count(double angle)
+        {
+            return static_cast<uint32_t>(constexpr_round(constexpr_abs(angle) * 1e6));
+        }
+
+        constexpr uint16_t altitude_count(double altitude)
+        {
+            return static_cast<uint16_t>(constexpr_round(constexpr_abs(altitude) * 10));
+        }
+
+        constexpr uint8_t sign(double value)
+        {
+            return value > 0 ? 0 : 1;
+        }
     }
 
     namespace packets {
+        /** Size of a packet, without the CRC
+         *
+         * @throw std::invalid_argument for bundle requests, whose size is
+         *   given by their header (see Bundle)
+         */
         int getPacketSize(CommandIDs command_id, MessageTypes message_type);
 
+        /** Whether the given byte is a command ID, extensions included */
+        bool isValidCommandID(uint8_t command_id);
+
+        /** Whether sending the request twice has the same effect than
+         * sending it once, i.e. whether it can be retransmitted safely
+         *
+         * This is true for the angles, rates and stabilization target
+         * requests, and for the features query.
+         */
+        bool isIdempotent(CommandIDs command_id);
+
         struct SimpleMessage
         {
             uint8_t command_id;
@@ -165,7 +267,7 @@ namespace indra_heads_protocol
         } __attribute__((packed));
     }
 
-    static const int MAX_PACKET_SIZE = 16;
+    static const int MAX_PACKET_SIZE = 48;
 
     /** Creation of the request messages
      *
@@ -189,6 +291,12 @@ namespace indra_heads_protocol
             return packets::SimpleMessage(ID_BITE);
         }
 
+        /** Ask the head which protocol extensions it supports */
+        inline packets::SimpleMessage Features()
+        {
+            return packets::SimpleMessage(ID_FEATURES);
+        }
+
         inline packets::StatusRefreshRate StatusRefreshRatePT(Rates rate)
         {
             return packets::StatusRefreshRate(ID_STATUS_REFRESH_RATE_PT, rate);
@@ -221,6 +329,29 @@ namespace indra_heads_protocol
             return packets::AngularVelocities(ID_ANGULAR_VELOCITY_GEO, yaw, pitch, roll);
         }
 
+        /** The angle requests from roll, pitch and yaw, which is the order
+         * of RequestedConfiguration::rpy and of what decode returns
+         */
+        inline packets::Angles AnglesRelative(Eigen::Vector3d const& rpy)
+        {
+            return AnglesRelative(rpy.z(), rpy.y(), rpy.x());
+        }
+
+        inline packets::Angles AnglesGeo(Eigen::Vector3d const& rpy)
+        {
+            return AnglesGeo(rpy.z(), rpy.y(), rpy.x());
+        }
+
+        inline packets::AngularVelocities AngularVelocityRelative(Eigen::Vector3d const& rpy)
+        {
+            return AngularVelocityRelative(rpy.z(), rpy.y(), rpy.x());
+        }
+
+        inline packets::AngularVelocities AngularVelocityGeo(Eigen::Vector3d const& rpy)
+        {
+            return AngularVelocityGeo(rpy.z(), rpy.y(), rpy.x());
+        }
+
         inline packets::PositionGeo PositionGeo(
             double latitude, double longitude, double altitude)
         {
@@ -246,6 +377,121 @@ namespace indra_heads_protocol
         GeoTarget decode(packets::PositionGeo const& angle);
     }
 
+    /** Requests framed at compile time
+     *
+     * These build the complete packet, CRC included, as a constexpr byte
+     * array. When the arguments are constants, the packet is computed by the
+     * compiler and sending it is a plain write:
+     *
+     * <code>
+     * static constexpr auto home = framed::AnglesRelative(0, 0.5, 0);
+     * driver.sendRequest(home);
+     * </code>
+     *
+     * The bytes are the same as requests::packetize of the corresponding
+     * request.
+     */
+    namespace framed {
+        template<size_t N>
+        struct Packet {
+            uint8_t data[N];
+
+            static constexpr size_t size() { return N; }
+            constexpr CommandIDs command_id() const { return static_cast<CommandIDs>(data[0]); }
+        };
+
+        /** Append the CRC to the given bytes */
+        template<typename... Bytes>
+        constexpr Packet<sizeof...(Bytes) + 1> frame(Bytes... bytes)
+        {
+            return Packet<sizeof...(Bytes) + 1> {{
+                static_cast<uint8_t>(bytes)...,
+                details::crc8(0, static_cast<uint8_t>(bytes)...)
+            }};
+        }
+
+        constexpr Packet<3> Stop()
+        {
+            return frame(ID_STOP, MSG_REQUEST);
+        }
+
+        constexpr Packet<3> BITE()
+        {
+            return frame(ID_BITE, MSG_REQUEST);
+        }
+
+        constexpr Packet<4> StatusRefreshRatePT(Rates rate)
+        {
+            return frame(ID_STATUS_REFRESH_RATE_PT, MSG_REQUEST, rate);
+        }
+
+        constexpr Packet<4> StatusRefreshRateIMU(Rates rate)
+        {
+            return frame(ID_STATUS_REFRESH_RATE_IMU, MSG_REQUEST, rate);
+        }
+
+        constexpr Packet<9> Angles(CommandIDs command_id,
+                                   double yaw, double pitch, double roll)
+        {
+            return frame(command_id, MSG_REQUEST,
+                details::angle_count(yaw) >> 8, details::angle_count(yaw) & 0xFF,
+                details::angle_count(pitch) >> 8, details::angle_count(pitch) & 0xFF,
+                details::angle_count(roll) >> 8, details::angle_count(roll) & 0xFF);
+        }
+
+        constexpr Packet<9> AnglesRelative(double yaw, double pitch, double roll)
+        {
+            return Angles(ID_ANGLES_RELATIVE, yaw, pitch, roll);
+        }
+
+        constexpr Packet<9> AnglesGeo(double yaw, double pitch, double roll)
+        {
+            return Angles(ID_ANGLES_GEO, yaw, pitch, roll);
+        }
+
+        constexpr Packet<9> AngularVelocities(CommandIDs command_id,
+                                              double yaw, double pitch, double roll)
+        {
+            return frame(command_id, MSG_REQUEST,
+                details::sign(yaw), details::angular_velocity_count(yaw),
+                details::sign(pitch), details::angular_velocity_count(pitch),
+                details::sign(roll), details::angular_velocity_count(roll));
+        }
+
+        constexpr Packet<9> AngularVelocityRelative(double yaw, double pitch, double roll)
+        {
+            return AngularVelocities(ID_ANGULAR_VELOCITY_RELATIVE, yaw, pitch, roll);
+        }
+
+        constexpr Packet<9> AngularVelocityGeo(double yaw, double pitch, double roll)
+        {
+            return AngularVelocities(ID_ANGULAR_VELOCITY_GEO, yaw, pitch, roll);
+        }
+
+        constexpr Packet<16> PositionGeo(double latitude, double longitude, double altitude)
+        {
+            return frame(ID_STABILIZATION_TARGET, MSG_REQUEST,
+                details::sign(latitude),
+                details::latlon_count(latitude) >> 24,
+                (details::latlon_count(latitude) >> 16) & 0xFF,
+                (details::latlon_count(latitude) >> 8) & 0xFF,
+                details::latlon_count(latitude) & 0xFF,
+                details::sign(longitude),
+                details::latlon_count(longitude) >> 24,
+                (details::latlon_count(longitude) >> 16) & 0xFF,
+                (details::latlon_count(longitude) >> 8) & 0xFF,
+                details::latlon_count(longitude) & 0xFF,
+                details::sign(altitude),
+                details::altitude_count(altitude) >> 8,
+                details::altitude_count(altitude) & 0xFF);
+        }
+
+        /** The STOP request, ready to be written */
+        constexpr Packet<3> STOP = Stop();
+        /** The BITE request, ready to be written */
+        constexpr Packet<3> SELF_TEST = BITE();
+    }
+
     /** Representation of the reply messages
      */
     namespace reply {
@@ -254,6 +500,15 @@ namespace indra_heads_protocol
             return packets::Response(command_id, status);
         }
         ResponseStatus parse(packets::Response const& message);
+
+        /** Answer to requests::Features
+         *
+         * @param features a bitfield of Features values
+         */
+        inline packets::Response Features(uint8_t features)
+        {
+            return packets::Response(ID_FEATURES, static_cast<ResponseStatus>(features));
+        }
     }
 }
 
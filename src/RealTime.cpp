@@ -0,0 +1,47 @@
+#include <indra_heads_protocol/RealTime.hpp>
+#include <iodrivers_base/Exceptions.hpp>
+#include <alloca.h>
+#include <cstdint>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+using namespace indra_heads_protocol;
+
+static void prefaultStack(size_t size)
+{
+    volatile uint8_t* stack = static_cast<volatile uint8_t*>(alloca(size));
+    for (size_t i = 0; i < size; i += 4096)
+        stack[i] = 0;
+}
+
+void realtime::setupCurrentThread(RealTimeConfiguration const& config)
+{
+    if (config.lock_memory)
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+            throw iodrivers_base::UnixError("failed to lock memory");
+        prefaultStack(config.stack_prefault_size);
+    }
+
+    if (config.cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config.cpu, &cpus);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (ret != 0)
+            throw iodrivers_base::UnixError("failed to set the thread's CPU affinity", ret);
+    }
+
+    if (config.priority > 0)
+    {
+        sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = config.priority;
+        int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (ret != 0)
+            throw iodrivers_base::UnixError("failed to switch the thread to SCHED_FIFO", ret);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef INDRA_HEADS_REAL_TIME_HPP
+#define INDRA_HEADS_REAL_TIME_HPP
+
+#include <cstddef>
+
+namespace indra_heads_protocol
+{
+    /** Configuration of the real-time operating mode
+     *
+     * The default configuration does nothing
+     */
+    struct RealTimeConfiguration
+    {
+        /** Lock all current and future pages of the process in memory */
+        bool lock_memory = false;
+
+        /** How much of the calling thread's stack should be touched after
+         * locking memory, so that it does not page-fault later
+         */
+        size_t stack_prefault_size = 64 * 1024;
+
+        /** The CPU the calling thread should be pinned to. Negative to leave
+         * the affinity unchanged
+         */
+        int cpu = -1;
+
+        /** The SCHED_FIFO priority of the calling thread. Zero to leave the
+         * scheduling policy unchanged
+         */
+        int priority = 0;
+    };
+
+    namespace realtime
+    {
+        /** Apply the real-time configuration to the calling thread
+         *
+         * This is meant to be called at start-up, from the thread that will
+         * do the I/O. It requires the corresponding privileges
+         * (CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK to lock memory,
+         * CAP_SYS_NICE or RLIMIT_RTPRIO for SCHED_FIFO)
+         *
+         * @throw iodrivers_base::UnixError if one of the settings could not
+         *   be applied
+         */
+        void setupCurrentThread(RealTimeConfiguration const& config);
+    }
+}
+
+#endif
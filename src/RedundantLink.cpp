@@ -0,0 +1,223 @@
+#include <indra_heads_protocol/RedundantLink.hpp>
+#include <poll.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+RedundantLink::RedundantLink(Driver& primary, Driver& backup)
+    : mDrivers { &primary, &backup }
+    , mActive(PRIMARY)
+    , mFailed { false, false }
+    , mFailoverThreshold(1)
+    , mMissedResponses(0)
+{
+}
+
+void RedundantLink::setFailoverThreshold(int missed_responses)
+{
+    if (missed_responses < 1)
+        throw std::invalid_argument("the failover threshold must be at least one");
+    mFailoverThreshold = missed_responses;
+}
+
+int RedundantLink::getFailoverThreshold() const
+{
+    return mFailoverThreshold;
+}
+
+RedundantLink::Link RedundantLink::other(Link link)
+{
+    return link == PRIMARY ? BACKUP : PRIMARY;
+}
+
+bool RedundantLink::isUsable(Link link) const
+{
+    return !mFailed[link] && mDrivers[link]->isValid();
+}
+
+void RedundantLink::markFailed(Link link)
+{
+    if (!mFailed[link])
+        ++mStatistics.link_errors;
+    mFailed[link] = true;
+}
+
+bool RedundantLink::failover()
+{
+    Link next = other(mActive);
+    if (!isUsable(next))
+        return false;
+    mActive = next;
+    mMissedResponses = 0;
+    ++mStatistics.failovers;
+    return true;
+}
+
+RedundantLink::Link RedundantLink::getActiveLink() const
+{
+    return mActive;
+}
+
+Driver& RedundantLink::getActiveDriver()
+{
+    return *mDrivers[mActive];
+}
+
+Driver& RedundantLink::getDriver(Link link)
+{
+    return *mDrivers[link];
+}
+
+void RedundantLink::setActiveLink(Link link)
+{
+    if (mFailed[link])
+        throw std::invalid_argument("cannot switch to a failed link");
+    mActive = link;
+    mMissedResponses = 0;
+}
+
+bool RedundantLink::isLinkFailed(Link link) const
+{
+    return mFailed[link];
+}
+
+void RedundantLink::restoreLink(Link link)
+{
+    mFailed[link] = false;
+}
+
+RedundantLinkStatistics const& RedundantLink::getStatistics() const
+{
+    return mStatistics;
+}
+
+void RedundantLink::send(SendFunction const& write)
+{
+    while (true)
+    {
+        if (isUsable(mActive))
+        {
+            try {
+                write(*mDrivers[mActive]);
+                return;
+            }
+            catch(iodrivers_base::UnixError&) {
+                markFailed(mActive);
+            }
+        }
+        if (!failover())
+            throw iodrivers_base::UnixError("both links failed");
+    }
+}
+
+bool RedundantLink::readResponses(Link link, CommandIDs command_id, Response& response)
+{
+    if (!isUsable(link))
+        return false;
+
+    try {
+        while (true)
+        {
+            Response received = mDrivers[link]->readResponse(base::Time());
+            if (received.command_id == command_id)
+            {
+                response = received;
+                return true;
+            }
+        }
+    }
+    catch(iodrivers_base::TimeoutError&) {
+    }
+    catch(iodrivers_base::UnixError&) {
+        markFailed(link);
+    }
+    return false;
+}
+
+bool RedundantLink::waitResponse(CommandIDs command_id, base::Time const& sent,
+                                 bool sample, Response& response)
+{
+    Link link = mActive;
+    RoundTripEstimator& round_trip = mDrivers[link]->getRoundTripEstimator();
+    base::Time deadline = sent + round_trip.getTimeout();
+    while (isUsable(link))
+    {
+        if (readResponses(link, command_id, response))
+        {
+            if (sample)
+                round_trip.addSample(base::Time::now() - sent);
+            return true;
+        }
+        if (readResponses(other(link), command_id, response))
+        {
+            ++mStatistics.standby_responses;
+            return true;
+        }
+
+        base::Time now = base::Time::now();
+        if (!(now < deadline))
+            break;
+
+        pollfd fds[2];
+        int fd_count = 0;
+        for (Link l : { link, other(link) })
+        {
+            if (isUsable(l))
+            {
+                fds[fd_count].fd = mDrivers[l]->getFileDescriptor();
+                fds[fd_count].events = POLLIN;
+                ++fd_count;
+            }
+        }
+        poll(fds, fd_count, (deadline - now).toMilliseconds() + 1);
+    }
+    round_trip.backoff();
+    return false;
+}
+
+Response RedundantLink::transact(SendFunction const& write, CommandIDs command_id, bool idempotent)
+{
+    // Karn's algorithm: only sample the first transmission on a link
+    bool sample = true;
+    // Resend on the other link at most once. When both links are up but
+    // the head is silent, switching back and forth would never end
+    bool failed_over = false;
+    while (true)
+    {
+        base::Time sent = base::Time::now();
+        send(write);
+
+        Response response;
+        if (waitResponse(command_id, sent, sample, response))
+        {
+            mMissedResponses = 0;
+            return response;
+        }
+
+        ++mStatistics.missed_responses;
+        ++mMissedResponses;
+        bool link_failed = mFailed[mActive];
+        if (link_failed || mMissedResponses >= mFailoverThreshold)
+        {
+            if (failover())
+            {
+                sample = true;
+                if (idempotent && !failed_over)
+                {
+                    failed_over = true;
+                    continue;
+                }
+            }
+            else if (link_failed)
+                throw iodrivers_base::UnixError("both links failed");
+        }
+        else if (idempotent)
+        {
+            sample = false;
+            continue;
+        }
+
+        throw iodrivers_base::TimeoutError(iodrivers_base::TimeoutError::PACKET,
+                                           "no response from the head");
+    }
+}
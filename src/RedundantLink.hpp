@@ -0,0 +1,144 @@
+#ifndef INDRA_HEADS_REDUNDANT_LINK_HPP
+#define INDRA_HEADS_REDUNDANT_LINK_HPP
+
+#include <indra_heads_protocol/Driver.hpp>
+#include <functional>
+
+namespace indra_heads_protocol
+{
+    struct RedundantLinkStatistics
+    {
+        /** Switches from one link to the other */
+        uint64_t failovers = 0;
+        /** Requests that got no response within the timeout */
+        uint64_t missed_responses = 0;
+        /** Responses to the pending request that arrived on the standby
+         * link, i.e. late responses to a request sent before a failover
+         */
+        uint64_t standby_responses = 0;
+        /** I/O errors, including end of stream, that marked a link failed */
+        uint64_t link_errors = 0;
+    };
+
+    /** Client side of a head connected through two links at the same time,
+     * e.g. Ethernet and serial
+     *
+     * Requests go through the active link. The requests switch to the other
+     * link after an I/O error (including the end of the stream) on the
+     * active link, or once it missed a number of consecutive responses (see
+     * setFailoverThreshold). The request that could not go through is sent
+     * again on the new link if it is idempotent, within the same
+     * transaction. A link that got an I/O error is failed.
+     *
+     * Each link is a Driver, which keeps its own framing state. While
+     * waiting for a response, both links are read: the standby link does
+     * not accumulate stale input, and a late response to the pending request
+     * is accepted on whichever link it arrives.
+     *
+     * Failed links stay unused until restoreLink is called, e.g. after
+     * reconnecting them.
+     */
+    class RedundantLink
+    {
+    public:
+        enum Link
+        {
+            PRIMARY = 0,
+            BACKUP = 1
+        };
+
+    private:
+        typedef std::function<void (Driver&)> SendFunction;
+
+        Driver* mDrivers[2];
+        Link mActive;
+        bool mFailed[2];
+        int mFailoverThreshold;
+        int mMissedResponses;
+        RedundantLinkStatistics mStatistics;
+
+        static Link other(Link link);
+        bool isUsable(Link link) const;
+        void markFailed(Link link);
+        /** Switch to the other link if it is usable */
+        bool failover();
+
+        /** Write on the active link, failing over on I/O errors
+         *
+         * @throw iodrivers_base::UnixError if both links failed
+         */
+        void send(SendFunction const& write);
+
+        /** Read the responses buffered on the given link
+         *
+         * @return true if one of them is for command_id
+         */
+        bool readResponses(Link link, CommandIDs command_id, Response& response);
+        bool waitResponse(CommandIDs command_id, base::Time const& sent,
+                          bool sample, Response& response);
+        Response transact(SendFunction const& write, CommandIDs command_id, bool idempotent);
+
+    public:
+        RedundantLink(Driver& primary, Driver& backup);
+
+        /** How many consecutive missed responses make the active link
+         * failed. The default is one, i.e. fail over on the first timeout
+         *
+         * This replaces the drivers' own retransmissions: idempotent
+         * requests are retransmitted on the active link until the threshold
+         * is reached, and then on the other link
+         */
+        void setFailoverThreshold(int missed_responses);
+        int getFailoverThreshold() const;
+
+        /** Write a request on the active link, without waiting for its
+         * response
+         */
+        template<typename T>
+        void sendRequest(T const& packet)
+        {
+            send([&packet](Driver& driver) { driver.sendRequest(packet); });
+        }
+
+        /** Send a request and wait for its response, failing over to the
+         * other link if needed
+         *
+         * An idempotent request is resent on the other link at most once,
+         * so a transaction lasts at most twice the failover threshold's
+         * worth of response timeouts
+         *
+         * @throw iodrivers_base::TimeoutError if no response arrived, in
+         *   which case the next request goes to the other link if the
+         *   failover threshold was reached
+         * @throw iodrivers_base::UnixError if both links failed
+         */
+        template<typename T>
+        Response transact(T const& packet)
+        {
+            CommandIDs command_id = static_cast<CommandIDs>(packet.command_id);
+            return transact([&packet](Driver& driver) { driver.sendRequest(packet); },
+                            command_id, packets::isIdempotent(command_id));
+        }
+
+        Link getActiveLink() const;
+        Driver& getActiveDriver();
+        Driver& getDriver(Link link);
+
+        /** Make the given link the active one
+         *
+         * @throw std::invalid_argument if the link is failed
+         */
+        void setActiveLink(Link link);
+
+        bool isLinkFailed(Link link) const;
+
+        /** Consider the link usable again, e.g. after it got reconnected.
+         * This does not change the active link
+         */
+        void restoreLink(Link link);
+
+        RedundantLinkStatistics const& getStatistics() const;
+    };
+}
+
+#endif
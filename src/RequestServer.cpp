@@ -0,0 +1,104 @@
+#include <indra_heads_protocol/RequestServer.hpp>
+#include <indra_heads_protocol/Multicast.hpp>
+#include <algorithm>
+#include <poll.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+RequestServer::RequestServer(Driver& driver, Handler handler, size_t max_burst_size)
+    : mDriver(driver)
+    , mHandler(handler)
+    , mMaxBurstSize(std::max<size_t>(max_burst_size, 1))
+    , mPublisher(nullptr)
+{
+    mResponses.reserve(mMaxBurstSize);
+}
+
+ServerStatistics const& RequestServer::getStatistics() const
+{
+    return mStatistics;
+}
+
+void RequestServer::setPublisher(MulticastPublisher* publisher)
+{
+    mPublisher = publisher;
+}
+
+void RequestServer::handle(CommandIDs command_id)
+{
+    // Bundles go to the handler as a single ID_BUNDLE request, with all
+    // their commands applied to the configuration
+    if (command_id == ID_FEATURES)
+    {
+        mResponses.push_back(Response {
+            ID_FEATURES, static_cast<ResponseStatus>(FEATURE_BUNDLE) });
+        return;
+    }
+
+    if (mPublisher)
+        mPublisher->publishRequest(mDriver);
+    ResponseStatus status = mHandler(command_id, mDriver.getRequestedConfiguration());
+    mResponses.push_back(Response { command_id, status });
+}
+
+bool RequestServer::hasPendingData() const
+{
+    if (mDriver.hasPacket())
+        return true;
+
+    int fd = mDriver.getFileDescriptor();
+    if (fd == -1)
+        return true;
+    pollfd pfd = { fd, POLLIN, 0 };
+    return poll(&pfd, 1, 0) == 1;
+}
+
+size_t RequestServer::serve(base::Time const& timeout)
+{
+    mResponses.clear();
+    try {
+        handle(mDriver.readRequest(timeout));
+    }
+    catch(iodrivers_base::TimeoutError&) {
+        return 0;
+    }
+
+    // Checking for data first avoids paying for a TimeoutError at the end
+    // of each burst
+    while (mResponses.size() < mMaxBurstSize && hasPendingData())
+    {
+        CommandIDs command_id;
+        try {
+            command_id = mDriver.readRequest(base::Time());
+        }
+        catch(iodrivers_base::TimeoutError&) {
+            break;
+        }
+        handle(command_id);
+    }
+
+    mDriver.writeResponses(mResponses.data(), mResponses.size());
+    if (mPublisher)
+    {
+        base::Time now = base::Time::now();
+        for (auto const& response : mResponses)
+        {
+            if (response.command_id != ID_FEATURES)
+                mPublisher->publishResponse(response, now);
+        }
+        mPublisher->flush();
+    }
+
+    size_t count = mResponses.size();
+    mStatistics.requests += count;
+    ++mStatistics.bursts;
+    mStatistics.max_burst_size = std::max<uint64_t>(mStatistics.max_burst_size, count);
+    return count;
+}
+
+void RequestServer::run()
+{
+    while (true)
+        serve(base::Time::fromSeconds(1));
+}
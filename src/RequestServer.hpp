@@ -0,0 +1,92 @@
+#ifndef INDRA_HEADS_REQUEST_SERVER_HPP
+#define INDRA_HEADS_REQUEST_SERVER_HPP
+
+#include <indra_heads_protocol/Driver.hpp>
+#include <functional>
+#include <vector>
+
+namespace indra_heads_protocol
+{
+    class MulticastPublisher;
+
+    struct ServerStatistics
+    {
+        /** Requests handled */
+        uint64_t requests = 0;
+        /** Bursts of requests, i.e. response writes */
+        uint64_t bursts = 0;
+        /** Largest number of requests handled in a single burst */
+        uint64_t max_burst_size = 0;
+    };
+
+    /** Head-side serving loop with batched responses
+     *
+     * Each call to serve() waits for a request, then drains the requests
+     * that are already available without blocking. Every request goes
+     * through Driver::readRequest - so the requested configuration, its
+     * history and the watchdog are updated as usual - and is given to the
+     * handler, which returns the response status. The responses of the
+     * whole burst are then written with a single Driver::writeResponses.
+     *
+     * The server answers feature queries itself, advertising bundles. The
+     * handler gets a bundle as a single ID_BUNDLE request.
+     *
+     * Compared to a readRequest / writeResponse loop, this saves one write
+     * per request when clients pipeline them; see the 'serving' benchmark.
+     */
+    class RequestServer
+    {
+    public:
+        typedef std::function<ResponseStatus (CommandIDs, RequestedConfiguration const&)> Handler;
+
+    private:
+        Driver& mDriver;
+        Handler mHandler;
+        size_t mMaxBurstSize;
+        std::vector<Response> mResponses;
+        ServerStatistics mStatistics;
+        MulticastPublisher* mPublisher;
+
+        void handle(CommandIDs command_id);
+        /** Whether the driver has buffered packets or its file descriptor is
+         * readable. Streams without a file descriptor are always assumed
+         * readable
+         */
+        bool hasPendingData() const;
+
+    public:
+        /**
+         * @param max_burst_size the maximum number of requests handled
+         *   before the responses are written
+         */
+        RequestServer(Driver& driver, Handler handler, size_t max_burst_size = 64);
+
+        /** Serve one burst of requests
+         *
+         * Exceptions other than timeouts, from the driver or the handler,
+         * are passed through. The responses of the burst that were not
+         * written yet are then lost.
+         *
+         * @param timeout how long to wait for the first request
+         * @return the number of requests handled, zero on timeout
+         */
+        size_t serve(base::Time const& timeout);
+
+        /** Serve requests until the connection fails or gets closed
+         *
+         * @throw the exception that terminated the connection
+         */
+        void run();
+
+        ServerStatistics const& getStatistics() const;
+
+        /** Publish the decoded requests and their responses
+         *
+         * The records of a burst are sent together, after its responses.
+         * The publisher is not owned. Pass nullptr to stop publishing
+         */
+        void setPublisher(MulticastPublisher* publisher);
+    };
+}
+
+#endif
@@ -0,0 +1,74 @@
+#include <indra_heads_protocol/RoundTripEstimator.hpp>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+RoundTripEstimator::RoundTripEstimator(base::Time const& initial_timeout,
+                                       base::Time const& min_timeout,
+                                       base::Time const& max_timeout)
+    : mInitialTimeout(initial_timeout)
+    , mMinTimeout(min_timeout)
+    , mMaxTimeout(max_timeout)
+{
+    reset();
+}
+
+void RoundTripEstimator::reset()
+{
+    mSmoothedRTT = base::Time();
+    mRTTVariation = base::Time();
+    mHasSamples = false;
+    setTimeout(mInitialTimeout);
+}
+
+void RoundTripEstimator::setTimeout(base::Time const& timeout)
+{
+    mTimeout = std::max(mMinTimeout, std::min(mMaxTimeout, timeout));
+}
+
+void RoundTripEstimator::addSample(base::Time const& rtt)
+{
+    if (!mHasSamples)
+    {
+        mSmoothedRTT = rtt;
+        mRTTVariation = base::Time::fromMicroseconds(rtt.toMicroseconds() / 2);
+        mHasSamples = true;
+    }
+    else
+    {
+        int64_t srtt = mSmoothedRTT.toMicroseconds();
+        int64_t deviation = std::abs(srtt - rtt.toMicroseconds());
+        mRTTVariation = base::Time::fromMicroseconds(
+            (3 * mRTTVariation.toMicroseconds() + deviation) / 4);
+        mSmoothedRTT = base::Time::fromMicroseconds(
+            (7 * srtt + rtt.toMicroseconds()) / 8);
+    }
+    setTimeout(mSmoothedRTT + base::Time::fromMicroseconds(4 * mRTTVariation.toMicroseconds()));
+}
+
+void RoundTripEstimator::backoff()
+{
+    setTimeout(base::Time::fromMicroseconds(2 * mTimeout.toMicroseconds()));
+}
+
+bool RoundTripEstimator::hasSamples() const
+{
+    return mHasSamples;
+}
+
+base::Time RoundTripEstimator::getSmoothedRTT() const
+{
+    return mSmoothedRTT;
+}
+
+base::Time RoundTripEstimator::getRTTVariation() const
+{
+    return mRTTVariation;
+}
+
+base::Time RoundTripEstimator::getTimeout() const
+{
+    return mTimeout;
+}
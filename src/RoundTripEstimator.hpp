@@ -0,0 +1,56 @@
+#ifndef INDRA_HEADS_ROUND_TRIP_ESTIMATOR_HPP
+#define INDRA_HEADS_ROUND_TRIP_ESTIMATOR_HPP
+
+#include <base/Time.hpp>
+
+namespace indra_heads_protocol
+{
+    /** Smoothed round-trip time estimation, following TCP's (RFC 6298)
+     *
+     * The response timeout is SRTT + 4 * RTTVAR, clamped between the
+     * minimum and maximum timeouts. Until the first sample, it is the
+     * initial timeout. Each timeout doubles it (exponential backoff) until
+     * the next sample.
+     */
+    class RoundTripEstimator
+    {
+        base::Time mInitialTimeout;
+        base::Time mMinTimeout;
+        base::Time mMaxTimeout;
+        base::Time mSmoothedRTT;
+        base::Time mRTTVariation;
+        base::Time mTimeout;
+        bool mHasSamples;
+
+        void setTimeout(base::Time const& timeout);
+
+    public:
+        RoundTripEstimator(
+            base::Time const& initial_timeout = base::Time::fromSeconds(1),
+            base::Time const& min_timeout = base::Time::fromMilliseconds(10),
+            base::Time const& max_timeout = base::Time::fromSeconds(10));
+
+        /** Forget all samples, e.g. on reconnection */
+        void reset();
+
+        /** Update the estimate with a measured round-trip time
+         *
+         * Following Karn's algorithm, do not add samples for requests that
+         * have been retransmitted, as one cannot know which transmission the
+         * response is for.
+         */
+        void addSample(base::Time const& rtt);
+
+        /** Double the timeout after a request timed out */
+        void backoff();
+
+        bool hasSamples() const;
+        base::Time getSmoothedRTT() const;
+        base::Time getRTTVariation() const;
+
+        /** How long to wait for the response to a request */
+        base::Time getTimeout() const;
+    };
+}
+
+#endif
@@ -0,0 +1,266 @@
+#include <indra_heads_protocol/SetpointScheduler.hpp>
+#include <iodrivers_base/Exceptions.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+static base::Time monotonicNow()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return base::Time::fromMicroseconds(
+        static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000);
+}
+
+static timespec toTimespec(base::Time const& time)
+{
+    timespec ts;
+    ts.tv_sec  = time.toMicroseconds() / 1000000;
+    ts.tv_nsec = (time.toMicroseconds() % 1000000) * 1000;
+    return ts;
+}
+
+static bool isAngleCommand(CommandIDs command_id)
+{
+    return command_id == ID_ANGLES_RELATIVE || command_id == ID_ANGLES_GEO;
+}
+
+static bool isVelocityCommand(CommandIDs command_id)
+{
+    return command_id == ID_ANGULAR_VELOCITY_RELATIVE ||
+        command_id == ID_ANGULAR_VELOCITY_GEO;
+}
+
+static double interpolateAngle(double from, double to, double ratio)
+{
+    double delta = std::remainder(to - from, 2 * M_PI);
+    return std::remainder(from + delta * ratio, 2 * M_PI);
+}
+
+Setpoint indra_heads_protocol::interpolate(Trajectory const& trajectory, base::Time const& time)
+{
+    if (trajectory.empty())
+        throw std::invalid_argument("cannot interpolate an empty trajectory");
+
+    auto after = std::upper_bound(trajectory.begin(), trajectory.end(), time,
+        [](base::Time const& t, Setpoint const& s) { return t < s.time; });
+    if (after == trajectory.begin())
+        return trajectory.front();
+    else if (after == trajectory.end())
+        return trajectory.back();
+
+    Setpoint const& from = *(after - 1);
+    Setpoint const& to   = *after;
+    double ratio = (time - from.time).toSeconds() / (to.time - from.time).toSeconds();
+
+    Setpoint result = from;
+    result.time = time;
+    if (isAngleCommand(from.command_id))
+    {
+        for (int i = 0; i < 3; ++i)
+            result.rpy[i] = interpolateAngle(from.rpy[i], to.rpy[i], ratio);
+    }
+    else if (isVelocityCommand(from.command_id))
+        result.rpy = from.rpy + (to.rpy - from.rpy) * ratio;
+    else
+    {
+        result.lat_lon_alt = GeoTarget(
+            from.lat_lon_alt.latitude + (to.lat_lon_alt.latitude - from.lat_lon_alt.latitude) * ratio,
+            from.lat_lon_alt.longitude + (to.lat_lon_alt.longitude - from.lat_lon_alt.longitude) * ratio,
+            from.lat_lon_alt.altitude + (to.lat_lon_alt.altitude - from.lat_lon_alt.altitude) * ratio);
+    }
+    return result;
+}
+
+SetpointScheduler::SetpointScheduler(Driver& driver, base::Time const& period)
+    : mDriver(driver)
+    , mPeriod(period)
+    , mTimerFD(-1)
+    , mTickIndex(0)
+    , mJitterSum(0)
+    , mJitterSquaredSum(0)
+{
+    if (period <= base::Time())
+        throw std::invalid_argument("the scheduler period must be strictly positive");
+
+    mTimerFD = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (mTimerFD == -1)
+        throw iodrivers_base::UnixError("failed to create the scheduler's timerfd");
+}
+
+SetpointScheduler::~SetpointScheduler()
+{
+    ::close(mTimerFD);
+}
+
+void SetpointScheduler::setTrajectory(Trajectory const& trajectory)
+{
+    if (trajectory.empty())
+        throw std::invalid_argument("empty trajectory");
+
+    CommandIDs command_id = trajectory.front().command_id;
+    if (!isAngleCommand(command_id) && !isVelocityCommand(command_id) &&
+        command_id != ID_STABILIZATION_TARGET)
+        throw std::invalid_argument("trajectories can only contain angle, angular velocity or stabilization target setpoints");
+
+    for (size_t i = 1; i < trajectory.size(); ++i)
+    {
+        if (trajectory[i].command_id != command_id)
+            throw std::invalid_argument("all setpoints of a trajectory must use the same command");
+        else if (trajectory[i].time < trajectory[i - 1].time)
+            throw std::invalid_argument("trajectory setpoints must be sorted by time");
+    }
+
+    itimerspec disarm = {};
+    timerfd_settime(mTimerFD, 0, &disarm, nullptr);
+
+    mTrajectory = trajectory;
+    mStats = SchedulerStatistics();
+    mJitterSum = 0;
+    mJitterSquaredSum = 0;
+}
+
+void SetpointScheduler::start()
+{
+    if (mTrajectory.empty())
+        throw std::logic_error("call setTrajectory before start");
+
+    mStart = monotonicNow();
+    mTickIndex = 0;
+
+    itimerspec spec;
+    spec.it_value    = toTimespec(mStart);
+    spec.it_interval = toTimespec(mPeriod);
+    if (timerfd_settime(mTimerFD, TFD_TIMER_ABSTIME, &spec, nullptr) == -1)
+        throw iodrivers_base::UnixError("failed to arm the scheduler's timerfd");
+}
+
+void SetpointScheduler::waitForTick()
+{
+    pollfd fds[2];
+    fds[0].fd = mTimerFD;
+    fds[0].events = POLLIN;
+    fds[1].fd = mDriver.getFileDescriptor();
+    fds[1].events = POLLIN;
+    int fd_count = fds[1].fd < 0 ? 1 : 2;
+
+    while (true)
+    {
+        int ret = poll(fds, fd_count, -1);
+        if (ret == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            throw iodrivers_base::UnixError("poll failed in SetpointScheduler");
+        }
+
+        if (fd_count == 2 && fds[1].revents)
+            readResponses();
+        if (fds[0].revents & POLLIN)
+            return;
+    }
+}
+
+void SetpointScheduler::readResponses()
+{
+    while (true)
+    {
+        Response response;
+        try {
+            response = mDriver.readResponse(base::Time());
+        }
+        catch(iodrivers_base::TimeoutError&) {
+            return;
+        }
+
+        if (response.status == STATUS_OK)
+            ++mStats.acknowledged;
+        else
+            ++mStats.rejected;
+    }
+}
+
+void SetpointScheduler::updateJitter(base::Time const& jitter)
+{
+    if (mStats.ticks == 0 || jitter < mStats.jitter_min)
+        mStats.jitter_min = jitter;
+    if (mStats.ticks == 0 || jitter > mStats.jitter_max)
+        mStats.jitter_max = jitter;
+
+    ++mStats.ticks;
+    double value = jitter.toSeconds();
+    mJitterSum += value;
+    mJitterSquaredSum += value * value;
+
+    double mean = mJitterSum / mStats.ticks;
+    double variance = std::max(0.0, mJitterSquaredSum / mStats.ticks - mean * mean);
+    mStats.jitter_mean   = base::Time::fromSeconds(mean);
+    mStats.jitter_stddev = base::Time::fromSeconds(std::sqrt(variance));
+}
+
+void SetpointScheduler::send(Setpoint const& setpoint)
+{
+    Eigen::Vector3d const& rpy = setpoint.rpy;
+    switch(setpoint.command_id)
+    {
+        case ID_ANGLES_RELATIVE:
+            mDriver.sendRequest(requests::AnglesRelative(rpy.z(), rpy.y(), rpy.x()));
+            break;
+        case ID_ANGLES_GEO:
+            mDriver.sendRequest(requests::AnglesGeo(rpy.z(), rpy.y(), rpy.x()));
+            break;
+        case ID_ANGULAR_VELOCITY_RELATIVE:
+            mDriver.sendRequest(requests::AngularVelocityRelative(rpy.z(), rpy.y(), rpy.x()));
+            break;
+        case ID_ANGULAR_VELOCITY_GEO:
+            mDriver.sendRequest(requests::AngularVelocityGeo(rpy.z(), rpy.y(), rpy.x()));
+            break;
+        case ID_STABILIZATION_TARGET:
+            mDriver.sendRequest(requests::PositionGeo(
+                setpoint.lat_lon_alt.latitude,
+                setpoint.lat_lon_alt.longitude,
+                setpoint.lat_lon_alt.altitude));
+            break;
+        default:
+            throw std::logic_error("should never have reached this");
+    }
+}
+
+bool SetpointScheduler::step()
+{
+    waitForTick();
+
+    uint64_t expirations = 0;
+    if (::read(mTimerFD, &expirations, sizeof(expirations)) != sizeof(expirations))
+        throw iodrivers_base::UnixError("failed to read the scheduler's timerfd");
+
+    base::Time now = monotonicNow();
+    mTickIndex += expirations;
+    mStats.missed_ticks += expirations - 1;
+    base::Time deadline = mStart + mPeriod * static_cast<double>(mTickIndex - 1);
+    updateJitter(now - deadline);
+
+    base::Time elapsed = now - mStart;
+    send(interpolate(mTrajectory, elapsed));
+    return elapsed < mTrajectory.back().time;
+}
+
+void SetpointScheduler::run()
+{
+    start();
+    while (step());
+
+    itimerspec disarm = {};
+    timerfd_settime(mTimerFD, 0, &disarm, nullptr);
+}
+
+SchedulerStatistics SetpointScheduler::getStatistics() const
+{
+    return mStats;
+}
@@ -0,0 +1,142 @@
+#ifndef INDRA_HEADS_SETPOINT_SCHEDULER_HPP
+#define INDRA_HEADS_SETPOINT_SCHEDULER_HPP
+
+#include <indra_heads_protocol/Driver.hpp>
+#include <base/Eigen.hpp>
+#include <base/Time.hpp>
+#include <vector>
+
+namespace indra_heads_protocol
+{
+    /** A time-stamped setpoint of a trajectory
+     */
+    struct Setpoint
+    {
+        /** Time of the setpoint, relative to the start of the trajectory */
+        base::Time time;
+
+        /** The command used to send the setpoint. One of the ID_ANGLES_*,
+         * ID_ANGULAR_VELOCITY_* or ID_STABILIZATION_TARGET
+         */
+        CommandIDs command_id;
+
+        /** Roll/pitch/yaw angles or angular velocities, for the angle and
+         * angular velocity commands
+         */
+        base::Vector3d rpy;
+
+        /** Target for ID_STABILIZATION_TARGET
+         */
+        GeoTarget lat_lon_alt;
+
+        Setpoint()
+            : command_id(ID_STOP)
+            , rpy(base::unset<base::Vector3d>()) {}
+    };
+
+    typedef std::vector<Setpoint> Trajectory;
+
+    /** Setpoint of the trajectory at the given time
+     *
+     * Angles are interpolated along the shortest arc, velocities and geodetic
+     * targets linearly. The trajectory is held constant before its first
+     * and after its last sample.
+     */
+    Setpoint interpolate(Trajectory const& trajectory, base::Time const& time);
+
+    /** Jitter statistics of a SetpointScheduler
+     *
+     * The jitter is the difference between the time at which a setpoint got
+     * sent and the deadline of its tick
+     */
+    struct SchedulerStatistics
+    {
+        /** Number of setpoints sent */
+        uint64_t ticks = 0;
+        /** Number of deadlines that expired without a setpoint being sent,
+         * because the consumer was late
+         */
+        uint64_t missed_ticks = 0;
+        /** Responses received with STATUS_OK */
+        uint64_t acknowledged = 0;
+        /** Responses received with a status other than STATUS_OK */
+        uint64_t rejected = 0;
+
+        base::Time jitter_min;
+        base::Time jitter_max;
+        base::Time jitter_mean;
+        base::Time jitter_stddev;
+    };
+
+    /** Streams a trajectory of setpoints to a head at a fixed rate
+     *
+     * Ticks are generated on absolute deadlines by a timerfd on the monotonic
+     * clock, so that the period does not drift with the time spent sending.
+     * On each tick, the setpoint sent is the trajectory interpolated at the
+     * actual send time, which means that a late consumer still sends the
+     * setpoint that is valid <i>now</i>.
+     *
+     * Responses from the head are read while waiting for the next deadline
+     * and accounted in the statistics.
+     *
+     * <code>
+     * SetpointScheduler scheduler(driver, base::Time::fromMilliseconds(10));
+     * scheduler.setTrajectory(trajectory);
+     * scheduler.run();
+     * </code>
+     */
+    class SetpointScheduler
+    {
+        Driver& mDriver;
+        base::Time mPeriod;
+        int mTimerFD;
+
+        Trajectory mTrajectory;
+        base::Time mStart;
+        uint64_t mTickIndex;
+
+        SchedulerStatistics mStats;
+        double mJitterSum;
+        double mJitterSquaredSum;
+
+        void waitForTick();
+        void readResponses();
+        void updateJitter(base::Time const& jitter);
+        void send(Setpoint const& setpoint);
+
+    public:
+        SetpointScheduler(Driver& driver, base::Time const& period);
+        ~SetpointScheduler();
+
+        SetpointScheduler(SetpointScheduler const&) = delete;
+        SetpointScheduler& operator=(SetpointScheduler const&) = delete;
+
+        /** Set the trajectory to stream
+         *
+         * All setpoints must use the same command and be sorted by time.
+         * It resets the statistics and stops the current streaming, if there
+         * is one. Call start() to start streaming it.
+         */
+        void setTrajectory(Trajectory const& trajectory);
+
+        /** Start streaming the current trajectory, with the first deadline
+         * being now
+         */
+        void start();
+
+        /** Wait for the next deadline and send the corresponding setpoint
+         *
+         * @return false once the last setpoint of the trajectory has been
+         *   sent
+         */
+        bool step();
+
+        /** Start and stream the whole trajectory */
+        void run();
+
+        /** Returns the statistics since the last call to setTrajectory */
+        SchedulerStatistics getStatistics() const;
+    };
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include <indra_heads_protocol/SimulatedHead.hpp>
+#include <indra_heads_protocol/Multicast.hpp>
+#include <chrono>
+#include <poll.h>
+#include <thread>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+SimulatedHead::SimulatedHead(Driver& driver, SimulatedHeadConfiguration const& configuration)
+    : mDriver(driver)
+    , mConfiguration(configuration)
+    , mRNG(configuration.seed)
+    , mDroppedResponses(0)
+    , mPublisher(nullptr)
+{
+    if (!configuration.setpoint_timeout.isNull())
+    {
+        mDriver.setSetpointTimeout(RequestedConfiguration::ANGULAR_VELOCITY_RELATIVE,
+                                   configuration.setpoint_timeout);
+        mDriver.setSetpointTimeout(RequestedConfiguration::ANGULAR_VELOCITY_GEO,
+                                   configuration.setpoint_timeout);
+    }
+}
+
+uint64_t SimulatedHead::getDroppedResponseCount() const
+{
+    return mDroppedResponses;
+}
+
+void SimulatedHead::setPublisher(MulticastPublisher* publisher)
+{
+    mPublisher = publisher;
+}
+
+void SimulatedHead::run()
+{
+    pollfd fds[2];
+    fds[0].fd = mDriver.getFileDescriptor();
+    fds[0].events = POLLIN;
+    fds[1].fd = mDriver.getWatchdogFileDescriptor();
+    fds[1].events = POLLIN;
+    int fd_count = fds[1].fd == -1 ? 1 : 2;
+    base::Time read_timeout = fd_count == 2 ? base::Time() : base::Time::fromSeconds(1);
+    // Whether the driver has no more buffered packets, in which case we can
+    // wait on its file descriptor
+    bool drained = true;
+    while (true)
+    {
+        if (fd_count == 2 && drained)
+        {
+            fds[0].revents = fds[1].revents = 0;
+            poll(fds, fd_count, -1);
+            if (fds[1].revents & POLLIN)
+                mDriver.processWatchdog();
+            if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+        }
+
+        CommandIDs command_id;
+        try {
+            command_id = mDriver.readRequest(read_timeout);
+            drained = false;
+        }
+        catch(iodrivers_base::TimeoutError&) {
+            drained = true;
+            continue;
+        }
+        handleRequest(command_id);
+    }
+}
+
+void SimulatedHead::handleRequest(CommandIDs command_id)
+{
+    bool extension = command_id == ID_FEATURES || command_id == ID_BUNDLE;
+    if (extension && !mConfiguration.extensions)
+        return;
+
+    if (mPublisher && !extension)
+        mPublisher->publishRequest(mDriver);
+
+    if (mConfiguration.loss > 0 &&
+        std::uniform_real_distribution<double>(0, 1)(mRNG) < mConfiguration.loss)
+    {
+        ++mDroppedResponses;
+        return;
+    }
+
+    int64_t delay = mConfiguration.delay.toMicroseconds();
+    if (!mConfiguration.jitter.isNull())
+    {
+        delay += std::uniform_int_distribution<int64_t>(
+            0, mConfiguration.jitter.toMicroseconds())(mRNG);
+    }
+    if (delay > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(delay));
+    if (command_id == ID_FEATURES)
+        mDriver.writeFeatures(FEATURE_BUNDLE);
+    else
+        mDriver.writeResponse(Response { command_id, STATUS_OK });
+
+    if (mPublisher)
+    {
+        if (!extension)
+            mPublisher->publishResponse(Response { command_id, STATUS_OK }, base::Time::now());
+        mPublisher->flush();
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef INDRA_HEADS_SIMULATED_HEAD_HPP
+#define INDRA_HEADS_SIMULATED_HEAD_HPP
+
+#include <indra_heads_protocol/Driver.hpp>
+#include <random>
+
+namespace indra_heads_protocol
+{
+    class MulticastPublisher;
+
+    struct SimulatedHeadConfiguration
+    {
+        /** Fixed delay before each response */
+        base::Time delay;
+        /** Maximum of a uniformly distributed random delay added to each
+         * response
+         */
+        base::Time jitter;
+        /** Setpoint timeout of the velocity modes, null to disable the
+         * watchdog (see Driver::setSetpointTimeout)
+         */
+        base::Time setpoint_timeout;
+        /** Probability to never answer a request */
+        double loss = 0;
+        /** Seed of the random generator used for jitter and losses */
+        unsigned int seed = 0;
+        /** Whether to support the protocol extensions. When false, the
+         * head behaves as one that predates them and never answers
+         * ID_FEATURES or ID_BUNDLE
+         */
+        bool extensions = true;
+    };
+
+    /** Head side of a connection that answers STATUS_OK to every request
+     *
+     * This is the core of indra_heads_protocol_sim. It is part of the
+     * library so that client-side behaviour (timeouts, retransmissions) can
+     * be tested against it in-process.
+     */
+    class SimulatedHead
+    {
+        Driver& mDriver;
+        SimulatedHeadConfiguration mConfiguration;
+        std::mt19937 mRNG;
+        uint64_t mDroppedResponses;
+        MulticastPublisher* mPublisher;
+
+        void handleRequest(CommandIDs command_id);
+
+    public:
+        SimulatedHead(Driver& driver, SimulatedHeadConfiguration const& configuration);
+
+        /** Serve requests until the connection fails or gets closed
+         *
+         * @throw the exception that terminated the connection
+         */
+        void run();
+
+        /** How many responses have been dropped to simulate losses */
+        uint64_t getDroppedResponseCount() const;
+
+        /** Publish the decoded requests and the responses, one datagram per
+         * request. The publisher is not owned
+         */
+        void setPublisher(MulticastPublisher* publisher);
+    };
+}
+
+#endif
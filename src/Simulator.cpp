@@ -0,0 +1,173 @@
+#include <indra_heads_protocol/SimulatedHead.hpp>
+#include <indra_heads_protocol/Multicast.hpp>
+#include <iodrivers_base/IOStream.hpp>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <netinet/in.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+void usage()
+{
+    std::cout
+        << "usage: indra_heads_protocol_sim [OPTIONS] [PORT]\n"
+        << "\n"
+        << "Simulates a head: waits for connections on PORT (default 17001) and\n"
+        << "answers every request with OK\n"
+        << "\n"
+        << "Options:\n"
+        << "  --delay MS    delay every response by MS milliseconds\n"
+        << "  --jitter MS   add a uniformly distributed random delay between 0 and MS\n"
+        << "                milliseconds to every response\n"
+        << "  --watchdog MS stop the head when no new velocity setpoint arrived within\n"
+        << "                MS milliseconds\n"
+        << "  --loss PCT    do not answer PCT percent of the requests\n"
+        << "  --legacy      behave as a head without the protocol extensions (feature\n"
+        << "                negotiation and bundles)\n"
+        << "  --multicast GROUP:PORT\n"
+        << "                publish the decoded requests and the responses to the given\n"
+        << "                UDP multicast group\n"
+        << "  --multicast-interface ADDRESS\n"
+        << "                publish on the interface with this address, e.g. 127.0.0.1\n"
+        << std::endl;
+}
+
+base::Time fromMilliseconds(std::string const& arg)
+{
+    return base::Time::fromMicroseconds(std::stod(arg) * 1000);
+}
+
+struct MulticastConfiguration
+{
+    std::string group;
+    int port = 0;
+    MulticastPublisherConfiguration publisher;
+};
+
+void handleClient(int client_fd, SimulatedHeadConfiguration conf,
+                  MulticastConfiguration multicast)
+{
+    Driver driver;
+    driver.setMainStream(new iodrivers_base::FDStream(client_fd, true));
+    driver.setReadTimeout(base::Time::fromSeconds(1));
+
+    conf.seed = client_fd;
+    SimulatedHead head(driver, conf);
+    try {
+        // One publisher, i.e. one session, per connection
+        std::unique_ptr<MulticastPublisher> publisher;
+        if (!multicast.group.empty())
+        {
+            publisher.reset(new MulticastPublisher(
+                multicast.group, multicast.port, multicast.publisher));
+            head.setPublisher(publisher.get());
+        }
+        head.run();
+    }
+    catch(std::exception& e) {
+        std::cout
+            << "connection " << client_fd << " closed: " << e.what() << "\n"
+            << "  " << driver.getWatchdogStopCount() << " watchdog stops, "
+            << head.getDroppedResponseCount() << " dropped responses"
+            << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int port = 17001;
+    SimulatedHeadConfiguration conf;
+    MulticastConfiguration multicast;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--help") {
+            usage();
+            return 0;
+        }
+        else if (arg == "--delay" && i + 1 < argc) {
+            conf.delay = fromMilliseconds(argv[++i]);
+        }
+        else if (arg == "--jitter" && i + 1 < argc) {
+            conf.jitter = fromMilliseconds(argv[++i]);
+        }
+        else if (arg == "--watchdog" && i + 1 < argc) {
+            conf.setpoint_timeout = fromMilliseconds(argv[++i]);
+        }
+        else if (arg == "--loss" && i + 1 < argc) {
+            conf.loss = std::stod(argv[++i]) / 100;
+        }
+        else if (arg == "--legacy") {
+            conf.extensions = false;
+        }
+        else if (arg == "--multicast" && i + 1 < argc) {
+            string address = argv[++i];
+            size_t colon = address.rfind(':');
+            if (colon == string::npos) {
+                usage();
+                return 1;
+            }
+            multicast.group = address.substr(0, colon);
+            multicast.port = std::stol(address.substr(colon + 1));
+        }
+        else if (arg == "--multicast-interface" && i + 1 < argc) {
+            multicast.publisher.interface = argv[++i];
+        }
+        else {
+            port = std::stol(arg);
+        }
+    }
+
+    if (!multicast.group.empty())
+    {
+        try {
+            MulticastPublisher check(multicast.group, multicast.port, multicast.publisher);
+        }
+        catch(std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0)
+    {
+        std::cerr << "setsockopt(SO_REUSEADDR) failed" << std::endl;
+        std::cerr << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(server_fd, (sockaddr*)&server_addr, sizeof(server_addr)) < 0 ||
+        listen(server_fd, 64) < 0)
+    {
+        std::cerr << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::cout << "Simulated head waiting for connections on port " << port << std::endl;
+    while (true)
+    {
+        int client_fd = accept(server_fd, nullptr, nullptr);
+        if (client_fd == -1)
+        {
+            std::cerr << strerror(errno) << std::endl;
+            usleep(100000);
+            continue;
+        }
+        std::thread(handleClient, client_fd, conf, multicast).detach();
+    }
+    return 0;
+}
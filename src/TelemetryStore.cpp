@@ -0,0 +1,373 @@
+#include <indra_heads_protocol/TelemetryStore.hpp>
+#include <iodrivers_base/Exceptions.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+using telemetry::COLUMN_COUNT;
+
+namespace
+{
+    static const uint32_t BLOCK_MAGIC = 0x4d4c5449; // "ITLM"
+
+    struct BlockHeader
+    {
+        uint32_t magic;
+        uint32_t count;
+        int64_t first_time;
+        int64_t last_time;
+        /** Value of each column in the first record */
+        int64_t bases[COLUMN_COUNT];
+        /** Size of each column's encoded differences, zero if the column
+         * is constant within the block
+         */
+        uint32_t sizes[COLUMN_COUNT];
+    };
+
+    static_assert(sizeof(BlockHeader) == 168, "BlockHeader is expected to have no padding");
+
+    enum Columns
+    {
+        COLUMN_TIME,
+        COLUMN_LATITUDE,
+        COLUMN_LONGITUDE,
+        COLUMN_ALTITUDE,
+        COLUMN_ROLL,
+        COLUMN_PITCH,
+        COLUMN_YAW,
+        COLUMN_COMMAND_ID,
+        COLUMN_RATE_STATUS_PT,
+        COLUMN_RATE_STATUS_IMU,
+        COLUMN_CONTROL_MODE,
+        COLUMN_FLAGS
+    };
+    static_assert(COLUMN_FLAGS + 1 == COLUMN_COUNT, "column count mismatch");
+
+    int64_t getField(ConfigurationSnapshot const& record, int column)
+    {
+        switch(column)
+        {
+            case COLUMN_TIME: return record.time;
+            case COLUMN_LATITUDE: return record.latitude;
+            case COLUMN_LONGITUDE: return record.longitude;
+            case COLUMN_ALTITUDE: return record.altitude;
+            case COLUMN_ROLL: return record.rpy[0];
+            case COLUMN_PITCH: return record.rpy[1];
+            case COLUMN_YAW: return record.rpy[2];
+            case COLUMN_COMMAND_ID: return record.command_id;
+            case COLUMN_RATE_STATUS_PT: return record.rate_status_pt;
+            case COLUMN_RATE_STATUS_IMU: return record.rate_status_imu;
+            case COLUMN_CONTROL_MODE: return record.control_mode;
+            default: return record.flags;
+        }
+    }
+
+    void setField(ConfigurationSnapshot& record, int column, int64_t value)
+    {
+        switch(column)
+        {
+            case COLUMN_TIME: record.time = value; break;
+            case COLUMN_LATITUDE: record.latitude = value; break;
+            case COLUMN_LONGITUDE: record.longitude = value; break;
+            case COLUMN_ALTITUDE: record.altitude = value; break;
+            case COLUMN_ROLL: record.rpy[0] = value; break;
+            case COLUMN_PITCH: record.rpy[1] = value; break;
+            case COLUMN_YAW: record.rpy[2] = value; break;
+            case COLUMN_COMMAND_ID: record.command_id = value; break;
+            case COLUMN_RATE_STATUS_PT: record.rate_status_pt = value; break;
+            case COLUMN_RATE_STATUS_IMU: record.rate_status_imu = value; break;
+            case COLUMN_CONTROL_MODE: record.control_mode = value; break;
+            default: record.flags = value; break;
+        }
+    }
+
+    void appendVarint(std::vector<uint8_t>& buffer, int64_t value)
+    {
+        // Zigzag, so that small negative values are small too
+        uint64_t encoded = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        while (encoded >= 0x80)
+        {
+            buffer.push_back(static_cast<uint8_t>(encoded) | 0x80);
+            encoded >>= 7;
+        }
+        buffer.push_back(static_cast<uint8_t>(encoded));
+    }
+
+    uint8_t const* readVarint(uint8_t const* data, uint8_t const* end, int64_t& value)
+    {
+        uint64_t encoded = 0;
+        for (int shift = 0; data != end && shift < 64; shift += 7)
+        {
+            uint8_t byte = *data++;
+            encoded |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                value = static_cast<int64_t>(encoded >> 1) ^ -static_cast<int64_t>(encoded & 1);
+                return data;
+            }
+        }
+        throw std::runtime_error("corrupted telemetry block");
+    }
+
+    /** The values stored for a column: differences between consecutive
+     * values, and between consecutive periods for times
+     */
+    int64_t getDifference(std::vector<ConfigurationSnapshot> const& records,
+                          int column, size_t i)
+    {
+        int64_t delta = getField(records[i], column) - getField(records[i - 1], column);
+        if (column != COLUMN_TIME || i == 1)
+            return delta;
+        return delta - (records[i - 1].time - records[i - 2].time);
+    }
+
+    void readFully(int fd, uint8_t* buffer, size_t size, uint64_t offset)
+    {
+        while (size > 0)
+        {
+            ssize_t ret = pread(fd, buffer, size, offset);
+            if (ret == -1)
+                throw iodrivers_base::UnixError("failed to read telemetry file");
+            else if (ret == 0)
+                throw std::runtime_error("unexpected end of telemetry file");
+            buffer += ret;
+            size -= ret;
+            offset += ret;
+        }
+    }
+
+    void writeFully(int fd, uint8_t const* buffer, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t ret = ::write(fd, buffer, size);
+            if (ret == -1)
+                throw iodrivers_base::UnixError("failed to write telemetry file");
+            buffer += ret;
+            size -= ret;
+        }
+    }
+}
+
+TelemetryReader::TelemetryReader(std::string const& path)
+    : mRecordCount(0)
+    , mValidSize(0)
+{
+    mFD = ::open(path.c_str(), O_RDONLY);
+    if (mFD == -1)
+        throw iodrivers_base::UnixError("failed to open " + path);
+
+    try
+    {
+        struct stat info;
+        if (fstat(mFD, &info) == -1)
+            throw iodrivers_base::UnixError("failed to stat " + path);
+        uint64_t file_size = info.st_size;
+
+        uint64_t offset = 0;
+        while (offset + sizeof(BlockHeader) <= file_size)
+        {
+            BlockHeader header;
+            readFully(mFD, reinterpret_cast<uint8_t*>(&header), sizeof(header), offset);
+            if (header.magic != BLOCK_MAGIC || header.count == 0)
+                throw std::runtime_error(path + " is not a telemetry file or is corrupted");
+
+            uint64_t size = sizeof(header);
+            for (int c = 0; c < COLUMN_COUNT; ++c)
+                size += header.sizes[c];
+            if (offset + size > file_size)
+                break;
+
+            mBlocks.push_back(Block { offset, size, header.first_time,
+                                      header.last_time, header.count });
+            mRecordCount += header.count;
+            offset += size;
+        }
+        mValidSize = offset;
+    }
+    catch(...)
+    {
+        ::close(mFD);
+        throw;
+    }
+}
+
+TelemetryReader::~TelemetryReader()
+{
+    ::close(mFD);
+}
+
+uint64_t TelemetryReader::getRecordCount() const
+{
+    return mRecordCount;
+}
+
+size_t TelemetryReader::getBlockCount() const
+{
+    return mBlocks.size();
+}
+
+uint64_t TelemetryReader::getValidSize() const
+{
+    return mValidSize;
+}
+
+bool TelemetryReader::getTimeRange(int64_t& first, int64_t& last) const
+{
+    if (mBlocks.empty())
+        return false;
+    first = mBlocks.front().first_time;
+    last = mBlocks.back().last_time;
+    return true;
+}
+
+void TelemetryReader::decodeBlock(Block const& block, std::vector<ConfigurationSnapshot>& records)
+{
+    mBuffer.resize(block.size);
+    readFully(mFD, mBuffer.data(), block.size, block.offset);
+    BlockHeader header;
+    std::memcpy(&header, mBuffer.data(), sizeof(header));
+
+    size_t first = records.size();
+    records.resize(first + header.count, ConfigurationSnapshot());
+    ConfigurationSnapshot* out = records.data() + first;
+
+    uint8_t const* data = mBuffer.data() + sizeof(header);
+    for (int c = 0; c < COLUMN_COUNT; ++c)
+    {
+        uint8_t const* end = data + header.sizes[c];
+        int64_t value = header.bases[c];
+        int64_t delta = 0;
+        setField(out[0], c, value);
+        for (size_t i = 1; i < header.count; ++i)
+        {
+            int64_t difference = 0;
+            if (header.sizes[c] != 0)
+                data = readVarint(data, end, difference);
+            if (c == COLUMN_TIME)
+                delta += difference;
+            else
+                delta = difference;
+            value += delta;
+            setField(out[i], c, value);
+        }
+        if (data != end)
+            throw std::runtime_error("corrupted telemetry block");
+    }
+}
+
+size_t TelemetryReader::query(int64_t from, int64_t to, std::vector<ConfigurationSnapshot>& records)
+{
+    auto it = std::lower_bound(mBlocks.begin(), mBlocks.end(), from,
+        [](Block const& block, int64_t time) { return block.last_time < time; });
+
+    size_t initial_size = records.size();
+    for (; it != mBlocks.end() && it->first_time <= to; ++it)
+    {
+        size_t block_start = records.size();
+        decodeBlock(*it, records);
+        if (it->first_time < from || it->last_time > to)
+        {
+            // Keep only the records in range. Times are sorted within the
+            // block too
+            auto begin = records.begin() + block_start;
+            auto in_range = std::remove_if(begin, records.end(),
+                [from, to](ConfigurationSnapshot const& r) { return r.time < from || r.time > to; });
+            records.erase(in_range, records.end());
+        }
+    }
+    return records.size() - initial_size;
+}
+
+TelemetryWriter::TelemetryWriter(std::string const& path, size_t block_size)
+    : mBlockSize(block_size)
+    , mLastTime(std::numeric_limits<int64_t>::min())
+    , mBytesWritten(0)
+{
+    if (block_size == 0 || block_size > std::numeric_limits<uint32_t>::max())
+        throw std::invalid_argument("invalid telemetry block size");
+
+    mFD = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (mFD == -1)
+        throw iodrivers_base::UnixError("failed to open " + path);
+
+    try
+    {
+        TelemetryReader reader(path);
+        int64_t first;
+        reader.getTimeRange(first, mLastTime);
+        // Drop what an interrupted writer left behind
+        if (ftruncate(mFD, reader.getValidSize()) == -1)
+            throw iodrivers_base::UnixError("failed to truncate " + path);
+        if (lseek(mFD, 0, SEEK_END) == -1)
+            throw iodrivers_base::UnixError("failed to seek in " + path);
+    }
+    catch(...)
+    {
+        ::close(mFD);
+        throw;
+    }
+    mPending.reserve(block_size);
+}
+
+TelemetryWriter::~TelemetryWriter()
+{
+    try { flush(); }
+    catch(...) {}
+    ::close(mFD);
+}
+
+uint64_t TelemetryWriter::getBytesWritten() const
+{
+    return mBytesWritten;
+}
+
+void TelemetryWriter::push(ConfigurationSnapshot const& record)
+{
+    if (record.time < mLastTime)
+        throw std::invalid_argument("telemetry records must be pushed in chronological order");
+    mLastTime = record.time;
+    mPending.push_back(record);
+    if (mPending.size() == mBlockSize)
+        flush();
+}
+
+void TelemetryWriter::flush()
+{
+    if (mPending.empty())
+        return;
+
+    BlockHeader header;
+    header.magic = BLOCK_MAGIC;
+    header.count = mPending.size();
+    header.first_time = mPending.front().time;
+    header.last_time = mPending.back().time;
+
+    mBuffer.resize(sizeof(header));
+    for (int c = 0; c < COLUMN_COUNT; ++c)
+    {
+        header.bases[c] = getField(mPending.front(), c);
+        size_t column_start = mBuffer.size();
+        bool constant = true;
+        for (size_t i = 1; i < mPending.size(); ++i)
+        {
+            int64_t difference = getDifference(mPending, c, i);
+            constant = constant && (difference == 0);
+            appendVarint(mBuffer, difference);
+        }
+        if (constant)
+            mBuffer.resize(column_start);
+        header.sizes[c] = mBuffer.size() - column_start;
+    }
+    std::memcpy(mBuffer.data(), &header, sizeof(header));
+
+    mPending.clear();
+    writeFully(mFD, mBuffer.data(), mBuffer.size());
+    mBytesWritten += mBuffer.size();
+}
@@ -0,0 +1,133 @@
+#ifndef INDRA_HEADS_TELEMETRY_STORE_HPP
+#define INDRA_HEADS_TELEMETRY_STORE_HPP
+
+#include <indra_heads_protocol/ConfigurationSnapshot.hpp>
+#include <string>
+#include <vector>
+
+namespace indra_heads_protocol
+{
+    /** Columnar, append-only file of ConfigurationSnapshot records
+     *
+     * Records are grouped in blocks. Within a block, each field of the
+     * snapshot is stored as its own column: the block header holds the
+     * column's first value, and the column the differences between
+     * consecutive values, zigzag and varint encoded. Times are encoded as
+     * the differences between consecutive periods, so that a regular rate
+     * costs one byte per record. A column that does not change in a block
+     * takes no space at all.
+     *
+     * Values are the snapshot's fixed-point fields, not the wire counts:
+     * rpy is in tenths of degrees, so angles decoded from the wire (0.5
+     * degree resolution) only change in steps of 5.
+     *
+     * The block headers hold the block's time range, which is what allows
+     * TelemetryReader to decode only the blocks a query needs.
+     *
+     * Files are in host byte order.
+     */
+    namespace telemetry
+    {
+        /** Number of columns, i.e. of fields in a snapshot */
+        static const int COLUMN_COUNT = 12;
+    }
+
+    /** Read access to a file written by TelemetryWriter */
+    class TelemetryReader
+    {
+        struct Block
+        {
+            uint64_t offset;
+            uint64_t size;
+            int64_t first_time;
+            int64_t last_time;
+            uint32_t count;
+        };
+
+        int mFD;
+        std::vector<Block> mBlocks;
+        uint64_t mRecordCount;
+        uint64_t mValidSize;
+        std::vector<uint8_t> mBuffer;
+
+        void decodeBlock(Block const& block, std::vector<ConfigurationSnapshot>& records);
+
+    public:
+        /** Open the file and index its blocks
+         *
+         * A block that was not completely written (e.g. because the writer
+         * was killed) ends the file.
+         *
+         * @throw iodrivers_base::UnixError if the file cannot be read
+         * @throw std::runtime_error if it is not a telemetry file
+         */
+        explicit TelemetryReader(std::string const& path);
+        ~TelemetryReader();
+        TelemetryReader(TelemetryReader const&) = delete;
+        TelemetryReader& operator =(TelemetryReader const&) = delete;
+
+        uint64_t getRecordCount() const;
+        size_t getBlockCount() const;
+        /** Size of the complete blocks in the file, in bytes */
+        uint64_t getValidSize() const;
+
+        /** Times of the first and last records, in microseconds
+         *
+         * @return false if the file is empty
+         */
+        bool getTimeRange(int64_t& first, int64_t& last) const;
+
+        /** Append the records whose time is within [from, to], in
+         * microseconds
+         *
+         * Only the blocks that overlap the range are read and decoded
+         *
+         * @return the number of records appended
+         */
+        size_t query(int64_t from, int64_t to, std::vector<ConfigurationSnapshot>& records);
+    };
+
+    /** Appends records to a telemetry file, see TelemetryReader */
+    class TelemetryWriter
+    {
+        int mFD;
+        size_t mBlockSize;
+        std::vector<ConfigurationSnapshot> mPending;
+        std::vector<uint8_t> mBuffer;
+        int64_t mLastTime;
+        uint64_t mBytesWritten;
+
+    public:
+        /** Open or create the file
+         *
+         * Records are appended to the ones already in the file. An
+         * incomplete block at the end of the file is discarded.
+         *
+         * @param block_size the number of records per block. Larger blocks
+         *   compress slightly better, smaller blocks make queries on short
+         *   time ranges cheaper
+         * @throw iodrivers_base::UnixError if the file cannot be opened
+         */
+        explicit TelemetryWriter(std::string const& path, size_t block_size = 4096);
+
+        /** Flushes the pending records, ignoring errors */
+        ~TelemetryWriter();
+        TelemetryWriter(TelemetryWriter const&) = delete;
+        TelemetryWriter& operator =(TelemetryWriter const&) = delete;
+
+        /** Add a record. It is written when the block is full or on flush()
+         *
+         * @throw std::invalid_argument if the record is older than the last
+         *   one
+         */
+        void push(ConfigurationSnapshot const& record);
+
+        /** Write the pending records as a (possibly partial) block */
+        void flush();
+
+        /** Bytes written by this writer so far */
+        uint64_t getBytesWritten() const;
+    };
+}
+
+#endif
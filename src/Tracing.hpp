@@ -0,0 +1,46 @@
+#ifndef INDRA_HEADS_TRACING_HPP
+#define INDRA_HEADS_TRACING_HPP
+
+/** Static tracepoints in the driver's framing and I/O paths
+ *
+ * When systemtap's sys/sdt.h is available at build time, INDRA_HEADS_TRACE
+ * defines a USDT probe in the indra_heads_protocol provider. A disabled probe
+ * costs a single nop. They can be listed with
+ *
+ * <code>
+ * bpftrace -l 'usdt:/path/to/libindra_heads_protocol.so:*'
+ * </code>
+ *
+ * and scripts/indra_heads_latency.bt turns them into per-command latency
+ * breakdowns. Without sys/sdt.h, the tracepoints compile to nothing.
+ *
+ * Probes and their arguments:
+ *
+ * - packet_framed(command_id, message_type, size)
+ * - crc_failure(command_id, message_type, size)
+ * - byte_discarded(byte)
+ * - request_sent(command_id, size)
+ * - request_decoded(command_id, time in microseconds)
+ * - response_sent(command_id, status)
+ * - response_matched(command_id, status)
+ * - watchdog_stop(number of watchdog stops so far)
+ *
+ * The framing probes (packet_framed, crc_failure, byte_discarded) fire from
+ * Driver::readPacket only, so that what hasPacket looks at is not counted
+ * twice.
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define INDRA_HEADS_HAS_SDT
+#endif
+#endif
+
+#ifdef INDRA_HEADS_HAS_SDT
+#include <sys/sdt.h>
+#define INDRA_HEADS_TRACE(name, ...) STAP_PROBEV(indra_heads_protocol, name, __VA_ARGS__)
+#else
+#define INDRA_HEADS_TRACE(name, ...) do {} while(0)
+#endif
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef INDRA_HEADS_TEST_SIMULATED_HEAD_FIXTURE_HPP
+#define INDRA_HEADS_TEST_SIMULATED_HEAD_FIXTURE_HPP
+
+#include <indra_heads_protocol/SimulatedHead.hpp>
+#include <iodrivers_base/IOStream.hpp>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <thread>
+
+namespace indra_heads_protocol
+{
+    inline base::Time ms(double value)
+    {
+        return base::Time::fromMicroseconds(value * 1000);
+    }
+
+    /** A SimulatedHead running in its own thread, and the client driver
+     * connected to it through a socket pair
+     */
+    struct SimulatedHeadConnection
+    {
+        Driver client;
+        Driver head_driver;
+        std::thread head_thread;
+
+        void startHead(SimulatedHeadConfiguration const& conf = SimulatedHeadConfiguration())
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+                throw std::runtime_error("failed to create socket pair");
+            client.setMainStream(new iodrivers_base::FDStream(fds[0], true));
+            head_driver.setMainStream(new iodrivers_base::FDStream(fds[1], true));
+            head_thread = std::thread([this, conf]() {
+                SimulatedHead head(head_driver, conf);
+                try { head.run(); }
+                catch(std::exception&) {}
+            });
+        }
+
+        /** Close the connection and return what the head received */
+        ConfigurationHistory const& stopHead()
+        {
+            client.close();
+            if (head_thread.joinable())
+                head_thread.join();
+            return head_driver.getRequestedConfigurationHistory();
+        }
+
+        ~SimulatedHeadConnection()
+        {
+            stopHead();
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,162 @@
+#include "gtest/gtest.h"
+#include <indra_heads_protocol/AsyncDriver.hpp>
+#include <iodrivers_base/IOStream.hpp>
+#include <memory>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+struct AsyncDriverTest : public ::testing::Test
+{
+    Driver driver;
+    int peer;
+    async::EventLoop loop;
+    async::AsyncDriver head;
+
+    AsyncDriverTest()
+        : head(loop, driver)
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+            throw std::runtime_error("failed to create socket pair");
+        driver.setMainStream(new iodrivers_base::FDStream(fds[0], true));
+        peer = fds[1];
+    }
+
+    ~AsyncDriverTest()
+    {
+        ::close(peer);
+    }
+
+    vector<uint8_t> readFromPeer()
+    {
+        uint8_t buffer[256];
+        ssize_t size = ::read(peer, buffer, sizeof(buffer));
+        return vector<uint8_t>(buffer, buffer + size);
+    }
+
+    void reply(CommandIDs command_id, ResponseStatus status)
+    {
+        auto packet = requests::packetize(reply::Response(command_id, status));
+        ::write(peer, packet.data(), packet.size());
+    }
+};
+
+static async::Task pointAt(async::AsyncDriver& head, ResponseStatus& result)
+{
+    result = co_await head.request(requests::AnglesGeo(0.1, 0.3, 0.2));
+}
+
+TEST_F(AsyncDriverTest, it_resumes_the_coroutine_with_the_response_status) {
+    ResponseStatus result = STATUS_UNSUPPORTED;
+    async::Task task = pointAt(head, result);
+
+    ASSERT_EQ(requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2)), readFromPeer());
+    ASSERT_FALSE(task.done());
+    reply(ID_ANGLES_GEO, STATUS_OK);
+    loop.run();
+    ASSERT_TRUE(task.done());
+    task.get();
+    ASSERT_EQ(STATUS_OK, result);
+}
+
+TEST_F(AsyncDriverTest, it_matches_responses_with_the_oldest_pending_request_of_the_same_command) {
+    vector<int> order;
+    auto flow = [&](int index, CommandIDs command_id) -> async::Task {
+        if (command_id == ID_BITE)
+            co_await head.request(requests::BITE());
+        else
+            co_await head.request(requests::Stop());
+        order.push_back(index);
+    };
+    async::Task first = flow(0, ID_BITE);
+    async::Task second = flow(1, ID_STOP);
+    async::Task third = flow(2, ID_BITE);
+    ASSERT_EQ(3, head.getPendingCount());
+
+    reply(ID_STOP, STATUS_OK);
+    reply(ID_BITE, STATUS_OK);
+    reply(ID_BITE, STATUS_OK);
+    loop.run();
+    ASSERT_EQ((vector<int> { 1, 0, 2 }), order);
+}
+
+static async::Task selfTest(async::AsyncDriver& head, base::Time timeout)
+{
+    co_await head.request(requests::BITE(), timeout);
+}
+
+TEST_F(AsyncDriverTest, it_throws_TimeoutError_in_the_coroutine_if_no_response_arrives) {
+    async::Task task = selfTest(head, base::Time::fromMilliseconds(10));
+    loop.run();
+    ASSERT_TRUE(task.done());
+    ASSERT_THROW(task.get(), iodrivers_base::TimeoutError);
+}
+
+TEST_F(AsyncDriverTest, destroying_a_waiting_task_cancels_its_request) {
+    ResponseStatus result = STATUS_UNSUPPORTED;
+    {
+        async::Task task = pointAt(head, result);
+        ASSERT_EQ(1, head.getPendingCount());
+    }
+    ASSERT_EQ(0, head.getPendingCount());
+
+    reply(ID_ANGLES_GEO, STATUS_OK);
+    ASSERT_FALSE(loop.step(base::Time::fromMilliseconds(10)));
+    ASSERT_EQ(STATUS_UNSUPPORTED, result);
+}
+
+TEST_F(AsyncDriverTest, a_task_destroyed_by_another_one_is_not_resumed) {
+    ResponseStatus result = STATUS_UNSUPPORTED;
+    std::unique_ptr<async::Task> victim(new async::Task(pointAt(head, result)));
+    auto killer = [&]() -> async::Task {
+        co_await head.request(requests::BITE());
+        victim.reset();
+    };
+    async::Task task = killer();
+
+    // Both are made ready in the same step, the killer first
+    reply(ID_BITE, STATUS_OK);
+    reply(ID_ANGLES_GEO, STATUS_OK);
+    loop.run();
+    ASSERT_TRUE(task.done());
+    ASSERT_EQ(STATUS_UNSUPPORTED, result);
+}
+
+TEST_F(AsyncDriverTest, get_does_nothing_on_a_moved_from_task) {
+    async::Task task = selfTest(head, base::Time::fromMilliseconds(10));
+    async::Task moved(std::move(task));
+    task.get();
+    ASSERT_TRUE(task.done());
+    loop.run();
+}
+
+TEST_F(AsyncDriverTest, it_runs_many_flows_across_heads_on_one_thread) {
+    Driver other_driver;
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    other_driver.setMainStream(new iodrivers_base::FDStream(fds[0], true));
+    async::AsyncDriver other_head(loop, other_driver);
+
+    int completed = 0;
+    auto flow = [&](async::AsyncDriver& target) -> async::Task {
+        co_await target.request(requests::AngularVelocityGeo(0.1, 0.2, 0.3));
+        ++completed;
+    };
+    vector<async::Task> tasks;
+    for (int i = 0; i < 100; ++i)
+        tasks.push_back(flow(i % 2 ? head : other_head));
+    ASSERT_EQ(50, head.getPendingCount());
+    ASSERT_EQ(50, other_head.getPendingCount());
+
+    auto packet = requests::packetize(reply::Response(ID_ANGULAR_VELOCITY_GEO, STATUS_OK));
+    for (int i = 0; i < 50; ++i) {
+        reply(ID_ANGULAR_VELOCITY_GEO, STATUS_OK);
+        ::write(fds[1], packet.data(), packet.size());
+    }
+    loop.run();
+    ::close(fds[1]);
+    ASSERT_EQ(100, completed);
+}
@@ -0,0 +1,166 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+#include "SimulatedHeadFixture.hpp"
+#include <indra_heads_protocol/Bundle.hpp>
+#include <indra_heads_protocol/PacketParser.hpp>
+#include <iodrivers_base/Fixture.hpp>
+
+using namespace std;
+using namespace indra_heads_protocol;
+using ::testing::ElementsAre;
+
+static Bundle makeBundle()
+{
+    Bundle bundle;
+    bundle.add(requests::AnglesGeo(0.1, 0.3, 0.2));
+    bundle.add(requests::PositionGeo(-0.1, 0.2, -0.3));
+    bundle.add(requests::StatusRefreshRatePT(RATE_50HZ));
+    return bundle;
+}
+
+TEST(Bundle, it_frames_the_commands_without_their_message_type) {
+    Bundle bundle;
+    ASSERT_TRUE(bundle.add(requests::StatusRefreshRatePT(RATE_20HZ)));
+    ASSERT_TRUE(bundle.add(requests::Stop()));
+    ASSERT_EQ(2, bundle.getCommandCount());
+    ASSERT_EQ(7, bundle.getPacketSize());
+
+    std::vector<uint8_t> packet = bundle.packetize();
+    ASSERT_THAT(std::vector<uint8_t>(packet.begin(), packet.end() - 1),
+                ElementsAre(ID_BUNDLE, MSG_REQUEST, 3,
+                            ID_STATUS_REFRESH_RATE_PT, RATE_20HZ,
+                            ID_STOP));
+    ASSERT_EQ(static_cast<uint8_t>(details::compute_crc(packet.data(), 6)),
+              packet.back());
+}
+
+TEST(Bundle, it_splits_into_standalone_requests) {
+    std::vector<std::vector<uint8_t>> packets = makeBundle().packetizeCommands();
+    ASSERT_EQ(3, packets.size());
+    ASSERT_EQ(requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2)), packets[0]);
+    ASSERT_EQ(requests::packetize(requests::PositionGeo(-0.1, 0.2, -0.3)), packets[1]);
+    ASSERT_EQ(requests::packetize(requests::StatusRefreshRatePT(RATE_50HZ)), packets[2]);
+}
+
+TEST(Bundle, it_refuses_commands_that_do_not_fit) {
+    Bundle bundle;
+    int count = 0;
+    while (bundle.add(requests::PositionGeo(-0.1, 0.2, -0.3)))
+        ++count;
+    ASSERT_EQ(MAX_BUNDLE_PAYLOAD / 14, count);
+    ASSERT_LE(bundle.getPacketSize(), MAX_PACKET_SIZE);
+}
+
+TEST(Bundle, it_refuses_extensions_and_responses) {
+    Bundle bundle;
+    ASSERT_FALSE(bundle.add(requests::Features()));
+    ASSERT_FALSE(bundle.add(reply::Response(ID_STOP, STATUS_OK)));
+    ASSERT_TRUE(bundle.empty());
+}
+
+TEST(Bundle, it_is_idempotent_only_if_all_its_commands_are) {
+    ASSERT_TRUE(makeBundle().isIdempotent());
+    Bundle bundle = makeBundle();
+    bundle.add(requests::AngularVelocityGeo(0.1, 0.2, 0.3));
+    ASSERT_FALSE(bundle.isIdempotent());
+}
+
+TEST(Bundle, the_parser_frames_bundles_delivered_byte_per_byte) {
+    std::vector<uint8_t> packet = makeBundle().packetize();
+    PacketParser parser;
+    for (size_t i = 1; i < packet.size(); ++i)
+        ASSERT_EQ(0, parser.extract(packet.data(), i));
+    ASSERT_EQ(static_cast<int>(packet.size()), parser.extract(packet.data(), packet.size()));
+}
+
+TEST(Bundle, the_parser_rejects_an_invalid_payload_size) {
+    PacketParser parser;
+    uint8_t empty[] = { ID_BUNDLE, MSG_REQUEST, 0, 0 };
+    ASSERT_EQ(-1, parser.extract(empty, sizeof(empty)));
+    ASSERT_EQ(PacketParser::REJECTED_BUNDLE, parser.getLastRejection());
+
+    uint8_t too_large[] = { ID_BUNDLE, MSG_REQUEST, MAX_BUNDLE_PAYLOAD + 1 };
+    ASSERT_EQ(-1, parser.extract(too_large, sizeof(too_large)));
+    ASSERT_EQ(PacketParser::REJECTED_BUNDLE, parser.getLastRejection());
+}
+
+TEST(Bundle, the_parser_rejects_a_malformed_payload_with_a_valid_CRC) {
+    // A rate request whose rate byte is missing
+    uint8_t packet[] = { ID_BUNDLE, MSG_REQUEST, 2, ID_STOP, ID_STATUS_REFRESH_RATE_PT, 0 };
+    packet[5] = details::compute_crc(packet, 5);
+    PacketParser parser;
+    ASSERT_EQ(-1, parser.extract(packet, sizeof(packet)));
+    ASSERT_EQ(PacketParser::REJECTED_BUNDLE, parser.getLastRejection());
+}
+
+struct BundleDriverTest : public ::testing::Test, public iodrivers_base::Fixture<Driver>
+{
+    BundleDriverTest()
+    {
+        driver.openURI("test://");
+    }
+};
+
+TEST_F(BundleDriverTest, readRequest_applies_all_the_bundled_commands) {
+    pushDataToDriver(makeBundle().packetize());
+    ASSERT_EQ(ID_BUNDLE, driver.readRequest());
+
+    RequestedConfiguration conf = driver.getRequestedConfiguration();
+    ASSERT_EQ(ID_BUNDLE, conf.command_id);
+    ASSERT_EQ(RequestedConfiguration::POSITION_GEO, conf.control_mode);
+    ASSERT_TRUE(Eigen::Vector3d(0.19199, 0.29671, 0.09599).isApprox(conf.rpy, 1e-4));
+    ASSERT_NEAR(-0.1, conf.lat_lon_alt.latitude, 1e-6);
+    ASSERT_EQ(RATE_50HZ, conf.rate_status_pt);
+}
+
+TEST_F(BundleDriverTest, readRequest_returns_feature_queries) {
+    pushDataToDriver(requests::packetize(requests::Features()));
+    ASSERT_EQ(ID_FEATURES, driver.readRequest());
+    driver.writeFeatures(FEATURE_BUNDLE);
+    ASSERT_EQ(requests::packetize(reply::Features(FEATURE_BUNDLE)), readDataFromDriver());
+}
+
+struct BundleNegotiationTest : public ::testing::Test, public SimulatedHeadConnection
+{
+    void startHead(bool extensions)
+    {
+        client.getRoundTripEstimator() = RoundTripEstimator(ms(100));
+        SimulatedHeadConfiguration conf;
+        conf.extensions = extensions;
+        SimulatedHeadConnection::startHead(conf);
+    }
+};
+
+TEST_F(BundleNegotiationTest, it_sends_a_single_frame_to_heads_that_support_bundles) {
+    startHead(true);
+    ASSERT_EQ(FEATURE_BUNDLE, client.negotiateFeatures());
+    ASSERT_EQ(FEATURE_BUNDLE, client.getPeerFeatures());
+
+    Response response = client.transact(makeBundle());
+    ASSERT_EQ(ID_BUNDLE, response.command_id);
+    ASSERT_EQ(STATUS_OK, response.status);
+
+    ConfigurationHistory const& history = stopHead();
+    // The features query, then the bundle
+    ASSERT_EQ(2, history.size());
+    ASSERT_EQ(ID_BUNDLE, history.back().command_id);
+    ASSERT_EQ(RATE_50HZ, history.back().rate_status_pt);
+}
+
+TEST_F(BundleNegotiationTest, it_falls_back_to_separate_requests_for_legacy_heads) {
+    startHead(false);
+    base::Time timeout = client.getRoundTripEstimator().getTimeout();
+    ASSERT_EQ(0, client.negotiateFeatures());
+    // The unanswered query does not inflate the timeouts
+    ASSERT_EQ(timeout, client.getRoundTripEstimator().getTimeout());
+
+    Response response = client.transact(makeBundle());
+    ASSERT_EQ(ID_BUNDLE, response.command_id);
+    ASSERT_EQ(STATUS_OK, response.status);
+
+    ConfigurationHistory const& history = stopHead();
+    // The features query, then one entry per command
+    ASSERT_EQ(4, history.size());
+    ASSERT_EQ(ID_STATUS_REFRESH_RATE_PT, history.back().command_id);
+    ASSERT_EQ(RequestedConfiguration::POSITION_GEO, history.back().control_mode);
+}
@@ -0,0 +1,167 @@
+#include "gtest/gtest.h"
+#include <indra_heads_protocol/CaptureDecoder.hpp>
+#include <indra_heads_protocol/Bundle.hpp>
+#include <iodrivers_base/Exceptions.hpp>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <unistd.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+static void append(std::vector<uint8_t>& capture, std::vector<uint8_t> const& bytes)
+{
+    capture.insert(capture.end(), bytes.begin(), bytes.end());
+}
+
+/** A capture with requests, responses, bundles and line noise */
+static std::vector<uint8_t> makeCapture(size_t count, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> capture;
+    for (size_t i = 0; i < count; ++i)
+    {
+        switch(rng() % 6)
+        {
+            case 0:
+                append(capture, requests::packetize(requests::AnglesGeo(0.1, 0.2, 0.3)));
+                break;
+            case 1:
+                append(capture, requests::packetize(requests::PositionGeo(0.1, -0.2, 300)));
+                break;
+            case 2:
+                append(capture, requests::packetize(reply::Response(ID_STOP, STATUS_OK)));
+                break;
+            case 3:
+            {
+                Bundle bundle;
+                bundle.add(requests::StatusRefreshRateIMU(RATE_50HZ));
+                bundle.add(requests::Stop());
+                append(capture, bundle.packetize());
+                break;
+            }
+            default:
+                // Line noise, possibly the start of a packet
+                for (size_t n = rng() % 5; n > 0; --n)
+                    capture.push_back(rng() % 12);
+        }
+    }
+    return capture;
+}
+
+static void assertSameColumns(CaptureColumns const& expected, CaptureColumns const& actual)
+{
+    ASSERT_EQ(expected.offsets, actual.offsets);
+    ASSERT_EQ(expected.command_ids, actual.command_ids);
+    ASSERT_EQ(expected.message_types, actual.message_types);
+    ASSERT_EQ(expected.codes, actual.codes);
+    for (int i = 0; i < 3; ++i)
+    {
+        ASSERT_EQ(expected.values[i].size(), actual.values[i].size());
+        for (size_t row = 0; row < expected.size(); ++row)
+        {
+            if (std::isnan(expected.values[i][row]))
+                ASSERT_TRUE(std::isnan(actual.values[i][row]));
+            else
+                ASSERT_EQ(expected.values[i][row], actual.values[i][row]);
+        }
+    }
+}
+
+TEST(CaptureDecoder, it_decodes_the_packets_in_columns) {
+    std::vector<uint8_t> capture = { 0xff };
+    append(capture, requests::packetize(requests::StatusRefreshRatePT(RATE_20HZ)));
+    append(capture, requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2)));
+    capture.push_back(0xfe);
+    append(capture, requests::packetize(requests::PositionGeo(-0.1, 0.2, 300)));
+    append(capture, requests::packetize(reply::Response(ID_STOP, STATUS_FAILED)));
+
+    CaptureDecoder decoder(1);
+    CaptureColumns columns = decoder.decode(capture.data(), capture.size());
+    ASSERT_EQ(4, columns.size());
+    ASSERT_EQ(std::vector<uint64_t>({ 1, 5, 15, 31 }), columns.offsets);
+    ASSERT_EQ(std::vector<uint8_t>({ ID_STATUS_REFRESH_RATE_PT, ID_ANGLES_GEO,
+                                     ID_STABILIZATION_TARGET, ID_STOP }),
+              columns.command_ids);
+    ASSERT_EQ(std::vector<uint8_t>({ MSG_REQUEST, MSG_REQUEST, MSG_REQUEST, MSG_RESPONSE }),
+              columns.message_types);
+    ASSERT_EQ(std::vector<uint8_t>({ RATE_20HZ, 0, 0, STATUS_FAILED }), columns.codes);
+    ASSERT_NEAR(0.19199, columns.values[0][1], 1e-4);
+    ASSERT_NEAR(-0.1, columns.values[0][2], 1e-6);
+    ASSERT_NEAR(300, columns.values[2][2], 0.1);
+    ASSERT_TRUE(std::isnan(columns.values[0][3]));
+
+    CaptureStatistics const& stats = decoder.getStatistics();
+    ASSERT_EQ(capture.size(), stats.bytes);
+    ASSERT_EQ(4, stats.packets);
+    ASSERT_EQ(2, stats.discarded_bytes);
+    ASSERT_EQ(0, stats.truncated_bytes);
+}
+
+TEST(CaptureDecoder, it_expands_bundles_into_one_row_per_command) {
+    Bundle bundle;
+    bundle.add(requests::StatusRefreshRateIMU(RATE_50HZ));
+    bundle.add(requests::AngularVelocityGeo(0.1, 0.2, 0.3));
+    std::vector<uint8_t> capture = { 0xff };
+    append(capture, bundle.packetize());
+
+    CaptureDecoder decoder(1);
+    CaptureColumns columns = decoder.decode(capture.data(), capture.size());
+    ASSERT_EQ(std::vector<uint64_t>({ 1, 1 }), columns.offsets);
+    ASSERT_EQ(std::vector<uint8_t>({ ID_STATUS_REFRESH_RATE_IMU, ID_ANGULAR_VELOCITY_GEO }),
+              columns.command_ids);
+    ASSERT_EQ(RATE_50HZ, columns.codes[0]);
+    ASSERT_EQ(1, decoder.getStatistics().packets);
+}
+
+TEST(CaptureDecoder, it_stops_at_an_incomplete_packet) {
+    std::vector<uint8_t> capture = requests::packetize(requests::Stop());
+    std::vector<uint8_t> angles = requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2));
+    capture.insert(capture.end(), angles.begin(), angles.begin() + 5);
+
+    CaptureDecoder decoder(2, 4);
+    CaptureColumns columns = decoder.decode(capture.data(), capture.size());
+    ASSERT_EQ(1, columns.size());
+    ASSERT_EQ(5, decoder.getStatistics().truncated_bytes);
+    ASSERT_EQ(0, decoder.getStatistics().discarded_bytes);
+}
+
+TEST(CaptureDecoder, chunks_give_the_same_result_than_a_sequential_decoding) {
+    std::vector<uint8_t> capture = makeCapture(2000, 42);
+    CaptureDecoder sequential(1, capture.size());
+    CaptureColumns expected = sequential.decode(capture.data(), capture.size());
+    CaptureStatistics expected_stats = sequential.getStatistics();
+    ASSERT_GT(expected_stats.discarded_bytes, 0);
+
+    for (size_t chunk_size : { 1, 2, 3, 7, 13, 16, 47, 100, 1000 })
+    {
+        CaptureDecoder decoder(3, chunk_size);
+        CaptureColumns columns = decoder.decode(capture.data(), capture.size());
+        assertSameColumns(expected, columns);
+        ASSERT_EQ(expected_stats.packets, decoder.getStatistics().packets);
+        ASSERT_EQ(expected_stats.discarded_bytes, decoder.getStatistics().discarded_bytes);
+        ASSERT_EQ(expected_stats.truncated_bytes, decoder.getStatistics().truncated_bytes);
+    }
+}
+
+TEST(CaptureDecoder, it_decodes_a_mapped_file) {
+    std::vector<uint8_t> capture = makeCapture(200, 1);
+    char path[] = "/tmp/indra_heads_capture_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    ASSERT_EQ(static_cast<ssize_t>(capture.size()), write(fd, capture.data(), capture.size()));
+    close(fd);
+
+    CaptureDecoder decoder(2, 64);
+    CaptureColumns columns = decoder.decodeFile(path);
+    unlink(path);
+
+    CaptureDecoder sequential(1, capture.size());
+    assertSameColumns(sequential.decode(capture.data(), capture.size()), columns);
+}
+
+TEST(CaptureDecoder, it_throws_if_the_file_cannot_be_mapped) {
+    CaptureDecoder decoder;
+    ASSERT_THROW(decoder.decodeFile("/does/not/exist"), iodrivers_base::UnixError);
+}
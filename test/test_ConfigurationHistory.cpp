@@ -0,0 +1,114 @@
+#include "gtest/gtest.h"
+#include <indra_heads_protocol/ConfigurationHistory.hpp>
+#include <indra_heads_protocol/Driver.hpp>
+#include <iodrivers_base/Fixture.hpp>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+static RequestedConfiguration makeConfiguration(
+    double t, RequestedConfiguration::ControlModes mode, Eigen::Vector3d const& rpy)
+{
+    RequestedConfiguration conf;
+    conf.time = base::Time::fromSeconds(t);
+    conf.control_mode = mode;
+    conf.rpy = rpy;
+    return conf;
+}
+
+TEST(ConfigurationHistory, it_returns_the_configuration_active_at_a_given_time) {
+    ConfigurationHistory history(4);
+    for (int i = 0; i < 3; ++i)
+        history.push(makeConfiguration(i, RequestedConfiguration::ANGLES_GEO,
+                                       Eigen::Vector3d(0, 0, 0.1 * i)));
+
+    RequestedConfiguration result;
+    ASSERT_FALSE(history.get(base::Time::fromSeconds(-1), result));
+    ASSERT_TRUE(history.get(base::Time::fromSeconds(1.5), result));
+    ASSERT_DOUBLE_EQ(0.1, result.rpy.z());
+    ASSERT_TRUE(history.get(base::Time::fromSeconds(2), result));
+    ASSERT_DOUBLE_EQ(0.2, result.rpy.z());
+    ASSERT_TRUE(history.get(base::Time::fromSeconds(10), result));
+    ASSERT_DOUBLE_EQ(0.2, result.rpy.z());
+}
+
+TEST(ConfigurationHistory, it_overwrites_the_oldest_configuration_once_full) {
+    ConfigurationHistory history(3);
+    for (int i = 0; i < 5; ++i)
+        history.push(makeConfiguration(i, RequestedConfiguration::ANGLES_GEO,
+                                       Eigen::Vector3d(0, 0, 0.1 * i)));
+
+    ASSERT_EQ(3, history.size());
+    ASSERT_EQ(base::Time::fromSeconds(2), history.front().time);
+    ASSERT_EQ(base::Time::fromSeconds(4), history.back().time);
+
+    RequestedConfiguration result;
+    ASSERT_FALSE(history.get(base::Time::fromSeconds(1.5), result));
+    ASSERT_TRUE(history.get(base::Time::fromSeconds(3.5), result));
+    ASSERT_DOUBLE_EQ(0.3, result.rpy.z());
+}
+
+TEST(ConfigurationHistory, it_interpolates_velocities_linearly) {
+    ConfigurationHistory history(4);
+    history.push(makeConfiguration(0, RequestedConfiguration::ANGULAR_VELOCITY_GEO,
+                                   Eigen::Vector3d(0, 0, 0)));
+    history.push(makeConfiguration(1, RequestedConfiguration::ANGULAR_VELOCITY_GEO,
+                                   Eigen::Vector3d(0.2, 0.4, -0.2)));
+
+    RequestedConfiguration result;
+    ASSERT_TRUE(history.interpolate(base::Time::fromSeconds(0.25), result));
+    ASSERT_TRUE(Eigen::Vector3d(0.05, 0.1, -0.05).isApprox(result.rpy, 1e-9));
+}
+
+TEST(ConfigurationHistory, it_slerps_angles) {
+    ConfigurationHistory history(4);
+    history.push(makeConfiguration(0, RequestedConfiguration::ANGLES_GEO,
+                                   Eigen::Vector3d(0, 0, M_PI - 0.1)));
+    history.push(makeConfiguration(1, RequestedConfiguration::ANGLES_GEO,
+                                   Eigen::Vector3d(0, 0, -M_PI + 0.1)));
+
+    RequestedConfiguration result;
+    ASSERT_TRUE(history.interpolate(base::Time::fromSeconds(0.5), result));
+    ASSERT_NEAR(0, result.rpy.x(), 1e-9);
+    ASSERT_NEAR(0, result.rpy.y(), 1e-9);
+    ASSERT_NEAR(M_PI, std::abs(result.rpy.z()), 1e-9);
+}
+
+TEST(ConfigurationHistory, it_does_not_interpolate_across_control_modes) {
+    ConfigurationHistory history(4);
+    history.push(makeConfiguration(0, RequestedConfiguration::ANGLES_GEO,
+                                   Eigen::Vector3d(0, 0, 0.1)));
+    history.push(makeConfiguration(1, RequestedConfiguration::ANGULAR_VELOCITY_GEO,
+                                   Eigen::Vector3d(0, 0, 1)));
+
+    RequestedConfiguration result;
+    ASSERT_TRUE(history.interpolate(base::Time::fromSeconds(0.5), result));
+    ASSERT_EQ(RequestedConfiguration::ANGLES_GEO, result.control_mode);
+    ASSERT_DOUBLE_EQ(0.1, result.rpy.z());
+}
+
+TEST(ConfigurationHistory, it_ignores_pushes_when_its_capacity_is_zero) {
+    ConfigurationHistory history;
+    history.push(RequestedConfiguration());
+    ASSERT_TRUE(history.empty());
+}
+
+struct ConfigurationHistoryDriverTest : public ::testing::Test, public iodrivers_base::Fixture<Driver>
+{
+    ConfigurationHistoryDriverTest()
+    {
+        driver.openURI("test://");
+    }
+};
+
+TEST_F(ConfigurationHistoryDriverTest, readRequest_records_the_configurations) {
+    pushDataToDriver(requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2)));
+    pushDataToDriver(requests::packetize(requests::Stop()));
+    driver.readRequest();
+    driver.readRequest();
+
+    auto const& history = driver.getRequestedConfigurationHistory();
+    ASSERT_EQ(2, history.size());
+    ASSERT_EQ(ID_ANGLES_GEO, history.front().command_id);
+    ASSERT_EQ(ID_STOP, history.back().command_id);
+}
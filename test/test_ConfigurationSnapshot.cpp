@@ -0,0 +1,92 @@
+#include "gtest/gtest.h"
+#include <indra_heads_protocol/ConfigurationSnapshot.hpp>
+#include <indra_heads_protocol/Driver.hpp>
+#include <iodrivers_base/Fixture.hpp>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+static void assertSameConfiguration(RequestedConfiguration const& expected,
+                                    RequestedConfiguration const& actual)
+{
+    ASSERT_EQ(expected.time, actual.time);
+    ASSERT_EQ(expected.command_id, actual.command_id);
+    ASSERT_EQ(expected.rate_status_pt, actual.rate_status_pt);
+    ASSERT_EQ(expected.rate_status_imu, actual.rate_status_imu);
+    ASSERT_EQ(expected.control_mode, actual.control_mode);
+    for (int i = 0; i < 3; ++i)
+    {
+        if (base::isUnset(expected.rpy[i]))
+            ASSERT_TRUE(base::isUnset(actual.rpy[i]));
+        else
+            ASSERT_NEAR(expected.rpy[i], actual.rpy[i], 1e-12);
+    }
+    if (base::isUnknown(expected.lat_lon_alt.latitude))
+        ASSERT_TRUE(base::isUnknown(actual.lat_lon_alt.latitude));
+    else
+    {
+        ASSERT_EQ(expected.lat_lon_alt.latitude, actual.lat_lon_alt.latitude);
+        ASSERT_EQ(expected.lat_lon_alt.longitude, actual.lat_lon_alt.longitude);
+        ASSERT_EQ(expected.lat_lon_alt.altitude, actual.lat_lon_alt.altitude);
+    }
+}
+
+TEST(ConfigurationSnapshot, it_decodes_angular_velocities_exactly) {
+    RequestedConfiguration conf;
+    conf.command_id = ID_ANGULAR_VELOCITY_GEO;
+    conf.rpy = requests::decode(requests::AngularVelocityGeo(-0.4, 0.2, -0.3));
+    RequestedConfiguration result =
+        ConfigurationSnapshot::fromConfiguration(conf).toConfiguration();
+    ASSERT_EQ(conf.rpy, result.rpy);
+}
+
+TEST(ConfigurationSnapshot, it_rounds_to_the_protocol_resolution) {
+    RequestedConfiguration conf;
+    conf.command_id = ID_STABILIZATION_TARGET;
+    conf.rpy = Eigen::Vector3d(0.1 * M_PI / 180 * 1.4, 0, -0.1 * M_PI / 180 * 1.6);
+    conf.lat_lon_alt = GeoTarget(1.0000004, -2.0000006, 10.04);
+    ConfigurationSnapshot snapshot = ConfigurationSnapshot::fromConfiguration(conf);
+    ASSERT_EQ(1, snapshot.rpy[0]);
+    ASSERT_EQ(-2, snapshot.rpy[2]);
+    ASSERT_EQ(1000000, snapshot.latitude);
+    ASSERT_EQ(-2000001, snapshot.longitude);
+    ASSERT_EQ(100, snapshot.altitude);
+}
+
+TEST(ConfigurationSnapshot, it_preserves_unset_fields) {
+    RequestedConfiguration conf;
+    conf.time = base::Time::fromMicroseconds(1234567);
+    conf.command_id = ID_STOP;
+    ConfigurationSnapshot snapshot = ConfigurationSnapshot::fromConfiguration(conf);
+    ASSERT_EQ(0, snapshot.flags);
+    assertSameConfiguration(conf, snapshot.toConfiguration());
+}
+
+struct ConfigurationSnapshotDriverTest : public ::testing::Test, public iodrivers_base::Fixture<Driver>
+{
+    ConfigurationSnapshotDriverTest()
+    {
+        driver.openURI("test://");
+    }
+
+    void assertRoundTrip(std::vector<uint8_t> const& packet)
+    {
+        pushDataToDriver(packet);
+        driver.readRequest();
+        RequestedConfiguration conf = driver.getRequestedConfiguration();
+        assertSameConfiguration(
+            conf, ConfigurationSnapshot::fromConfiguration(conf).toConfiguration());
+    }
+};
+
+TEST_F(ConfigurationSnapshotDriverTest, it_converts_decoded_configurations_losslessly) {
+    assertRoundTrip(requests::packetize(requests::StatusRefreshRatePT(RATE_20HZ)));
+    assertRoundTrip(requests::packetize(requests::StatusRefreshRateIMU(RATE_50HZ)));
+    assertRoundTrip(requests::packetize(requests::AnglesRelative(0.1, 0.3, 0.2)));
+    assertRoundTrip(requests::packetize(requests::AnglesGeo(-3.1, -0.3, 3.1)));
+    assertRoundTrip(requests::packetize(requests::AngularVelocityRelative(0.1, -0.2, 0.3)));
+    assertRoundTrip(requests::packetize(requests::AngularVelocityGeo(-0.4, 0.2, -0.3)));
+    assertRoundTrip(requests::packetize(requests::PositionGeo(-45.123456, 170.654321, -1234.5)));
+    assertRoundTrip(requests::packetize(requests::Stop()));
+    assertRoundTrip(requests::packetize(requests::BITE()));
+}
@@ -0,0 +1,212 @@
+#include "gtest/gtest.h"
+#include <indra_heads_protocol/DecodePipeline.hpp>
+#include <iodrivers_base/IOStream.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+TEST(FrameRing, it_rounds_its_capacity_to_a_power_of_two) {
+    ASSERT_EQ(8, FrameRing(5).getCapacity());
+    ASSERT_EQ(8, FrameRing(8).getCapacity());
+}
+
+TEST(FrameRing, it_returns_frames_in_order_and_refuses_pushes_when_full) {
+    FrameRing ring(2);
+    uint8_t data[] = { 1, 2, 3 };
+    ASSERT_TRUE(ring.push(10, data, 3));
+    ASSERT_TRUE(ring.push(20, data + 1, 2));
+    ASSERT_FALSE(ring.push(30, data, 1));
+    ASSERT_EQ(2, ring.size());
+
+    RawFrame frame;
+    ASSERT_TRUE(ring.pop(frame));
+    ASSERT_EQ(10, frame.time);
+    ASSERT_EQ(3, frame.size);
+    ASSERT_EQ(1, frame.data[0]);
+    ASSERT_TRUE(ring.push(30, data, 1));
+    ASSERT_TRUE(ring.pop(frame));
+    ASSERT_EQ(20, frame.time);
+    ASSERT_EQ(2, frame.data[0]);
+    ASSERT_TRUE(ring.pop(frame));
+    ASSERT_EQ(30, frame.time);
+    ASSERT_FALSE(ring.pop(frame));
+}
+
+struct DecodePipelineTest : public ::testing::Test
+{
+    Driver driver;
+    int peer;
+
+    DecodePipelineTest()
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+            throw std::runtime_error("failed to create socket pair");
+        driver.setMainStream(new iodrivers_base::FDStream(fds[0], true));
+        peer = fds[1];
+    }
+
+    ~DecodePipelineTest()
+    {
+        if (peer != -1)
+            ::close(peer);
+    }
+
+    void write(std::vector<uint8_t> const& packet)
+    {
+        ASSERT_EQ(static_cast<ssize_t>(packet.size()),
+                  ::write(peer, packet.data(), packet.size()));
+    }
+
+    void closePeer()
+    {
+        ::close(peer);
+        peer = -1;
+    }
+};
+
+TEST_F(DecodePipelineTest, it_decodes_and_dispatches_requests_and_responses_in_order) {
+    DecodePipeline pipeline(driver, 4);
+    std::vector<CommandIDs> requests;
+    std::vector<Response> responses;
+    RequestedConfiguration last;
+    pipeline.setRequestHandler([&](CommandIDs id, RequestedConfiguration const& conf) {
+        requests.push_back(id);
+        last = conf;
+    });
+    pipeline.setResponseHandler([&](Response const& response) {
+        responses.push_back(response);
+    });
+    pipeline.start();
+
+    write(requests::packetize(requests::StatusRefreshRatePT(RATE_20HZ)));
+    write(requests::packetize(reply::Response(ID_ANGLES_GEO, STATUS_FAILED)));
+    write(requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2)));
+    closePeer();
+    pipeline.wait();
+
+    ASSERT_TRUE(pipeline.isIOFinished());
+    ASSERT_EQ((std::vector<CommandIDs> { ID_STATUS_REFRESH_RATE_PT, ID_ANGLES_GEO }), requests);
+    ASSERT_EQ(1, responses.size());
+    ASSERT_EQ(ID_ANGLES_GEO, responses[0].command_id);
+    ASSERT_EQ(STATUS_FAILED, responses[0].status);
+    ASSERT_EQ(RATE_20HZ, last.rate_status_pt);
+    ASSERT_EQ(RequestedConfiguration::ANGLES_GEO, last.control_mode);
+    ASSERT_NEAR(0.1, last.rpy.z(), 0.01);
+
+    PipelineStatistics stats = pipeline.getStatistics();
+    ASSERT_EQ(3, stats.frames_read);
+    ASSERT_EQ(3, stats.frames_dispatched);
+    ASSERT_EQ(0, stats.frames_dropped);
+}
+
+/** CPU time used by the process while the calling thread sleeps */
+static base::Time cpuTimeDuringSleep(int milliseconds)
+{
+    timespec start, end;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+    usleep(milliseconds * 1000);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+    return base::Time::fromMicroseconds(
+        (end.tv_sec - start.tv_sec) * 1000000LL + (end.tv_nsec - start.tv_nsec) / 1000);
+}
+
+TEST_F(DecodePipelineTest, an_idle_pipeline_does_not_use_the_CPU) {
+    DecodePipeline pipeline(driver, 4);
+    int calls = 0;
+    pipeline.setRequestHandler([&](CommandIDs, RequestedConfiguration const&) { ++calls; });
+    pipeline.start();
+
+    ASSERT_LT(cpuTimeDuringSleep(200), base::Time::fromMilliseconds(40));
+    // And it still wakes up for new frames
+    write(requests::packetize(requests::BITE()));
+    closePeer();
+    pipeline.wait();
+    ASSERT_EQ(1, calls);
+}
+
+struct BlockedHandler
+{
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool released = false;
+    int calls = 0;
+
+    void operator()()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ++calls;
+        condition.wait(lock, [this]() { return released; });
+    }
+
+    void release()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        released = true;
+        condition.notify_all();
+    }
+};
+
+TEST_F(DecodePipelineTest, it_drops_frames_when_the_ring_is_full) {
+    DecodePipeline pipeline(driver, 2, DecodePipeline::DROP_NEWEST);
+    BlockedHandler handler;
+    pipeline.setRequestHandler([&](CommandIDs, RequestedConfiguration const&) { handler(); });
+    pipeline.start();
+
+    for (int i = 0; i < 10; ++i)
+        write(requests::packetize(requests::BITE()));
+    closePeer();
+    while (!pipeline.isIOFinished())
+        usleep(1000);
+    handler.release();
+    pipeline.wait();
+
+    PipelineStatistics stats = pipeline.getStatistics();
+    ASSERT_EQ(10, stats.frames_read);
+    ASSERT_GT(stats.frames_dropped, 0);
+    ASSERT_EQ(10, stats.frames_dispatched + stats.frames_dropped);
+    ASSERT_EQ(stats.frames_dispatched, handler.calls);
+}
+
+TEST_F(DecodePipelineTest, it_applies_backpressure_when_the_ring_is_full) {
+    DecodePipeline pipeline(driver, 2, DecodePipeline::BLOCK);
+    BlockedHandler handler;
+    pipeline.setRequestHandler([&](CommandIDs, RequestedConfiguration const&) { handler(); });
+    pipeline.start();
+
+    for (int i = 0; i < 10; ++i)
+        write(requests::packetize(requests::BITE()));
+    closePeer();
+    while (pipeline.getStatistics().backpressure_waits == 0)
+        usleep(1000);
+    handler.release();
+    pipeline.wait();
+
+    PipelineStatistics stats = pipeline.getStatistics();
+    ASSERT_EQ(10, stats.frames_dispatched);
+    ASSERT_EQ(0, stats.frames_dropped);
+    ASSERT_EQ(2, stats.max_ring_usage);
+}
+
+TEST_F(DecodePipelineTest, the_IO_thread_sleeps_while_the_ring_is_full) {
+    DecodePipeline pipeline(driver, 2, DecodePipeline::BLOCK);
+    BlockedHandler handler;
+    pipeline.setRequestHandler([&](CommandIDs, RequestedConfiguration const&) { handler(); });
+    pipeline.start();
+
+    for (int i = 0; i < 10; ++i)
+        write(requests::packetize(requests::BITE()));
+    while (pipeline.getStatistics().backpressure_waits == 0)
+        usleep(1000);
+    ASSERT_LT(cpuTimeDuringSleep(200), base::Time::fromMilliseconds(40));
+
+    closePeer();
+    handler.release();
+    pipeline.wait();
+    ASSERT_EQ(10, pipeline.getStatistics().frames_dispatched);
+}
@@ -2,6 +2,11 @@
 #include "gmock/gmock.h"
 #include <indra_heads_protocol/Driver.hpp>
 #include <iodrivers_base/Fixture.hpp>
+#include <iodrivers_base/IOStream.hpp>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
 
 using namespace indra_heads_protocol;
 
@@ -82,6 +87,20 @@ TEST_F(DriverTest, it_rejects_an_invalid_request_CRC) {
     ASSERT_EQ(0, getQueuedBytes());
 }
 
+TEST_F(DriverTest, it_counts_each_packet_rejected_because_of_its_CRC_once) {
+    uint8_t msg[] = {
+        0x05, 0x01, 0x01, 0xD2,
+        0x05, 0x01, 0x01, 0x21,
+        0x05, 0x01, 0x01, 0xD2
+    };
+    pushDataToDriver(msg, msg + sizeof(msg));
+    readResponse();
+    // hasPacket looks at the invalid packet too, but does not discard it
+    ASSERT_TRUE(driver.hasPacket());
+    readResponse();
+    ASSERT_EQ(1, driver.getCRCFailureCount());
+}
+
 TEST_F(DriverTest, it_returns_a_response) {
     uint8_t msg[] = {0x05, 0x01, 0x01, 0xD2 };
     pushDataToDriver(msg, msg + sizeof(msg));
@@ -194,3 +213,320 @@ TEST_F(DriverTest, it_throws_if_a_request_is_received_while_expecting_a_response
     pushDataToDriver(msg, msg + sizeof(msg));
     ASSERT_THROW(readResponse(), std::runtime_error);
 }
+
+TEST_F(DriverTest, it_frames_a_request_received_one_byte_at_a_time) {
+    uint8_t msg[] = {0x05, 0x00, 0x00, 0xB, 0x00, 0x22, 0x00, 0x16, 0x17};
+    for (size_t i = 0; i < sizeof(msg) - 1; ++i) {
+        pushDataToDriver(msg + i, msg + i + 1);
+        ASSERT_ANY_THROW( readPacket() );
+        ASSERT_EQ(i + 1, getQueuedBytes());
+    }
+    pushDataToDriver(msg + sizeof(msg) - 1, msg + sizeof(msg));
+    ASSERT_EQ(ID_ANGLES_GEO, readRequest());
+}
+
+TEST_F(DriverTest, it_writes_queued_requests_in_order) {
+    ASSERT_TRUE(driver.queueRequest(requests::StatusRefreshRatePT(RATE_20HZ)));
+    ASSERT_TRUE(driver.queueRequest(requests::BITE()));
+    ASSERT_EQ(2, driver.getQueuedRequestCount());
+    ASSERT_TRUE(readDataFromDriver().empty());
+
+    ASSERT_EQ(1, driver.writeQueuedRequests(1));
+    ASSERT_EQ(requests::packetize(requests::StatusRefreshRatePT(RATE_20HZ)),
+              readDataFromDriver());
+    ASSERT_EQ(1, driver.writeQueuedRequests());
+    ASSERT_EQ(requests::packetize(requests::BITE()), readDataFromDriver());
+    ASSERT_EQ(0, driver.getQueuedRequestCount());
+}
+
+TEST_F(DriverTest, it_refuses_to_queue_requests_when_the_queue_is_full) {
+    driver.setRequestQueueCapacity(2);
+    ASSERT_TRUE(driver.queueRequest(requests::BITE()));
+    ASSERT_TRUE(driver.queueRequest(requests::BITE()));
+    ASSERT_FALSE(driver.queueRequest(requests::BITE()));
+    ASSERT_EQ(2, driver.getQueuedRequestCount());
+}
+
+TEST_F(DriverTest, a_priority_STOP_bypasses_the_queue_and_cancels_queued_setpoints) {
+    driver.setRequestQueueCapacity(3);
+    // Wrap the ring buffer around
+    driver.queueRequest(requests::BITE());
+    driver.queueRequest(requests::BITE());
+    driver.writeQueuedRequests();
+    readDataFromDriver();
+
+    driver.queueRequest(requests::AnglesGeo(0.1, 0.3, 0.2));
+    driver.queueRequest(requests::StatusRefreshRatePT(RATE_20HZ));
+    driver.queueRequest(requests::AngularVelocityGeo(0.1, -0.2, 0.3));
+    driver.sendPriorityRequest(requests::Stop());
+    ASSERT_EQ(requests::packetize(requests::Stop()), readDataFromDriver());
+
+    ASSERT_EQ(1, driver.getQueuedRequestCount());
+    driver.writeQueuedRequests();
+    ASSERT_EQ(requests::packetize(requests::StatusRefreshRatePT(RATE_20HZ)),
+              readDataFromDriver());
+}
+
+TEST_F(DriverTest, it_writes_packets_framed_at_compile_time_as_is) {
+    driver.sendRequest(framed::AnglesGeo(0.1, 0.3, 0.2));
+    ASSERT_EQ(requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2)),
+              readDataFromDriver());
+    driver.sendPriorityRequest(framed::STOP);
+    ASSERT_EQ(requests::packetize(requests::Stop()), readDataFromDriver());
+    ASSERT_THROW(driver.sendPriorityRequest(framed::AnglesGeo(0.1, 0.3, 0.2)),
+                 std::invalid_argument);
+}
+
+TEST_F(DriverTest, clear_also_discards_the_packet_being_framed) {
+    std::vector<uint8_t> partial = requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2));
+    partial.resize(5);
+    pushDataToDriver(partial);
+    ASSERT_THROW(readPacket(), iodrivers_base::TimeoutError);
+
+    driver.clear();
+    pushDataToDriver(requests::packetize(requests::AnglesGeo(0.2, 0.1, 0.3)));
+    ASSERT_EQ(ID_ANGLES_GEO, readRequest());
+    ASSERT_NEAR(0.2, requestedConfiguration.rpy.z(), 1e-2);
+}
+
+TEST_F(DriverTest, it_rejects_priority_requests_that_are_not_STOP_or_BITE) {
+    ASSERT_THROW(driver.sendPriorityRequest(requests::AnglesGeo(0.1, 0.3, 0.2)),
+                 std::invalid_argument);
+}
+
+TEST_F(DriverTest, the_watchdog_is_disabled_by_default) {
+    ASSERT_EQ(-1, driver.getWatchdogFileDescriptor());
+    ASSERT_FALSE(driver.processWatchdog());
+}
+
+TEST_F(DriverTest, the_watchdog_switches_to_STOP_when_a_setpoint_gets_stale) {
+    driver.setSetpointTimeout(RequestedConfiguration::ANGULAR_VELOCITY_GEO,
+                              base::Time::fromMilliseconds(20));
+    pushDataToDriver(requests::packetize(requests::AngularVelocityGeo(0.1, -0.2, 0.3)));
+    readRequest();
+
+    pollfd pfd = { driver.getWatchdogFileDescriptor(), POLLIN, 0 };
+    ASSERT_EQ(1, poll(&pfd, 1, 1000));
+    ASSERT_TRUE(driver.processWatchdog());
+    ASSERT_EQ(1, driver.getWatchdogStopCount());
+
+    RequestedConfiguration conf = driver.getRequestedConfiguration();
+    ASSERT_EQ(RequestedConfiguration::STOP, conf.control_mode);
+    ASSERT_EQ(ID_STOP, conf.command_id);
+    ASSERT_GE((conf.time - requestedConfiguration.time).toMilliseconds(), 20);
+    ASSERT_EQ(ID_STOP, driver.getRequestedConfigurationHistory().back().command_id);
+}
+
+TEST_F(DriverTest, a_fresh_setpoint_rearms_the_watchdog) {
+    driver.setSetpointTimeout(RequestedConfiguration::ANGULAR_VELOCITY_GEO,
+                              base::Time::fromMilliseconds(50));
+    pushDataToDriver(requests::packetize(requests::AngularVelocityGeo(0.1, -0.2, 0.3)));
+    readRequest();
+    usleep(30000);
+    pushDataToDriver(requests::packetize(requests::AngularVelocityGeo(0.1, -0.2, 0.3)));
+    readRequest();
+    usleep(30000);
+
+    pollfd pfd = { driver.getWatchdogFileDescriptor(), POLLIN, 0 };
+    ASSERT_EQ(0, poll(&pfd, 1, 0));
+    ASSERT_FALSE(driver.processWatchdog());
+    ASSERT_EQ(RequestedConfiguration::ANGULAR_VELOCITY_GEO,
+              driver.getRequestedConfiguration().control_mode);
+}
+
+TEST_F(DriverTest, requests_that_are_not_setpoints_do_not_rearm_the_watchdog) {
+    driver.setSetpointTimeout(RequestedConfiguration::ANGULAR_VELOCITY_GEO,
+                              base::Time::fromMilliseconds(50));
+    pushDataToDriver(requests::packetize(requests::AngularVelocityGeo(0.1, -0.2, 0.3)));
+    readRequest();
+    for (int i = 0; i < 4; ++i)
+    {
+        usleep(20000);
+        pushDataToDriver(requests::packetize(requests::StatusRefreshRatePT(RATE_50HZ)));
+        readRequest();
+        pushDataToDriver(requests::packetize(requests::StatusRefreshRateIMU(RATE_50HZ)));
+        readRequest();
+    }
+
+    pollfd pfd = { driver.getWatchdogFileDescriptor(), POLLIN, 0 };
+    ASSERT_EQ(1, poll(&pfd, 1, 0));
+    ASSERT_TRUE(driver.processWatchdog());
+    ASSERT_EQ(RequestedConfiguration::STOP,
+              driver.getRequestedConfiguration().control_mode);
+}
+
+TEST_F(DriverTest, the_watchdog_uses_the_deadline_of_the_current_control_mode) {
+    driver.setSetpointTimeout(RequestedConfiguration::ANGULAR_VELOCITY_GEO,
+                              base::Time::fromMilliseconds(10));
+    pushDataToDriver(requests::packetize(requests::AngularVelocityGeo(0.1, -0.2, 0.3)));
+    readRequest();
+    pushDataToDriver(requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2)));
+    readRequest();
+    usleep(30000);
+
+    ASSERT_FALSE(driver.processWatchdog());
+    ASSERT_EQ(RequestedConfiguration::ANGLES_GEO,
+              driver.getRequestedConfiguration().control_mode);
+}
+
+static std::vector<uint8_t> response(CommandIDs command_id, ResponseStatus status = STATUS_OK)
+{
+    return requests::packetize(reply::Response(command_id, status));
+}
+
+static std::vector<uint8_t> concat(std::vector<std::vector<uint8_t>> const& packets)
+{
+    std::vector<uint8_t> result;
+    for (auto const& packet : packets)
+        result.insert(result.end(), packet.begin(), packet.end());
+    return result;
+}
+
+TEST_F(DriverTest, it_replays_the_acknowledged_configuration_in_a_single_burst) {
+    pushDataToDriver(concat({ response(ID_STATUS_REFRESH_RATE_PT),
+                              response(ID_ANGLES_GEO),
+                              response(ID_STATUS_REFRESH_RATE_IMU),
+                              response(ID_ANGLES_RELATIVE) }));
+    driver.transact(requests::StatusRefreshRatePT(RATE_20HZ));
+    driver.transact(requests::AnglesGeo(0.1, 0.3, 0.2));
+    driver.transact(requests::StatusRefreshRateIMU(RATE_50HZ));
+    driver.transact(requests::AnglesRelative(0.2, 0.1, 0.3));
+    readDataFromDriver();
+    ASSERT_EQ(3, driver.getAcknowledgedRequestCount());
+
+    pushDataToDriver(concat({ response(ID_STATUS_REFRESH_RATE_PT),
+                              response(ID_STATUS_REFRESH_RATE_IMU),
+                              response(ID_ANGLES_RELATIVE, STATUS_FAILED) }));
+    Response result = driver.restoreConfiguration();
+    ASSERT_EQ(ID_BUNDLE, result.command_id);
+    ASSERT_EQ(STATUS_FAILED, result.status);
+    ASSERT_EQ(concat({ requests::packetize(requests::StatusRefreshRatePT(RATE_20HZ)),
+                       requests::packetize(requests::StatusRefreshRateIMU(RATE_50HZ)),
+                       requests::packetize(requests::AnglesRelative(0.2, 0.1, 0.3)) }),
+              readDataFromDriver());
+
+    RequestedConfiguration conf = driver.getAcknowledgedConfiguration();
+    ASSERT_EQ(RATE_20HZ, conf.rate_status_pt);
+    ASSERT_EQ(RATE_50HZ, conf.rate_status_imu);
+    ASSERT_EQ(RequestedConfiguration::ANGLES_RELATIVE, conf.control_mode);
+    ASSERT_NEAR(0.2, conf.rpy.z(), 1e-2);
+}
+
+TEST_F(DriverTest, it_does_not_acknowledge_rejected_requests_nor_replay_self_tests) {
+    pushDataToDriver(concat({ response(ID_ANGLES_GEO),
+                              response(ID_ANGLES_RELATIVE, STATUS_FAILED) }));
+    driver.transact(requests::AnglesGeo(0.1, 0.3, 0.2));
+    driver.transact(requests::AnglesRelative(0.2, 0.1, 0.3));
+    ASSERT_EQ(RequestedConfiguration::ANGLES_GEO,
+              driver.getAcknowledgedConfiguration().control_mode);
+
+    driver.acknowledgeRequest(requests::BITE());
+    ASSERT_EQ(0, driver.getAcknowledgedRequestCount());
+    readDataFromDriver();
+    ASSERT_EQ(STATUS_OK, driver.restoreConfiguration().status);
+    ASSERT_TRUE(readDataFromDriver().empty());
+}
+
+TEST_F(DriverTest, it_writes_again_only_the_replayed_requests_that_got_no_response) {
+    driver.getRoundTripEstimator() = RoundTripEstimator(
+        base::Time::fromMilliseconds(10), base::Time::fromMilliseconds(10),
+        base::Time::fromMilliseconds(20));
+    driver.setRetransmitCount(1);
+    driver.acknowledgeRequest(requests::StatusRefreshRatePT(RATE_20HZ));
+    driver.acknowledgeRequest(requests::AnglesGeo(0.1, 0.3, 0.2));
+
+    pushDataToDriver(response(ID_STATUS_REFRESH_RATE_PT));
+    ASSERT_THROW(driver.restoreConfiguration(), iodrivers_base::TimeoutError);
+    ASSERT_EQ(concat({ requests::packetize(requests::StatusRefreshRatePT(RATE_20HZ)),
+                       requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2)),
+                       requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2)) }),
+              readDataFromDriver());
+    ASSERT_EQ(1, driver.getRetransmissionCount());
+}
+
+TEST_F(DriverTest, it_does_not_write_again_non_idempotent_replayed_requests) {
+    driver.getRoundTripEstimator() = RoundTripEstimator(
+        base::Time::fromMilliseconds(10), base::Time::fromMilliseconds(10),
+        base::Time::fromMilliseconds(20));
+    driver.setRetransmitCount(3);
+    driver.acknowledgeRequest(requests::AngularVelocityGeo(0.1, -0.2, 0.3));
+
+    ASSERT_THROW(driver.restoreConfiguration(), iodrivers_base::TimeoutError);
+    ASSERT_EQ(requests::packetize(requests::AngularVelocityGeo(0.1, -0.2, 0.3)),
+              readDataFromDriver());
+}
+
+struct SerialDriverTest : public ::testing::Test
+{
+    Driver driver;
+    int master;
+    int slave;
+
+    SerialDriverTest()
+    {
+        master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master == -1 || grantpt(master) != 0 || unlockpt(master) != 0)
+            throw std::runtime_error("failed to create a pty");
+        slave = ::open(ptsname(master), O_RDWR | O_NOCTTY);
+        if (slave == -1)
+            throw std::runtime_error("failed to open the pty slave");
+
+        termios tio;
+        tcgetattr(slave, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+        driver.setMainStream(new iodrivers_base::FDStream(slave, true));
+    }
+
+    ~SerialDriverTest()
+    {
+        ::close(master);
+    }
+
+    void writeMaster(std::vector<uint8_t> const& data)
+    {
+        ASSERT_EQ(static_cast<ssize_t>(data.size()), ::write(master, data.data(), data.size()));
+    }
+
+    bool waitSlaveReadable(int timeout_ms)
+    {
+        pollfd pfd = { slave, POLLIN, 0 };
+        return poll(&pfd, 1, timeout_ms) == 1;
+    }
+};
+
+TEST_F(SerialDriverTest, it_sets_VMIN_to_the_expected_packet_size) {
+    driver.setupLowLatencySerial(MSG_RESPONSE);
+    termios tio;
+    tcgetattr(slave, &tio);
+    ASSERT_EQ(4, tio.c_cc[VMIN]);
+    ASSERT_EQ(0, tio.c_cc[VTIME]);
+
+    driver.setupLowLatencySerial(MSG_REQUEST);
+    tcgetattr(slave, &tio);
+    ASSERT_EQ(MIN_PACKET_SIZE, tio.c_cc[VMIN]);
+}
+
+TEST_F(SerialDriverTest, it_wakes_up_only_once_a_full_response_is_available) {
+    driver.setupLowLatencySerial(MSG_RESPONSE);
+    std::vector<uint8_t> response =
+        requests::packetize(reply::Response(ID_ANGLES_GEO, STATUS_OK));
+
+    writeMaster(std::vector<uint8_t>(response.begin(), response.begin() + 2));
+    ASSERT_FALSE(waitSlaveReadable(50));
+    writeMaster(std::vector<uint8_t>(response.begin() + 2, response.end()));
+    ASSERT_TRUE(waitSlaveReadable(1000));
+    ASSERT_EQ(STATUS_OK, driver.readResponse(base::Time()).status);
+}
+
+TEST_F(SerialDriverTest, it_discards_stale_input) {
+    writeMaster(std::vector<uint8_t> { 0xFF, 0x10, ID_ANGLES_GEO, MSG_RESPONSE });
+    ASSERT_TRUE(waitSlaveReadable(1000));
+    driver.setupLowLatencySerial(MSG_RESPONSE);
+
+    writeMaster(requests::packetize(reply::Response(ID_STOP, STATUS_FAILED)));
+    Response response = driver.readResponse(base::Time::fromSeconds(1));
+    ASSERT_EQ(ID_STOP, response.command_id);
+    ASSERT_EQ(STATUS_FAILED, response.status);
+    ASSERT_EQ(0, driver.getStatus().bad_rx);
+}
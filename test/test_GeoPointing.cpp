@@ -0,0 +1,86 @@
+#include "gtest/gtest.h"
+#include <indra_heads_protocol/GeoPointing.hpp>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+TEST(GeoPointing, it_converts_geodetic_positions_to_ECEF) {
+    ASSERT_TRUE(Eigen::Vector3d(6378137, 0, 0).isApprox(
+        geodesy::toECEF(GeoTarget(0, 0, 0)), 1e-9));
+    ASSERT_TRUE(Eigen::Vector3d(0, 6378237, 0).isApprox(
+        geodesy::toECEF(GeoTarget(0, 90, 100)), 1e-9));
+    ASSERT_NEAR(6356752.314, geodesy::toECEF(GeoTarget(90, 0, 0)).z(), 1e-3);
+}
+
+TEST(GeoPointing, it_points_towards_targets_from_a_level_platform) {
+    GeoTarget platform(45, 10, 0);
+    Eigen::Vector3d level(0, 0, 0);
+
+    Eigen::Vector2d east = GeoPointing::solve(platform, level, GeoTarget(45, 10.001, 0));
+    ASSERT_NEAR(0, east.x(), 1e-4);
+    Eigen::Vector2d north = GeoPointing::solve(platform, level, GeoTarget(45.001, 10, 0));
+    ASSERT_NEAR(M_PI / 2, north.x(), 1e-3);
+    Eigen::Vector2d up = GeoPointing::solve(platform, level, GeoTarget(45, 10, 1000));
+    ASSERT_NEAR(-M_PI / 2, up.y(), 1e-6);
+
+    // Earth curvature puts targets at the same altitude slightly below the
+    // horizon
+    ASSERT_GT(east.y(), 0);
+    ASSERT_LT(east.y(), 1e-3);
+}
+
+TEST(GeoPointing, it_compensates_for_the_platform_attitude) {
+    GeoTarget platform(45, 10, 0);
+    GeoTarget north(45.001, 10, 0);
+
+    Eigen::Vector2d angles = GeoPointing::solve(platform, Eigen::Vector3d(0, 0, M_PI / 2), north);
+    ASSERT_NEAR(0, angles.x(), 1e-3);
+
+    // Nose up by 0.1 rad while facing north
+    angles = GeoPointing::solve(platform, Eigen::Vector3d(0, -0.1, M_PI / 2), north);
+    ASSERT_NEAR(0, angles.x(), 1e-3);
+    ASSERT_NEAR(0.1, angles.y(), 1e-3);
+}
+
+TEST(GeoPointing, streaming_updates_match_the_one_shot_solution) {
+    std::vector<GeoTarget> targets = {
+        GeoTarget(45.01, 10, 0), GeoTarget(44.99, 10.02, 50), GeoTarget(45, 9.9, 1000)
+    };
+    GeoPointing pointing;
+    pointing.setTargets(targets);
+    ASSERT_EQ(3, pointing.getTargetCount());
+
+    for (int step = 0; step < 3; ++step)
+    {
+        GeoTarget platform(45 + step * 1e-4, 10, 2);
+        Eigen::Vector3d rpy(0.05 * step, -0.02, 0.3 * step);
+        pointing.update(platform, rpy);
+        for (size_t i = 0; i < targets.size(); ++i)
+        {
+            Eigen::Vector2d expected = GeoPointing::solve(platform, rpy, targets[i]);
+            ASSERT_NEAR(expected.x(), pointing.getYaw()[i], 1e-9);
+            ASSERT_NEAR(expected.y(), pointing.getPitch()[i], 1e-9);
+        }
+    }
+}
+
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+TEST(GeoPointing, update_does_not_allocate_once_the_targets_are_set) {
+    GeoPointing pointing;
+    pointing.setTargets(std::vector<GeoTarget> {
+        GeoTarget(45.01, 10, 0), GeoTarget(44.99, 10.02, 50)
+    });
+    Eigen::internal::set_is_malloc_allowed(false);
+    pointing.update(GeoTarget(45, 10, 0), Eigen::Vector3d(0.1, 0.2, 0.3));
+    pointing.update(GeoTarget(45, 10.001, 0), Eigen::Vector3d(0.1, 0.2, 0.4));
+    Eigen::internal::set_is_malloc_allowed(true);
+    ASSERT_EQ(2, pointing.getYaw().size());
+}
+#endif
+
+TEST(GeoPointing, it_computes_the_range_to_the_targets) {
+    GeoPointing pointing;
+    pointing.setTargets(std::vector<GeoTarget> { GeoTarget(45.01, 10, 0) });
+    pointing.update(GeoTarget(45, 10, 0), Eigen::Vector3d(0.1, 0.2, 0.3));
+    ASSERT_NEAR(1111.3, pointing.getRange()[0], 1);
+}
@@ -0,0 +1,167 @@
+#include "gtest/gtest.h"
+#include <indra_heads_protocol/Multicast.hpp>
+#include <arpa/inet.h>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+static const char* GROUP = "239.255.71.17";
+
+struct MulticastTest : public ::testing::Test
+{
+    int port;
+    MulticastPublisherConfiguration conf;
+
+    MulticastTest()
+        : port(30000 + getpid() % 20000)
+    {
+        conf.interface = "127.0.0.1";
+    }
+
+    size_t readAll(MulticastSubscriber& subscriber, std::vector<MulticastRecord>& records)
+    {
+        // read() also returns zero for the datagrams it drops
+        size_t count = 0;
+        pollfd fd = { subscriber.getFileDescriptor(), POLLIN, 0 };
+        while (poll(&fd, 1, 100) == 1)
+            count += subscriber.read(records, base::Time());
+        return count;
+    }
+
+    /** Send a datagram of response records, bypassing MulticastPublisher */
+    void sendDatagram(uint32_t session, uint64_t first_sequence, uint32_t count)
+    {
+        std::vector<uint8_t> datagram(24);
+        uint32_t magic = 0x4d484449;
+        std::memcpy(&datagram[0], &magic, 4);
+        std::memcpy(&datagram[4], &session, 4);
+        std::memcpy(&datagram[8], &first_sequence, 8);
+        std::memcpy(&datagram[16], &count, 4);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            datagram.push_back(MulticastRecord::RESPONSE);
+            datagram.insert(datagram.end(), 8, 0);
+            datagram.push_back(ID_STOP);
+            datagram.push_back(STATUS_OK);
+        }
+        sendRaw(datagram);
+    }
+
+    void sendRaw(std::vector<uint8_t> const& datagram)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        in_addr interface;
+        inet_pton(AF_INET, "127.0.0.1", &interface);
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        inet_pton(AF_INET, GROUP, &address.sin_addr);
+        sendto(fd, datagram.data(), datagram.size(), 0,
+               reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        close(fd);
+    }
+};
+
+TEST_F(MulticastTest, all_subscribers_get_the_batched_records_in_order) {
+    MulticastSubscriber first(GROUP, port, "127.0.0.1");
+    MulticastSubscriber second(GROUP, port, "127.0.0.1");
+    MulticastPublisher publisher(GROUP, port, conf);
+
+    RequestedConfiguration configuration;
+    configuration.time = base::Time::fromMicroseconds(1234);
+    configuration.command_id = ID_ANGLES_GEO;
+    configuration.control_mode = RequestedConfiguration::ANGLES_GEO;
+    configuration.rpy = Eigen::Vector3d(0.1, 0.2, 0.3);
+    ConfigurationSnapshot snapshot = ConfigurationSnapshot::fromConfiguration(configuration);
+    publisher.publishCommand(snapshot);
+    publisher.publishResponse(Response { ID_ANGLES_GEO, STATUS_OK },
+                              base::Time::fromMicroseconds(1300));
+    publisher.publishResponse(Response { ID_STOP, STATUS_FAILED },
+                              base::Time::fromMicroseconds(1400));
+    ASSERT_EQ(3, publisher.getPendingRecordCount());
+    publisher.flush();
+    ASSERT_EQ(1, publisher.getStatistics().datagrams);
+
+    for (MulticastSubscriber* subscriber : { &first, &second })
+    {
+        std::vector<MulticastRecord> records;
+        ASSERT_EQ(3, readAll(*subscriber, records));
+        ASSERT_EQ(MulticastRecord::COMMAND, records[0].type);
+        ASSERT_EQ(0, std::memcmp(&snapshot, &records[0].configuration, sizeof(snapshot)));
+        ASSERT_EQ(MulticastRecord::RESPONSE, records[1].type);
+        ASSERT_EQ(1300, records[1].time);
+        ASSERT_EQ(ID_ANGLES_GEO, records[1].response.command_id);
+        ASSERT_EQ(STATUS_FAILED, records[2].response.status);
+        for (uint64_t i = 0; i < 3; ++i)
+            ASSERT_EQ(i, records[i].sequence);
+        ASSERT_EQ(1, subscriber->getStatistics().datagrams);
+        ASSERT_EQ(0, subscriber->getStatistics().gaps);
+    }
+}
+
+TEST_F(MulticastTest, it_sends_a_datagram_once_it_is_full) {
+    MulticastSubscriber subscriber(GROUP, port, "127.0.0.1");
+    // Room for two commands
+    conf.max_datagram_size = 24 + 2 * (1 + sizeof(ConfigurationSnapshot));
+    MulticastPublisher publisher(GROUP, port, conf);
+
+    for (int i = 0; i < 5; ++i)
+        publisher.publishCommand(ConfigurationSnapshot());
+    ASSERT_EQ(2, publisher.getStatistics().datagrams);
+    ASSERT_EQ(1, publisher.getPendingRecordCount());
+
+    std::vector<MulticastRecord> records;
+    ASSERT_EQ(4, readAll(subscriber, records));
+    ASSERT_EQ(3, records.back().sequence);
+}
+
+TEST_F(MulticastTest, the_subscriber_counts_missed_records) {
+    MulticastSubscriber subscriber(GROUP, port, "127.0.0.1");
+    sendDatagram(42, 10, 2);
+    sendDatagram(42, 15, 3);
+    std::vector<MulticastRecord> records;
+    ASSERT_EQ(5, readAll(subscriber, records));
+    ASSERT_EQ(15, records[2].sequence);
+    ASSERT_EQ(1, subscriber.getStatistics().gaps);
+    ASSERT_EQ(3, subscriber.getStatistics().missed_records);
+}
+
+TEST_F(MulticastTest, the_subscriber_drops_late_datagrams) {
+    MulticastSubscriber subscriber(GROUP, port, "127.0.0.1");
+    sendDatagram(42, 0, 2);
+    sendDatagram(42, 4, 2);
+    sendDatagram(42, 2, 2);
+    std::vector<MulticastRecord> records;
+    ASSERT_EQ(4, readAll(subscriber, records));
+    ASSERT_EQ(1, subscriber.getStatistics().late_datagrams);
+    ASSERT_EQ(2, subscriber.getStatistics().missed_records);
+}
+
+TEST_F(MulticastTest, the_subscriber_follows_a_restarted_publisher) {
+    MulticastSubscriber subscriber(GROUP, port, "127.0.0.1");
+    sendDatagram(42, 100, 2);
+    sendDatagram(43, 0, 2);
+    std::vector<MulticastRecord> records;
+    ASSERT_EQ(4, readAll(subscriber, records));
+    ASSERT_EQ(1, subscriber.getStatistics().session_changes);
+    ASSERT_EQ(0, subscriber.getStatistics().gaps);
+}
+
+TEST_F(MulticastTest, the_subscriber_rejects_invalid_datagrams) {
+    MulticastSubscriber subscriber(GROUP, port, "127.0.0.1");
+    sendRaw(std::vector<uint8_t>(64, 0x42));
+    sendDatagram(42, 0, 1);
+    std::vector<MulticastRecord> records;
+    ASSERT_EQ(1, readAll(subscriber, records));
+    ASSERT_EQ(1, subscriber.getStatistics().invalid_datagrams);
+}
+
+TEST_F(MulticastTest, it_rejects_addresses_that_are_not_multicast_groups) {
+    ASSERT_THROW(MulticastPublisher("127.0.0.1", port), std::invalid_argument);
+    ASSERT_THROW(MulticastSubscriber("not an address", port), std::invalid_argument);
+}
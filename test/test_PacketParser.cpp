@@ -0,0 +1,80 @@
+#include "gtest/gtest.h"
+#include <indra_heads_protocol/PacketParser.hpp>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+TEST(PacketParser, it_waits_for_more_bytes_on_an_empty_buffer) {
+    PacketParser parser;
+    ASSERT_EQ(0, parser.extract(nullptr, 0));
+}
+
+TEST(PacketParser, it_rejects_an_invalid_command_ID) {
+    uint8_t msg[] = { 0xF0 };
+    PacketParser parser;
+    ASSERT_EQ(-1, parser.extract(msg, 1));
+}
+
+TEST(PacketParser, it_rejects_an_invalid_message_type) {
+    uint8_t msg[] = { 0x00, 0x02 };
+    PacketParser parser;
+    ASSERT_EQ(-1, parser.extract(msg, 2));
+}
+
+TEST(PacketParser, it_returns_a_packet_received_in_one_go) {
+    uint8_t msg[] = { 0x02, 0x00, 0x02, 0xD8 };
+    PacketParser parser;
+    ASSERT_EQ(4, parser.extract(msg, 4));
+    ASSERT_EQ(0, parser.getProcessedSize());
+}
+
+TEST(PacketParser, it_resumes_a_packet_received_one_byte_at_a_time) {
+    vector<uint8_t> msg = requests::packetize(requests::PositionGeo(-0.1, 0.2, -0.3));
+    PacketParser parser;
+    for (size_t i = 0; i < msg.size() - 1; ++i) {
+        ASSERT_EQ(0, parser.extract(msg.data(), i));
+        ASSERT_EQ(i < 2 ? 0 : i, parser.getProcessedSize());
+    }
+    ASSERT_EQ(msg.size(), parser.extract(msg.data(), msg.size()));
+}
+
+TEST(PacketParser, it_rejects_an_invalid_CRC_of_a_packet_received_in_pieces) {
+    uint8_t msg[] = { 0x02, 0x00, 0x02, 0x21 };
+    PacketParser parser;
+    ASSERT_EQ(0, parser.extract(msg, 3));
+    ASSERT_EQ(-1, parser.extract(msg, 4));
+    ASSERT_EQ(0, parser.getProcessedSize());
+}
+
+TEST(PacketParser, it_restarts_if_the_buffer_does_not_start_with_the_packet_being_parsed) {
+    uint8_t partial[] = { 0x04, 0x00, 0x00 };
+    uint8_t msg[] = { 0x02, 0x00, 0x02, 0xD8 };
+    PacketParser parser;
+    ASSERT_EQ(0, parser.extract(partial, 3));
+    ASSERT_EQ(4, parser.extract(msg, 4));
+}
+
+TEST(PacketParser, it_restarts_if_the_buffer_is_shorter_than_what_was_already_parsed) {
+    vector<uint8_t> msg = requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2));
+    PacketParser parser;
+    ASSERT_EQ(0, parser.extract(msg.data(), 6));
+    ASSERT_EQ(0, parser.extract(msg.data(), 3));
+    ASSERT_EQ(3, parser.getProcessedSize());
+    ASSERT_EQ(msg.size(), parser.extract(msg.data(), msg.size()));
+}
+
+TEST(PacketParser, it_reports_why_it_rejected_a_packet) {
+    uint8_t bad_id[] = { 0xF0 };
+    uint8_t bad_type[] = { 0x00, 0x02 };
+    uint8_t bad_crc[] = { 0x02, 0x00, 0x02, 0x21 };
+    PacketParser parser;
+    parser.extract(bad_id, sizeof(bad_id));
+    ASSERT_EQ(PacketParser::REJECTED_COMMAND_ID, parser.getLastRejection());
+    ASSERT_EQ(1, parser.getRejectedSize());
+    parser.extract(bad_type, sizeof(bad_type));
+    ASSERT_EQ(PacketParser::REJECTED_MESSAGE_TYPE, parser.getLastRejection());
+    ASSERT_EQ(1, parser.getRejectedSize());
+    parser.extract(bad_crc, sizeof(bad_crc));
+    ASSERT_EQ(PacketParser::REJECTED_CRC, parser.getLastRejection());
+    ASSERT_EQ(4, parser.getRejectedSize());
+}
@@ -64,6 +64,25 @@ TEST(Protocol, AngularVelocityGeo) {
             ElementsAre(0x07, 0x00, 0x0, 0x39, 0x1, 0x73, 0x0, 0xAC, 0xD5));
 }
 
+TEST(Protocol, angle_requests_from_rpy_take_roll_pitch_yaw) {
+    Eigen::Vector3d rpy(0.2, 0.3, 0.1);
+    ASSERT_EQ(requests::packetize(requests::AnglesRelative(0.1, 0.3, 0.2)),
+              requests::packetize(requests::AnglesRelative(rpy)));
+    ASSERT_EQ(requests::packetize(requests::AnglesGeo(0.1, 0.3, 0.2)),
+              requests::packetize(requests::AnglesGeo(rpy)));
+    // decode gives them back in the same order, at the protocol resolution
+    ASSERT_TRUE(Eigen::Vector3d(0.19199, 0.29671, 0.09599).isApprox(
+        requests::decode(requests::AnglesGeo(rpy)), 1e-4));
+
+    Eigen::Vector3d velocity(0.3, -0.2, 0.1);
+    ASSERT_EQ(requests::packetize(requests::AngularVelocityRelative(0.1, -0.2, 0.3)),
+              requests::packetize(requests::AngularVelocityRelative(velocity)));
+    ASSERT_EQ(requests::packetize(requests::AngularVelocityGeo(0.1, -0.2, 0.3)),
+              requests::packetize(requests::AngularVelocityGeo(velocity)));
+    ASSERT_TRUE(Eigen::Vector3d(0.300197, -0.200713, 0.09948).isApprox(
+        requests::decode(requests::AngularVelocityGeo(velocity)), 1e-4));
+}
+
 TEST(Protocol, StabilizationTarget) {
     vector<uint8_t> packet = requests::packetize(requests::PositionGeo(-0.1, 0.2, -0.3));
     // ElementsAre supports 10 elements max
@@ -80,3 +99,44 @@ TEST(Protocol, Response) {
     ASSERT_THAT(requests::packetize(reply::Response(ID_ANGLES_GEO, STATUS_FAILED)),
             ElementsAre(0x05, 0x01, 0x01, 0xD2));
 }
+
+// The framed packets must be usable in constant expressions
+static_assert(framed::STOP.data[0] == ID_STOP, "STOP is not framed at compile time");
+static_assert(framed::STOP.data[2] == 0x00, "wrong CRC for STOP");
+static_assert(framed::SELF_TEST.data[2] == 0x15, "wrong CRC for BITE");
+
+template<size_t N>
+vector<uint8_t> bytes(framed::Packet<N> const& packet)
+{
+    return vector<uint8_t>(packet.data, packet.data + N);
+}
+
+TEST(Protocol, framed_packets_match_the_runtime_encoding) {
+    ASSERT_EQ(requests::packetize(requests::Stop()), bytes(framed::STOP));
+    ASSERT_EQ(requests::packetize(requests::BITE()), bytes(framed::SELF_TEST));
+    ASSERT_EQ(requests::packetize(requests::StatusRefreshRatePT(RATE_20HZ)),
+              bytes(framed::StatusRefreshRatePT(RATE_20HZ)));
+    ASSERT_EQ(requests::packetize(requests::StatusRefreshRateIMU(RATE_50HZ)),
+              bytes(framed::StatusRefreshRateIMU(RATE_50HZ)));
+    ASSERT_EQ(requests::packetize(requests::AnglesRelative(0.1, 0.3, 0.2)),
+              bytes(framed::AnglesRelative(0.1, 0.3, 0.2)));
+    ASSERT_EQ(requests::packetize(requests::AnglesGeo(-0.1, 7, -2 * M_PI)),
+              bytes(framed::AnglesGeo(-0.1, 7, -2 * M_PI)));
+    ASSERT_EQ(requests::packetize(requests::AngularVelocityRelative(0.1, -0.2, 0)),
+              bytes(framed::AngularVelocityRelative(0.1, -0.2, 0)));
+    ASSERT_EQ(requests::packetize(requests::AngularVelocityGeo(0.1, -0.2, 0.3)),
+              bytes(framed::AngularVelocityGeo(0.1, -0.2, 0.3)));
+    ASSERT_EQ(requests::packetize(requests::PositionGeo(-0.1, 0.2, -0.3)),
+              bytes(framed::PositionGeo(-0.1, 0.2, -0.3)));
+    ASSERT_EQ(requests::packetize(requests::PositionGeo(48.858370, -2.294481, 3276.7)),
+              bytes(framed::PositionGeo(48.858370, -2.294481, 3276.7)));
+}
+
+TEST(Protocol, framed_packets_can_be_built_at_compile_time) {
+    static constexpr auto home = framed::AnglesRelative(0.1, 0.3, 0.2);
+    static_assert(home.size() == 9, "unexpected packet size");
+    static_assert(home.command_id() == ID_ANGLES_RELATIVE, "unexpected command ID");
+    static_assert(home.data[8] == 0x04, "wrong CRC");
+    ASSERT_EQ(requests::packetize(requests::AnglesRelative(0.1, 0.3, 0.2)),
+              bytes(home));
+}
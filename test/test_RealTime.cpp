@@ -0,0 +1,96 @@
+#include "gtest/gtest.h"
+#include <indra_heads_protocol/Driver.hpp>
+#include <iodrivers_base/IOStream.hpp>
+#include <cstdlib>
+#include <new>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+static bool g_count_allocations = false;
+static size_t g_allocations = 0;
+
+void* operator new(size_t size)
+{
+    if (g_count_allocations)
+        ++g_allocations;
+    void* ptr = std::malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+static long pageFaults()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+struct RealTimeTest : public ::testing::Test
+{
+    Driver driver;
+    int peer;
+
+    RealTimeTest()
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+            throw std::runtime_error("failed to create socket pair");
+        driver.setMainStream(new iodrivers_base::FDStream(fds[0], true));
+        peer = fds[1];
+    }
+
+    ~RealTimeTest()
+    {
+        ::close(peer);
+    }
+
+    void roundTrip()
+    {
+        static const uint8_t request[] =
+            { 0x05, 0x00, 0x00, 0xB, 0x00, 0x22, 0x00, 0x16, 0x17 };
+        uint8_t buffer[64];
+
+        // Head side
+        ::write(peer, request, sizeof(request));
+        driver.readRequest();
+        driver.writeResponse(Response { ID_ANGLES_GEO, STATUS_OK });
+        ::read(peer, buffer, sizeof(buffer));
+
+        // Client side
+        driver.sendRequest(requests::AngularVelocityGeo(0.1, 0.2, 0.3));
+        ::read(peer, buffer, sizeof(buffer));
+        static const uint8_t response[] = { 0x05, 0x01, 0x01, 0xD2 };
+        ::write(peer, response, sizeof(response));
+        driver.readResponse();
+    }
+};
+
+TEST_F(RealTimeTest, the_default_configuration_is_a_noop) {
+    driver.setupRealTime(RealTimeConfiguration());
+}
+
+TEST_F(RealTimeTest, it_does_not_allocate_nor_page_fault_in_steady_state) {
+    driver.setupRealTime(RealTimeConfiguration());
+    for (int i = 0; i < 100; ++i)
+        roundTrip();
+
+    long faults = pageFaults();
+    g_allocations = 0;
+    g_count_allocations = true;
+    for (int i = 0; i < 1000; ++i)
+        roundTrip();
+    g_count_allocations = false;
+
+    ASSERT_EQ(0, g_allocations);
+    ASSERT_EQ(0, pageFaults() - faults);
+}
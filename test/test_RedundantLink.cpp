@@ -0,0 +1,161 @@
+#include "gtest/gtest.h"
+#include "SimulatedHeadFixture.hpp"
+#include <indra_heads_protocol/RedundantLink.hpp>
+#include <csignal>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+/** A simulated head reachable through two links */
+struct RedundantLinkTest : public ::testing::Test
+{
+    SimulatedHeadConnection connections[2];
+    RedundantLink link;
+
+    RedundantLinkTest()
+        : link(connections[0].client, connections[1].client)
+    {
+        // Writing on a link whose peer is gone must be an error, not a signal
+        signal(SIGPIPE, SIG_IGN);
+    }
+
+    void startHeads(SimulatedHeadConfiguration const& primary,
+                    SimulatedHeadConfiguration const& backup = SimulatedHeadConfiguration())
+    {
+        SimulatedHeadConfiguration const* confs[2] = { &primary, &backup };
+        for (int i = 0; i < 2; ++i)
+        {
+            connections[i].startHead(*confs[i]);
+            connections[i].client.getRoundTripEstimator() =
+                RoundTripEstimator(ms(50), ms(10), ms(100));
+        }
+    }
+
+    /** Simulate the loss of a link on the head side */
+    void dropLink(RedundantLink::Link l)
+    {
+        shutdown(connections[l].head_driver.getFileDescriptor(), SHUT_RDWR);
+    }
+
+    /** What the head of the given link received so far */
+    ConfigurationHistory const& received(RedundantLink::Link l)
+    {
+        return connections[l].head_driver.getRequestedConfigurationHistory();
+    }
+
+    /** Stop the heads and return how many requests the given one got */
+    size_t stopHeads(RedundantLink::Link l)
+    {
+        for (int i = 0; i < 2; ++i)
+            connections[i].stopHead();
+        return received(l).size();
+    }
+};
+
+TEST_F(RedundantLinkTest, it_uses_the_primary_while_it_answers) {
+    startHeads(SimulatedHeadConfiguration());
+    for (int i = 0; i < 5; ++i)
+        ASSERT_EQ(STATUS_OK, link.transact(requests::AnglesGeo(0.1, 0.2, 0.3)).status);
+    ASSERT_EQ(RedundantLink::PRIMARY, link.getActiveLink());
+    ASSERT_EQ(0, link.getStatistics().failovers);
+    ASSERT_EQ(0, stopHeads(RedundantLink::BACKUP));
+    ASSERT_EQ(5, received(RedundantLink::PRIMARY).size());
+}
+
+TEST_F(RedundantLinkTest, it_fails_over_within_the_transaction_when_the_primary_drops) {
+    startHeads(SimulatedHeadConfiguration());
+    ASSERT_EQ(STATUS_OK, link.transact(requests::AnglesGeo(0.1, 0.2, 0.3)).status);
+    dropLink(RedundantLink::PRIMARY);
+
+    ASSERT_EQ(STATUS_OK, link.transact(requests::AnglesGeo(0.1, 0.2, 0.3)).status);
+    ASSERT_EQ(RedundantLink::BACKUP, link.getActiveLink());
+    ASSERT_TRUE(link.isLinkFailed(RedundantLink::PRIMARY));
+    ASSERT_EQ(1, link.getStatistics().failovers);
+    ASSERT_EQ(1, link.getStatistics().link_errors);
+
+    // Non-idempotent requests go to the backup too
+    ASSERT_EQ(STATUS_OK, link.transact(requests::AngularVelocityGeo(0.1, 0.2, 0.3)).status);
+    ASSERT_EQ(2, stopHeads(RedundantLink::BACKUP));
+}
+
+TEST_F(RedundantLinkTest, it_fails_over_when_the_primary_stops_answering) {
+    SimulatedHeadConfiguration silent;
+    silent.loss = 1;
+    startHeads(silent);
+
+    base::Time start = base::Time::now();
+    ASSERT_EQ(STATUS_OK, link.transact(requests::AnglesGeo(0.1, 0.2, 0.3)).status);
+    // One response timeout on the primary, then one round trip on the backup
+    ASSERT_LT(base::Time::now() - start, ms(100));
+    ASSERT_EQ(RedundantLink::BACKUP, link.getActiveLink());
+    ASSERT_FALSE(link.isLinkFailed(RedundantLink::PRIMARY));
+    ASSERT_EQ(1, link.getStatistics().missed_responses);
+    ASSERT_EQ(1, link.getStatistics().failovers);
+}
+
+TEST_F(RedundantLinkTest, it_does_not_resend_non_idempotent_requests_on_failover) {
+    SimulatedHeadConfiguration silent;
+    silent.loss = 1;
+    startHeads(silent);
+
+    ASSERT_THROW(link.transact(requests::AngularVelocityGeo(0.1, 0.2, 0.3)),
+                 iodrivers_base::TimeoutError);
+    ASSERT_EQ(RedundantLink::BACKUP, link.getActiveLink());
+    ASSERT_EQ(STATUS_OK, link.transact(requests::AngularVelocityGeo(0.1, 0.2, 0.3)).status);
+    ASSERT_EQ(1, stopHeads(RedundantLink::BACKUP));
+}
+
+TEST_F(RedundantLinkTest, it_gives_up_when_both_links_are_up_but_the_head_is_silent) {
+    SimulatedHeadConfiguration silent;
+    silent.loss = 1;
+    startHeads(silent, silent);
+
+    ASSERT_THROW(link.transact(requests::AnglesGeo(0.1, 0.2, 0.3)),
+                 iodrivers_base::TimeoutError);
+    ASSERT_EQ(2, link.getStatistics().missed_responses);
+    ASSERT_FALSE(link.isLinkFailed(RedundantLink::PRIMARY));
+    ASSERT_FALSE(link.isLinkFailed(RedundantLink::BACKUP));
+    ASSERT_EQ(1, stopHeads(RedundantLink::BACKUP));
+    ASSERT_EQ(1, received(RedundantLink::PRIMARY).size());
+}
+
+TEST_F(RedundantLinkTest, it_retransmits_on_the_active_link_until_the_threshold) {
+    SimulatedHeadConfiguration silent;
+    silent.loss = 1;
+    startHeads(silent);
+    link.setFailoverThreshold(3);
+
+    ASSERT_EQ(STATUS_OK, link.transact(requests::AnglesGeo(0.1, 0.2, 0.3)).status);
+    ASSERT_EQ(3, link.getStatistics().missed_responses);
+    ASSERT_EQ(1, stopHeads(RedundantLink::BACKUP));
+    ASSERT_EQ(3, received(RedundantLink::PRIMARY).size());
+}
+
+TEST_F(RedundantLinkTest, it_accepts_a_late_response_on_the_standby_link) {
+    SimulatedHeadConfiguration slow;
+    slow.delay = ms(70);
+    SimulatedHeadConfiguration slower;
+    slower.delay = ms(300);
+    startHeads(slow, slower);
+
+    ASSERT_EQ(STATUS_OK, link.transact(requests::AnglesGeo(0.1, 0.2, 0.3)).status);
+    ASSERT_EQ(RedundantLink::BACKUP, link.getActiveLink());
+    ASSERT_EQ(1, link.getStatistics().standby_responses);
+}
+
+TEST_F(RedundantLinkTest, it_throws_once_both_links_failed) {
+    startHeads(SimulatedHeadConfiguration());
+    dropLink(RedundantLink::PRIMARY);
+    dropLink(RedundantLink::BACKUP);
+    ASSERT_THROW(link.transact(requests::AnglesGeo(0.1, 0.2, 0.3)), iodrivers_base::UnixError);
+}
+
+TEST_F(RedundantLinkTest, failed_links_are_unused_until_restored) {
+    startHeads(SimulatedHeadConfiguration());
+    dropLink(RedundantLink::PRIMARY);
+    ASSERT_EQ(STATUS_OK, link.transact(requests::AnglesGeo(0.1, 0.2, 0.3)).status);
+    ASSERT_THROW(link.setActiveLink(RedundantLink::PRIMARY), std::invalid_argument);
+    link.restoreLink(RedundantLink::PRIMARY);
+    link.setActiveLink(RedundantLink::PRIMARY);
+    ASSERT_EQ(RedundantLink::PRIMARY, link.getActiveLink());
+}
@@ -0,0 +1,144 @@
+#include "gtest/gtest.h"
+#include <indra_heads_protocol/RequestServer.hpp>
+#include <indra_heads_protocol/Multicast.hpp>
+#include <iodrivers_base/IOStream.hpp>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+struct RequestServerTest : public ::testing::Test
+{
+    Driver driver;
+    int client_fd;
+    std::vector<CommandIDs> handled;
+
+    RequestServerTest()
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+            throw std::runtime_error("failed to create socket pair");
+        client_fd = fds[0];
+        driver.setMainStream(new iodrivers_base::FDStream(fds[1], true));
+    }
+
+    ~RequestServerTest()
+    {
+        ::close(client_fd);
+    }
+
+    RequestServer::Handler handler()
+    {
+        return [this](CommandIDs command_id, RequestedConfiguration const& conf) {
+            handled.push_back(command_id);
+            return command_id == ID_BITE ? STATUS_FAILED : STATUS_OK;
+        };
+    }
+
+    void sendRequests(std::vector<std::vector<uint8_t>> const& packets)
+    {
+        std::vector<uint8_t> burst;
+        for (auto const& p : packets)
+            burst.insert(burst.end(), p.begin(), p.end());
+        ASSERT_EQ(static_cast<ssize_t>(burst.size()),
+                  write(client_fd, burst.data(), burst.size()));
+    }
+
+    std::vector<uint8_t> readResponses(size_t count)
+    {
+        std::vector<uint8_t> result(count * 4);
+        size_t received = 0;
+        while (received < result.size())
+        {
+            ssize_t r = read(client_fd, result.data() + received, result.size() - received);
+            if (r <= 0)
+                throw std::runtime_error("failed to read the responses");
+            received += r;
+        }
+        return result;
+    }
+};
+
+TEST_F(RequestServerTest, it_handles_a_burst_and_answers_in_order) {
+    RequestServer server(driver, handler());
+    sendRequests({
+        requests::packetize(requests::AnglesGeo(0.1, 0.2, 0.3)),
+        requests::packetize(requests::BITE()),
+        requests::packetize(requests::Stop())
+    });
+
+    ASSERT_EQ(3, server.serve(base::Time::fromSeconds(1)));
+    ASSERT_EQ((std::vector<CommandIDs> { ID_ANGLES_GEO, ID_BITE, ID_STOP }), handled);
+
+    std::vector<uint8_t> expected;
+    for (auto const& p : {
+            requests::packetize(reply::Response(ID_ANGLES_GEO, STATUS_OK)),
+            requests::packetize(reply::Response(ID_BITE, STATUS_FAILED)),
+            requests::packetize(reply::Response(ID_STOP, STATUS_OK)) })
+        expected.insert(expected.end(), p.begin(), p.end());
+    ASSERT_EQ(expected, readResponses(3));
+
+    ASSERT_EQ(3, server.getStatistics().requests);
+    ASSERT_EQ(1, server.getStatistics().bursts);
+    ASSERT_EQ(3, server.getStatistics().max_burst_size);
+}
+
+TEST_F(RequestServerTest, the_handler_sees_the_updated_configuration) {
+    RequestServer server(driver,
+        [](CommandIDs command_id, RequestedConfiguration const& conf) {
+            return conf.control_mode == RequestedConfiguration::ANGLES_GEO ?
+                STATUS_OK : STATUS_FAILED;
+        });
+    sendRequests({ requests::packetize(requests::AnglesGeo(0.1, 0.2, 0.3)) });
+    ASSERT_EQ(1, server.serve(base::Time::fromSeconds(1)));
+    ASSERT_EQ(requests::packetize(reply::Response(ID_ANGLES_GEO, STATUS_OK)),
+              readResponses(1));
+}
+
+TEST_F(RequestServerTest, it_limits_the_size_of_a_burst) {
+    RequestServer server(driver, handler(), 2);
+    sendRequests({
+        requests::packetize(requests::Stop()),
+        requests::packetize(requests::Stop()),
+        requests::packetize(requests::Stop())
+    });
+
+    ASSERT_EQ(2, server.serve(base::Time::fromSeconds(1)));
+    ASSERT_EQ(1, server.serve(base::Time::fromSeconds(1)));
+    readResponses(3);
+    ASSERT_EQ(2, server.getStatistics().bursts);
+}
+
+TEST_F(RequestServerTest, it_returns_zero_on_timeout) {
+    RequestServer server(driver, handler());
+    ASSERT_EQ(0, server.serve(base::Time::fromMilliseconds(10)));
+    ASSERT_TRUE(handled.empty());
+    ASSERT_EQ(0, server.getStatistics().bursts);
+}
+
+TEST_F(RequestServerTest, it_publishes_a_burst_as_a_single_datagram) {
+    int port = 30000 + getpid() % 20000;
+    MulticastSubscriber subscriber("239.255.71.17", port, "127.0.0.1");
+    MulticastPublisherConfiguration conf;
+    conf.interface = "127.0.0.1";
+    MulticastPublisher publisher("239.255.71.17", port, conf);
+
+    RequestServer server(driver, handler());
+    server.setPublisher(&publisher);
+    sendRequests({
+        requests::packetize(requests::AnglesGeo(0.1, 0.2, 0.3)),
+        requests::packetize(requests::BITE())
+    });
+    ASSERT_EQ(2, server.serve(base::Time::fromSeconds(1)));
+    ASSERT_EQ(1, publisher.getStatistics().datagrams);
+
+    std::vector<MulticastRecord> records;
+    ASSERT_EQ(4, subscriber.read(records, base::Time::fromSeconds(1)));
+    ASSERT_EQ(MulticastRecord::COMMAND, records[0].type);
+    ASSERT_EQ(ID_ANGLES_GEO, records[0].configuration.command_id);
+    ASSERT_EQ(ID_BITE, records[1].configuration.command_id);
+    ASSERT_EQ(MulticastRecord::RESPONSE, records[2].type);
+    ASSERT_EQ(ID_ANGLES_GEO, records[2].response.command_id);
+    ASSERT_EQ(STATUS_FAILED, records[3].response.status);
+}
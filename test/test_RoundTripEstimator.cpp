@@ -0,0 +1,95 @@
+#include "gtest/gtest.h"
+#include "SimulatedHeadFixture.hpp"
+#include <indra_heads_protocol/RoundTripEstimator.hpp>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+TEST(RoundTripEstimator, it_uses_the_initial_timeout_until_the_first_sample) {
+    RoundTripEstimator estimator(ms(500));
+    ASSERT_FALSE(estimator.hasSamples());
+    ASSERT_EQ(ms(500), estimator.getTimeout());
+}
+
+TEST(RoundTripEstimator, it_initializes_the_estimate_with_the_first_sample) {
+    RoundTripEstimator estimator(ms(500), ms(1));
+    estimator.addSample(ms(20));
+    ASSERT_EQ(ms(20), estimator.getSmoothedRTT());
+    ASSERT_EQ(ms(10), estimator.getRTTVariation());
+    ASSERT_EQ(ms(60), estimator.getTimeout());
+}
+
+TEST(RoundTripEstimator, it_smoothes_the_samples) {
+    RoundTripEstimator estimator(ms(500), ms(1));
+    estimator.addSample(ms(20));
+    estimator.addSample(ms(28));
+    ASSERT_EQ(ms(21), estimator.getSmoothedRTT());
+    ASSERT_EQ(ms(9.5), estimator.getRTTVariation());
+    ASSERT_EQ(ms(59), estimator.getTimeout());
+}
+
+TEST(RoundTripEstimator, it_clamps_the_timeout) {
+    RoundTripEstimator estimator(ms(500), ms(10), ms(100));
+    estimator.addSample(ms(1));
+    ASSERT_EQ(ms(10), estimator.getTimeout());
+    estimator.addSample(ms(1000));
+    ASSERT_EQ(ms(100), estimator.getTimeout());
+}
+
+TEST(RoundTripEstimator, it_backs_off_exponentially) {
+    RoundTripEstimator estimator(ms(500), ms(1), ms(3000));
+    estimator.backoff();
+    ASSERT_EQ(ms(1000), estimator.getTimeout());
+    estimator.backoff();
+    estimator.backoff();
+    ASSERT_EQ(ms(3000), estimator.getTimeout());
+    estimator.addSample(ms(20));
+    ASSERT_EQ(ms(60), estimator.getTimeout());
+}
+
+struct SimulatedHeadTest : public ::testing::Test, public SimulatedHeadConnection
+{
+};
+
+TEST_F(SimulatedHeadTest, adaptive_timeouts_follow_a_jittery_head) {
+    SimulatedHeadConfiguration conf;
+    conf.delay = ms(5);
+    conf.jitter = ms(10);
+    startHead(conf);
+
+    for (int i = 0; i < 30; ++i)
+        ASSERT_EQ(STATUS_OK, client.transact(requests::AnglesGeo(0.1, 0.2, 0.3)).status);
+
+    RoundTripEstimator const& estimator = client.getRoundTripEstimator();
+    ASSERT_GE(estimator.getSmoothedRTT(), ms(5));
+    ASSERT_LE(estimator.getSmoothedRTT(), ms(20));
+    // Well below the initial 1s, but above the worst-case response time
+    ASSERT_LT(estimator.getTimeout(), ms(200));
+    ASSERT_GT(estimator.getTimeout(), ms(15));
+}
+
+TEST_F(SimulatedHeadTest, it_retransmits_idempotent_requests_on_timeout) {
+    SimulatedHeadConfiguration conf;
+    conf.jitter = ms(2);
+    conf.loss = 0.3;
+    startHead(conf);
+    client.getRoundTripEstimator() = RoundTripEstimator(ms(50), ms(10), ms(100));
+    client.setRetransmitCount(10);
+
+    for (int i = 0; i < 20; ++i)
+        ASSERT_EQ(STATUS_OK, client.transact(requests::StatusRefreshRatePT(RATE_20HZ)).status);
+    ASSERT_GT(client.getRetransmissionCount(), 0);
+}
+
+TEST_F(SimulatedHeadTest, it_does_not_retransmit_non_idempotent_requests) {
+    SimulatedHeadConfiguration conf;
+    conf.loss = 1;
+    startHead(conf);
+    client.getRoundTripEstimator() = RoundTripEstimator(ms(20), ms(10), ms(100));
+    client.setRetransmitCount(10);
+
+    ASSERT_THROW(client.transact(requests::AngularVelocityGeo(0.1, 0.2, 0.3)),
+                 iodrivers_base::TimeoutError);
+    ASSERT_EQ(0, client.getRetransmissionCount());
+    ASSERT_EQ(ms(40), client.getRoundTripEstimator().getTimeout());
+}
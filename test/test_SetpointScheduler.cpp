@@ -0,0 +1,108 @@
+#include "gtest/gtest.h"
+#include <indra_heads_protocol/SetpointScheduler.hpp>
+#include <iodrivers_base/Fixture.hpp>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+static Setpoint makeSetpoint(CommandIDs command_id, double t, Eigen::Vector3d const& rpy)
+{
+    Setpoint setpoint;
+    setpoint.time = base::Time::fromSeconds(t);
+    setpoint.command_id = command_id;
+    setpoint.rpy = rpy;
+    return setpoint;
+}
+
+static Setpoint makeTarget(double t, double lat, double lon, double alt)
+{
+    Setpoint setpoint;
+    setpoint.time = base::Time::fromSeconds(t);
+    setpoint.command_id = ID_STABILIZATION_TARGET;
+    setpoint.lat_lon_alt = GeoTarget(lat, lon, alt);
+    return setpoint;
+}
+
+TEST(SetpointInterpolation, it_holds_the_first_and_last_setpoints) {
+    Trajectory trajectory = {
+        makeSetpoint(ID_ANGULAR_VELOCITY_GEO, 1, Eigen::Vector3d(0, 0, 0)),
+        makeSetpoint(ID_ANGULAR_VELOCITY_GEO, 2, Eigen::Vector3d(1, 1, 1))
+    };
+    ASSERT_EQ(Eigen::Vector3d(0, 0, 0),
+        interpolate(trajectory, base::Time::fromSeconds(0)).rpy);
+    ASSERT_EQ(Eigen::Vector3d(1, 1, 1),
+        interpolate(trajectory, base::Time::fromSeconds(3)).rpy);
+}
+
+TEST(SetpointInterpolation, it_interpolates_velocities_linearly) {
+    Trajectory trajectory = {
+        makeSetpoint(ID_ANGULAR_VELOCITY_GEO, 0, Eigen::Vector3d(0, 0, 0)),
+        makeSetpoint(ID_ANGULAR_VELOCITY_GEO, 1, Eigen::Vector3d(0.1, -0.2, 0.4))
+    };
+    Setpoint result = interpolate(trajectory, base::Time::fromSeconds(0.25));
+    ASSERT_TRUE(Eigen::Vector3d(0.025, -0.05, 0.1).isApprox(result.rpy, 1e-6));
+}
+
+TEST(SetpointInterpolation, it_interpolates_angles_along_the_shortest_arc) {
+    Trajectory trajectory = {
+        makeSetpoint(ID_ANGLES_GEO, 0, Eigen::Vector3d(0, 0, M_PI - 0.1)),
+        makeSetpoint(ID_ANGLES_GEO, 1, Eigen::Vector3d(0, 0, -M_PI + 0.1))
+    };
+    Setpoint result = interpolate(trajectory, base::Time::fromSeconds(0.5));
+    ASSERT_NEAR(M_PI, std::abs(result.rpy.z()), 1e-6);
+}
+
+TEST(SetpointInterpolation, it_interpolates_geo_targets) {
+    Trajectory trajectory = {
+        makeTarget(0, 10, 20, 100),
+        makeTarget(2, 11, 22, 200)
+    };
+    Setpoint result = interpolate(trajectory, base::Time::fromSeconds(1));
+    ASSERT_NEAR(10.5, result.lat_lon_alt.latitude, 1e-9);
+    ASSERT_NEAR(21, result.lat_lon_alt.longitude, 1e-9);
+    ASSERT_NEAR(150, result.lat_lon_alt.altitude, 1e-9);
+}
+
+struct SetpointSchedulerTest : public ::testing::Test, public iodrivers_base::Fixture<Driver>
+{
+    SetpointSchedulerTest()
+    {
+        driver.openURI("test://");
+    }
+};
+
+TEST_F(SetpointSchedulerTest, it_rejects_trajectories_mixing_commands) {
+    SetpointScheduler scheduler(driver, base::Time::fromMilliseconds(10));
+    Trajectory trajectory = {
+        makeSetpoint(ID_ANGLES_GEO, 0, Eigen::Vector3d(0, 0, 0)),
+        makeSetpoint(ID_ANGULAR_VELOCITY_GEO, 1, Eigen::Vector3d(0, 0, 0))
+    };
+    ASSERT_THROW(scheduler.setTrajectory(trajectory), std::invalid_argument);
+}
+
+TEST_F(SetpointSchedulerTest, it_rejects_unsorted_trajectories) {
+    SetpointScheduler scheduler(driver, base::Time::fromMilliseconds(10));
+    Trajectory trajectory = {
+        makeSetpoint(ID_ANGLES_GEO, 1, Eigen::Vector3d(0, 0, 0)),
+        makeSetpoint(ID_ANGLES_GEO, 0, Eigen::Vector3d(0, 0, 0))
+    };
+    ASSERT_THROW(scheduler.setTrajectory(trajectory), std::invalid_argument);
+}
+
+TEST_F(SetpointSchedulerTest, it_streams_the_trajectory_at_the_requested_period) {
+    SetpointScheduler scheduler(driver, base::Time::fromMilliseconds(10));
+    Trajectory trajectory = {
+        makeSetpoint(ID_ANGULAR_VELOCITY_GEO, 0, Eigen::Vector3d(0, 0, 0)),
+        makeSetpoint(ID_ANGULAR_VELOCITY_GEO, 0.05, Eigen::Vector3d(0.1, 0.2, 0.3))
+    };
+    scheduler.setTrajectory(trajectory);
+    scheduler.run();
+
+    auto stats = scheduler.getStatistics();
+    ASSERT_GE(stats.ticks + stats.missed_ticks, 6);
+    auto data = readDataFromDriver();
+    ASSERT_EQ(stats.ticks * 9, data.size());
+    // The last setpoint is the end of the trajectory
+    vector<uint8_t> last(data.end() - 9, data.end());
+    ASSERT_EQ(requests::packetize(requests::AngularVelocityGeo(0.3, 0.2, 0.1)), last);
+}
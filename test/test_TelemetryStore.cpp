@@ -0,0 +1,175 @@
+#include "gtest/gtest.h"
+#include <indra_heads_protocol/TelemetryStore.hpp>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <unistd.h>
+
+using namespace std;
+using namespace indra_heads_protocol;
+
+struct TelemetryStoreTest : public ::testing::Test
+{
+    std::string path;
+
+    TelemetryStoreTest()
+    {
+        char name[] = "/tmp/indra_heads_telemetry_XXXXXX";
+        int fd = mkstemp(name);
+        close(fd);
+        path = name;
+    }
+
+    ~TelemetryStoreTest()
+    {
+        unlink(path.c_str());
+    }
+
+    /** Records at 50Hz with jitter, slowly varying values and occasional
+     * jumps
+     */
+    std::vector<ConfigurationSnapshot> makeRecords(size_t count, int64_t start = 0)
+    {
+        std::mt19937 rng(count);
+        std::vector<ConfigurationSnapshot> records(count);
+        int64_t time = start;
+        for (size_t i = 0; i < count; ++i)
+        {
+            ConfigurationSnapshot& r = records[i];
+            r = ConfigurationSnapshot();
+            time += 20000 + static_cast<int>(rng() % 200) - 100;
+            r.time = time;
+            r.latitude = 43600000 + i / 10;
+            r.longitude = -1400000 - static_cast<int>(i);
+            r.altitude = 150;
+            r.rpy[0] = static_cast<int16_t>(i % 3600);
+            r.rpy[1] = -450;
+            r.rpy[2] = (rng() % 100 == 0) ? -32768 : 32767;
+            r.command_id = (i / 1000) % 9;
+            r.rate_status_pt = RATE_50HZ;
+            r.control_mode = 3;
+            r.flags = ConfigurationSnapshot::HAS_RPY | ConfigurationSnapshot::HAS_LAT_LON_ALT;
+        }
+        return records;
+    }
+};
+
+static void assertSameRecords(std::vector<ConfigurationSnapshot> const& expected,
+                              std::vector<ConfigurationSnapshot> const& actual)
+{
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+        ASSERT_EQ(0, std::memcmp(&expected[i], &actual[i], sizeof(ConfigurationSnapshot))) << "record " << i;
+}
+
+TEST_F(TelemetryStoreTest, it_reads_back_what_was_written) {
+    auto records = makeRecords(10000);
+    {
+        TelemetryWriter writer(path, 1000);
+        for (auto const& r : records)
+            writer.push(r);
+    }
+
+    TelemetryReader reader(path);
+    ASSERT_EQ(10000, reader.getRecordCount());
+    ASSERT_EQ(10, reader.getBlockCount());
+    int64_t first, last;
+    ASSERT_TRUE(reader.getTimeRange(first, last));
+    ASSERT_EQ(records.front().time, first);
+    ASSERT_EQ(records.back().time, last);
+
+    std::vector<ConfigurationSnapshot> result;
+    ASSERT_EQ(10000, reader.query(first, last, result));
+    assertSameRecords(records, result);
+}
+
+TEST_F(TelemetryStoreTest, it_returns_only_the_records_within_the_queried_range) {
+    auto records = makeRecords(5000);
+    {
+        TelemetryWriter writer(path, 512);
+        for (auto const& r : records)
+            writer.push(r);
+    }
+
+    TelemetryReader reader(path);
+    int64_t from = records[1234].time;
+    int64_t to = records[2345].time;
+    std::vector<ConfigurationSnapshot> result;
+    ASSERT_EQ(1112, reader.query(from, to, result));
+    assertSameRecords(std::vector<ConfigurationSnapshot>(
+        records.begin() + 1234, records.begin() + 2346), result);
+
+    result.clear();
+    ASSERT_EQ(0, reader.query(records.back().time + 1, records.back().time + 1000, result));
+    ASSERT_EQ(0, reader.query(0, records.front().time - 1, result));
+}
+
+TEST_F(TelemetryStoreTest, constant_columns_and_a_regular_rate_cost_about_a_byte_per_record) {
+    {
+        TelemetryWriter writer(path, 4096);
+        ConfigurationSnapshot r = ConfigurationSnapshot();
+        for (int i = 0; i < 4096; ++i)
+        {
+            r.time = i * 20000;
+            writer.push(r);
+        }
+        writer.flush();
+        ASSERT_LT(writer.getBytesWritten(), 4096 + 200);
+    }
+}
+
+TEST_F(TelemetryStoreTest, it_appends_to_an_existing_file) {
+    auto records = makeRecords(3000);
+    {
+        TelemetryWriter writer(path, 1024);
+        for (size_t i = 0; i < 1500; ++i)
+            writer.push(records[i]);
+    }
+    {
+        TelemetryWriter writer(path, 1024);
+        ASSERT_THROW(writer.push(records[0]), std::invalid_argument);
+        for (size_t i = 1500; i < 3000; ++i)
+            writer.push(records[i]);
+    }
+
+    TelemetryReader reader(path);
+    std::vector<ConfigurationSnapshot> result;
+    reader.query(records.front().time, records.back().time, result);
+    assertSameRecords(records, result);
+}
+
+TEST_F(TelemetryStoreTest, an_incomplete_block_is_ignored_and_overwritten) {
+    auto records = makeRecords(2000);
+    {
+        TelemetryWriter writer(path, 1000);
+        for (size_t i = 0; i < 1000; ++i)
+            writer.push(records[i]);
+    }
+    uint64_t complete_size = TelemetryReader(path).getValidSize();
+    {
+        TelemetryWriter writer(path, 1000);
+        for (size_t i = 1000; i < 2000; ++i)
+            writer.push(records[i]);
+    }
+    // Simulate a writer killed in the middle of the second block
+    ASSERT_EQ(0, truncate(path.c_str(), complete_size + 300));
+    ASSERT_EQ(1000, TelemetryReader(path).getRecordCount());
+
+    {
+        TelemetryWriter writer(path, 1000);
+        for (size_t i = 1000; i < 2000; ++i)
+            writer.push(records[i]);
+    }
+    TelemetryReader reader(path);
+    std::vector<ConfigurationSnapshot> result;
+    reader.query(records.front().time, records.back().time, result);
+    assertSameRecords(records, result);
+}
+
+TEST_F(TelemetryStoreTest, it_rejects_files_that_are_not_telemetry_files) {
+    {
+        std::ofstream out(path);
+        out << std::string(512, 'x');
+    }
+    ASSERT_THROW(TelemetryReader reader(path), std::runtime_error);
+}